@@ -0,0 +1,93 @@
+#include "AllocationCounter.h"
+#include "FrameArena.h"
+#include <new>
+#include <pthread.h>
+
+// (only the counted thread writes these, no atomics needed)
+static pthread_t countedThread;
+static bool hasCountedThread=false;
+static unsigned long long allocationCount=0, allocationBytes=0;
+
+void AllocationCounter::setCountedThread() {
+    countedThread=pthread_self();
+    hasCountedThread=true;
+}
+
+bool AllocationCounter::isCountedThread() {
+    return hasCountedThread && pthread_equal(pthread_self(), countedThread);
+}
+
+unsigned long long AllocationCounter::getCount() {
+    return allocationCount;
+}
+
+unsigned long long AllocationCounter::getBytes() {
+    return allocationBytes;
+}
+
+#ifdef ALLOCATION_ACCOUNTING
+
+// (dynamic exception specifications are deprecated in C++11 and ill-formed in C++17)
+#if __cplusplus >= 201103L
+#define NO_THROW noexcept
+#define THROWS_BAD_ALLOC
+#else
+#define NO_THROW throw()
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#endif
+
+static inline void* countedMalloc(size_t size) {
+    if (AllocationCounter::isCountedThread()) {
+        // Inside a FrameArenaScope: scratch memory of the frame (not a heap allocation, unless the arena is full):
+        if (FrameArena::getActive()) {
+            void* p=FrameArena::getActive()->allocate(size ? size : 1);
+            if (p) return p;
+        }
+        allocationCount++;
+        allocationBytes+=size;
+    }
+    return malloc(size ? size : 1);
+}
+
+// (arena memory is released at the frame boundary, see FrameArena::reset)
+static inline void countedFree(void* p) {
+    if (!FrameArena::owns(p)) free(p);
+}
+
+void* operator new(size_t size) THROWS_BAD_ALLOC {
+    void* p=countedMalloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) THROWS_BAD_ALLOC {
+    void* p=countedMalloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) NO_THROW {
+    return countedMalloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) NO_THROW {
+    return countedMalloc(size);
+}
+
+void operator delete(void* p) NO_THROW {
+    countedFree(p);
+}
+
+void operator delete[](void* p) NO_THROW {
+    countedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) NO_THROW {
+    countedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) NO_THROW {
+    countedFree(p);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ofMain.h"
+
+// ==================================================================
+// Heap allocation accounting: the global operator new/delete are replaced (AllocationCounter.cpp) to count the
+// allocations made by ONE thread (the main thread, see setCountedThread): each profiler stage records how many
+// allocations it made (ScopedStageTimer), and testApp reports the frame processing of the steady state frames of
+// AR_DEMO and PHASE1 that still make some (profiler overlay, replay report): the goal is none, but the detection of the
+// fork still allocates. The other threads (capture, solver, task pool) are not counted: they don't hold the display.
+// Inside a FrameArenaScope, the allocations of this thread come from the frame arena instead (see FrameArena).
+// Comment out ALLOCATION_ACCOUNTING to remove the replacement operators (the counts are then always 0, and the arena
+// scopes have no effect).
+// Note: malloc calls made directly (OpenCV's fastMalloc, C libraries) are not seen, only operator new.
+// ==================================================================
+
+#define ALLOCATION_ACCOUNTING
+
+class AllocationCounter {
+public:
+    static void setCountedThread(); // the calling thread
+    static bool isCountedThread();
+    // Allocations (and bytes) made by the counted thread since the start of the program:
+    static unsigned long long getCount();
+    static unsigned long long getBytes();
+};
@@ -0,0 +1,408 @@
+#include "BenchmarkSuite.h"
+#include "BoardPrecheck.h"
+#include "ProjectedPatternDetector.h"
+#include "StageProfiler.h"
+#include "CalibrationGraph.h"
+#include "CalibrationSolver.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+const int benchmarkFrames = 60;            // synthetic frames for the detection benchmark
+const int benchmarkBoardCounts[] = {5, 10, 20, 40};
+const int benchmarkStereoBoards = 15;      // boards for the projector/stereo calibration
+const int benchmarkGraphBoards = 20;       // boards for the multi-device calibration graph
+const float maxSlowdown = 1.5;             // (with a baseline) allowed time increase
+const float maxErrorGrowth = 2.0;          // (with a baseline) allowed error increase
+const float maxCameraFocalError = 0.01;    // absolute limits: relative focal length error (camera with 20 boards)...
+const float maxProjectorFocalError = 0.03; // ... of the projector
+const float maxExtrinsicsAngleError = 1.0; // degrees
+
+static double relativeFocalError(const Mat& estimated, const Mat& truth) {
+    Mat e, t;
+    estimated.convertTo(e, CV_64F);
+    truth.convertTo(t, CV_64F);
+    return MAX(fabs(e.at<double>(0, 0)/t.at<double>(0, 0)-1), fabs(e.at<double>(1, 1)/t.at<double>(1, 1)-1));
+}
+
+static double principalPointError(const Mat& estimated, const Mat& truth) {
+    Mat e, t;
+    estimated.convertTo(e, CV_64F);
+    truth.convertTo(t, CV_64F);
+    return sqrt(pow(e.at<double>(0, 2)-t.at<double>(0, 2), 2)+pow(e.at<double>(1, 2)-t.at<double>(1, 2), 2));
+}
+
+BenchmarkSuite::BenchmarkSuite() {
+    passed=true;
+}
+
+void BenchmarkSuite::record(string key, double value) {
+    results.push_back(make_pair(key, value));
+    cout << key << " " << value << endl;
+}
+
+void BenchmarkSuite::check(string key, double value, double limit) {
+    if (value>limit) {
+        cout << "FAILED: " << key << " = " << value << " (limit " << limit << ")" << endl;
+        passed=false;
+    }
+}
+
+void BenchmarkSuite::setupScene() {
+    // Ground truth (similar to the calibration files in data/):
+    SyntheticDevice camera, projector;
+    camera.resolution=cv::Size(640, 480);
+    camera.cameraMatrix=(Mat_<double>(3, 3) << 780, 0, 330, 0, 775, 245, 0, 0, 1);
+    camera.distCoeffs=(Mat_<double>(5, 1) << -0.1, 0.12, 0, 0, 0);
+    projector.resolution=cv::Size(800, 600);
+    projector.cameraMatrix=(Mat_<double>(3, 3) << 1100, 0, 400, 0, 1100, 330, 0, 0, 1);
+    projector.distCoeffs=Mat::zeros(5, 1, CV_64F);
+    Mat rotCamToProj=(Mat_<double>(3, 1) << 0.05, -0.08, 0.01);
+    Mat transCamToProj=(Mat_<double>(3, 1) << -6, -1, 1);
+
+    Calibration camShape, projShape;
+    camShape.loadCalibrationShape("settingsPatternCamera.yml");
+    projShape.loadCalibrationShape("settingsProjectionPatternPixels.yml");
+    projShape.setImagerResolution(projector.resolution);
+    projShape.setCandidateImagePoints(); // (the projected circle grid, in projector pixels)
+    projectorDots=projShape.candidateImagePoints;
+
+    scene.setCamera(camera);
+    scene.setProjector(projector, rotCamToProj, transCamToProj);
+    scene.setBoard(camShape.myPatternShape.getPatternSize(), camShape.myPatternShape.squareSize);
+    scene.setProjectedDots(projectorDots, 6);
+    scene.setImageQuality(0.8, 2.0);
+}
+
+void BenchmarkSuite::benchmarkDetection() {
+    Calibration camera, projector;
+    camera.loadCalibrationShape("settingsPatternCamera.yml");
+    camera.setImagerResolution(scene.getCamera().resolution);
+    projector.loadCalibrationShape("settingsProjectionPatternPixels.yml");
+
+    BoardPrecheck precheck;
+    precheck.setup(camera.myPatternShape.getPatternSize());
+    ProjectedPatternDetector dots;
+    dots.setup(projector);
+
+    LatencyHistogram precheckTime, printedTime, projectedTime;
+    int printedFound=0, projectedFound=0;
+    Mat frame, gray, small;
+    for (int i=0; i<benchmarkFrames; i++) {
+        Mat rotation, translation;
+        if (!scene.randomPose(rotation, translation, true, 60, 90, 30)) continue;
+        scene.render(rotation, translation, frame);
+        cvtColor(frame, gray, CV_RGB2GRAY);
+        pyrDown(gray, small);
+
+        unsigned long long start=ofGetElapsedTimeMicros();
+        precheck.check(small, 2);
+        precheckTime.add(ofGetElapsedTimeMicros()-start);
+
+        start=ofGetElapsedTimeMicros();
+        camera.addImageToProcess(frame);
+        bool printed=camera.generateCandidateImageObjectPoints();
+        printedTime.add(ofGetElapsedTimeMicros()-start);
+
+        start=ofGetElapsedTimeMicros();
+        bool projected=dots.detect(frame, gray);
+        projectedTime.add(ofGetElapsedTimeMicros()-start);
+
+        printedFound+=printed;
+        projectedFound+=projected;
+        if (printed && projected) {
+            cameraImagePoints.push_back(camera.candidateImagePoints);
+            cameraObjectPoints.push_back(camera.candidateObjectPoints);
+            dotImagePoints.push_back(dots.getImagePoints());
+        }
+    }
+    record("detect_precheck_p50_us", precheckTime.getPercentile(0.5));
+    record("detect_printed_p50_us", printedTime.getPercentile(0.5));
+    record("detect_printed_p99_us", printedTime.getPercentile(0.99));
+    record("detect_projected_p50_us", projectedTime.getPercentile(0.5));
+    record("detect_projected_p99_us", projectedTime.getPercentile(0.99));
+    record("detect_printed_rate", (double)printedFound/benchmarkFrames);
+    record("detect_projected_rate", (double)projectedFound/benchmarkFrames);
+    check("detect_printed_miss_error", 1-(double)printedFound/benchmarkFrames, 0.1);
+}
+
+void BenchmarkSuite::benchmarkCameraCalibration() {
+    // More boards than detected ones: the extra boards are the exact corners + noise (detection is not measured here)
+    int maxBoards=benchmarkBoardCounts[sizeof(benchmarkBoardCounts)/sizeof(int)-1];
+    vector<vector<Point2f> > imagePoints=cameraImagePoints;
+    vector<vector<Point3f> > objectPoints=cameraObjectPoints;
+    RNG rng(1);
+    while (imagePoints.size()<maxBoards) {
+        Mat rotation, translation;
+        if (!scene.randomPose(rotation, translation, false, 35, 70, 35)) break;
+        vector<Point2f> corners;
+        scene.getCornerImagePoints(rotation, translation, corners);
+        for (int i=0; i<corners.size(); i++) corners[i]+=Point2f(rng.gaussian(0.1), rng.gaussian(0.1));
+        imagePoints.push_back(corners);
+        objectPoints.push_back(scene.getBoardPoints());
+    }
+
+    for (int c=0; c<sizeof(benchmarkBoardCounts)/sizeof(int); c++) {
+        int boards=MIN(benchmarkBoardCounts[c], (int)imagePoints.size());
+        Calibration calibration;
+        calibration.loadCalibrationShape("settingsPatternCamera.yml");
+        calibration.setImagerResolution(scene.getCamera().resolution);
+        for (int i=0; i<boards; i++) {
+            calibration.imagePoints.push_back(imagePoints[i]);
+            calibration.objectPoints.push_back(objectPoints[i]);
+        }
+        unsigned long long start=ofGetElapsedTimeMicros();
+        calibration.calibrate();
+        double elapsed=ofGetElapsedTimeMicros()-start;
+
+        string prefix="camera_calibrate_"+ofToString(boards)+"_";
+        double focalError=relativeFocalError(calibration.getDistortedIntrinsics().getCameraMatrix(), scene.getCamera().cameraMatrix);
+        record(prefix+"us", elapsed);
+        record(prefix+"focal_error", focalError);
+        record(prefix+"center_error", principalPointError(calibration.getDistortedIntrinsics().getCameraMatrix(), scene.getCamera().cameraMatrix));
+        record(prefix+"reprojection_error", calibration.getReprojectionError());
+        if (boards>=20) check(prefix+"focal_error", focalError, maxCameraFocalError);
+    }
+}
+
+void BenchmarkSuite::benchmarkStereoCalibration() {
+    int boards=MIN(benchmarkStereoBoards, (int)cameraImagePoints.size());
+    record("stereo_boards", boards);
+    if (boards<4) {
+        cout << "FAILED: not enough boards with both patterns for the stereo calibration" << endl;
+        passed=false;
+        return;
+    }
+
+    // Camera (board poses, and intrinsics used for the back-projection of the dots):
+    Calibration camera, projector;
+    camera.loadCalibrationShape("settingsPatternCamera.yml");
+    camera.setImagerResolution(scene.getCamera().resolution);
+    projector.loadCalibrationShape("settingsProjectionPatternPixels.yml");
+    projector.setImagerResolution(scene.getProjector().resolution);
+    for (int i=0; i<boards; i++) {
+        camera.imagePoints.push_back(cameraImagePoints[i]);
+        camera.objectPoints.push_back(cameraObjectPoints[i]);
+    }
+    camera.calibrate();
+
+    // Projector boards: the dots back-projected on the board plane (as in PHASE2):
+    for (int i=0; i<boards; i++) {
+        vector<Point3f> dotObjectPoints;
+        ProjectedPatternDetector::backProject(dotImagePoints[i], camera.getDistortedIntrinsics().getCameraMatrix(), camera.getDistCoeffs(),
+                                              camera.boardRotations[i], camera.boardTranslations[i], dotObjectPoints);
+        projector.imagePoints.push_back(projectorDots);
+        projector.objectPoints.push_back(dotObjectPoints);
+    }
+    unsigned long long start=ofGetElapsedTimeMicros();
+    projector.calibrate();
+    record("projector_calibrate_us", ofGetElapsedTimeMicros()-start);
+    double focalError=relativeFocalError(projector.getDistortedIntrinsics().getCameraMatrix(), scene.getProjector().cameraMatrix);
+    record("projector_focal_error", focalError);
+    record("projector_center_error", principalPointError(projector.getDistortedIntrinsics().getCameraMatrix(), scene.getProjector().cameraMatrix));
+    record("projector_reprojection_error", projector.getReprojectionError());
+    check("projector_focal_error", focalError, maxProjectorFocalError);
+
+    Mat rotation, translation, trueRotation, trueTranslation;
+    start=ofGetElapsedTimeMicros();
+    projector.stereoCalibrationCameraProjector(camera, rotation, translation);
+    record("stereo_calibration_us", ofGetElapsedTimeMicros()-start);
+
+    // Angle of the rotation between estimated and true extrinsics, and translation difference:
+    scene.getExtrinsics(trueRotation, trueTranslation);
+    Mat R, trueR, difference;
+    Rodrigues(rotation, R);
+    Rodrigues(trueRotation, trueR);
+    R.convertTo(R, CV_64F);
+    Rodrigues(Mat(R*trueR.t()), difference);
+    double angleError=norm(difference)*180/CV_PI;
+    Mat t;
+    translation.reshape(1, 3).convertTo(t, CV_64F);
+    record("extrinsics_angle_error", angleError);
+    record("extrinsics_translation_error", norm(t-trueTranslation));
+    check("extrinsics_angle_error", angleError, maxExtrinsicsAngleError);
+}
+
+void BenchmarkSuite::benchmarkCalibrationGraph() {
+    // Devices: world -> device poses (device 0, the reference camera, defines the world frame), around the camera of the
+    // scene, all looking at the boards:
+    struct GraphDevice {
+        const char* name;
+        bool projector;
+        double r[3], t[3];
+    };
+    const GraphDevice devices[] = {
+        {"camera0", false, {0, 0, 0}, {0, 0, 0}},
+        {"camera1", false, {0.02, 0.15, -0.01}, {-15, 1, 2}},
+        {"projector0", true, {0.05, -0.08, 0.01}, {-6, -1, 1}},
+        {"projector1", true, {-0.04, 0.1, 0.02}, {8, -2, 0}},
+        {"projector2", true, {0.1, 0.02, -0.03}, {-3, 6, 1}},
+        {"projector3", true, {-0.06, -0.12, 0}, {12, 3, -2}}
+    };
+    const int numDevices=sizeof(devices)/sizeof(GraphDevice);
+
+    CalibrationGraph graph;
+    for (int d=0; d<numDevices; d++) {
+        const SyntheticDevice& intrinsics=devices[d].projector ? scene.getProjector() : scene.getCamera();
+        graph.addDevice(devices[d].name, intrinsics.cameraMatrix, intrinsics.distCoeffs);
+    }
+
+    // Observations: every device that sees the whole board (exact projection + noise):
+    RNG rng(2);
+    int observations=0;
+    vector<Point2f> imagePoints;
+    for (int b=0; b<benchmarkGraphBoards; b++) {
+        Mat boardRotation, boardTranslation;
+        if (!scene.randomPose(boardRotation, boardTranslation, false, 60, 90, 30)) break;
+        int board=graph.addBoard();
+        for (int d=0; d<numDevices; d++) {
+            const SyntheticDevice& intrinsics=devices[d].projector ? scene.getProjector() : scene.getCamera();
+            Mat rotation, translation;
+            composeRT(boardRotation, boardTranslation, Mat(3, 1, CV_64F, (void*)devices[d].r), Mat(3, 1, CV_64F, (void*)devices[d].t), rotation, translation);
+            projectPoints(Mat(scene.getBoardPoints()), rotation, translation, intrinsics.cameraMatrix, intrinsics.distCoeffs, imagePoints);
+            bool visible=true;
+            for (int i=0; i<imagePoints.size() && visible; i++) {
+                visible=imagePoints[i].inside(cv::Rect(0, 0, intrinsics.resolution.width, intrinsics.resolution.height));
+                imagePoints[i]+=Point2f(rng.gaussian(0.1), rng.gaussian(0.1));
+            }
+            if (!visible) continue;
+            graph.addObservation(d, board, imagePoints, scene.getBoardPoints());
+            observations++;
+        }
+    }
+    record("graph_devices", numDevices);
+    record("graph_observations", observations);
+
+    unsigned long long start=ofGetElapsedTimeMicros();
+    bool solved=graph.solve();
+    record("graph_solve_us", ofGetElapsedTimeMicros()-start);
+    if (!solved) {
+        cout << "FAILED: calibration graph not solved" << endl;
+        passed=false;
+        return;
+    }
+    record("graph_reprojection_error", graph.getReprojectionError());
+
+    // Worst extrinsics error (reference camera -> each device) against the ground truth:
+    double maxAngleError=0, maxTranslationError=0;
+    for (int d=1; d<numDevices; d++) {
+        Mat rotation, translation, R, trueR, difference;
+        graph.getExtrinsics(0, d, rotation, translation);
+        Rodrigues(rotation, R);
+        Rodrigues(Mat(3, 1, CV_64F, (void*)devices[d].r), trueR);
+        Rodrigues(Mat(R*trueR.t()), difference);
+        maxAngleError=MAX(maxAngleError, norm(difference)*180/CV_PI);
+        maxTranslationError=MAX(maxTranslationError, norm(translation-Mat(3, 1, CV_64F, (void*)devices[d].t)));
+    }
+    record("graph_extrinsics_angle_error", maxAngleError);
+    record("graph_extrinsics_translation_error", maxTranslationError);
+    check("graph_extrinsics_angle_error", maxAngleError, maxExtrinsicsAngleError);
+}
+
+void BenchmarkSuite::benchmarkStaleSolverResult() {
+    const int newBoards=2;
+    int boards=MIN(benchmarkStereoBoards, (int)cameraImagePoints.size());
+    if (boards<4+newBoards) return; // (already reported by the stereo benchmark)
+
+    EditableCalibration camera, projector;
+    camera.loadCalibrationShape("settingsPatternCamera.yml");
+    camera.setImagerResolution(scene.getCamera().resolution);
+    projector.loadCalibrationShape("settingsProjectionPatternPixels.yml");
+    projector.setImagerResolution(scene.getProjector().resolution);
+    for (int i=0; i<boards-newBoards; i++) {
+        camera.imagePoints.push_back(cameraImagePoints[i]);
+        camera.objectPoints.push_back(cameraObjectPoints[i]);
+    }
+    camera.calibrate();
+    for (int i=0; i<boards-newBoards; i++) {
+        vector<Point3f> dotObjectPoints;
+        ProjectedPatternDetector::backProject(dotImagePoints[i], camera.getDistortedIntrinsics().getCameraMatrix(), camera.getDistCoeffs(),
+                                              camera.boardRotations[i], camera.boardTranslations[i], dotObjectPoints);
+        projector.imagePoints.push_back(projectorDots);
+        projector.objectPoints.push_back(dotObjectPoints);
+    }
+    projector.calibrate();
+    Mat rotCamToProj, transCamToProj;
+    projector.stereoCalibrationCameraProjector(camera, rotCamToProj, transCamToProj);
+
+    // First snapshot, solved (full refinement, no cleaning), then the solver is stopped so that the second snapshot stays
+    // pending: the first result is then stale when it is fetched.
+    CalibrationSolver solver;
+    solver.setIncremental(1, 2.0, 0);
+    solver.setup(boards+1, 1.0);
+    solver.submit(camera, projector, rotCamToProj, transCamToProj);
+    float start=ofGetElapsedTimef();
+    do ofSleepMillis(10); while (solver.isSolving() && ofGetElapsedTimef()-start<30);
+    solver.stop();
+
+    // Boards added meanwhile, as in PHASE2 (camera pose computed on the frame thread):
+    for (int i=boards-newBoards; i<boards; i++) {
+        camera.candidateImagePoints=cameraImagePoints[i];
+        camera.candidateObjectPoints=cameraObjectPoints[i];
+        camera.computeCandidateBoardPose();
+        camera.addCandidateImagePoints();
+        camera.addCandidateObjectPoints();
+        camera.addCandidateBoardPose();
+        projector.candidateImagePoints=projectorDots;
+        ProjectedPatternDetector::backProject(dotImagePoints[i], camera.getDistortedIntrinsics().getCameraMatrix(), camera.getDistCoeffs(),
+                                              camera.candidateBoardRotation, camera.candidateBoardTranslation, projector.candidateObjectPoints);
+        projector.addCandidateImagePoints();
+        projector.addCandidateObjectPoints();
+    }
+    vector<Mat> addedRotations(camera.boardRotations.end()-newBoards, camera.boardRotations.end());
+    solver.submit(camera, projector, rotCamToProj, transCamToProj);
+
+    // Number of misplaced boards or poses after the stale fetch (must be 0):
+    int mismatches=0;
+    if (!solver.fetch(camera, projector, rotCamToProj, transCamToProj) || solver.getStaleResults()!=1) mismatches++;
+    if (camera.size()!=boards || projector.size()!=boards || camera.boardRotations.size()!=camera.size()) mismatches++;
+    for (int i=0; i<newBoards && !mismatches; i++) {
+        int board=boards-newBoards+i;
+        if (camera.imagePoints[board]!=cameraImagePoints[board] || norm(camera.boardRotations[board], addedRotations[i], NORM_INF)>0) mismatches++;
+    }
+    record("solver_stale_mismatch_error", mismatches);
+    check("solver_stale_mismatch_error", mismatches, 0);
+}
+
+bool BenchmarkSuite::checkResults(string baselineFile) {
+    if (baselineFile=="") return passed;
+    ifstream baseline(ofToDataPath(baselineFile).c_str());
+    if (!baseline.is_open()) {
+        cout << "Baseline " << baselineFile << " not found (no regression check)" << endl;
+        return passed;
+    }
+    map<string, double> reference;
+    string key;
+    double value;
+    while (baseline >> key >> value) reference[key]=value;
+
+    for (int i=0; i<results.size(); i++) {
+        const string& name=results[i].first;
+        if (reference.find(name)==reference.end()) continue;
+        double before=reference[name];
+        if (name.size()>3 && name.substr(name.size()-3)=="_us") {
+            check(name+" (vs baseline)", results[i].second, before*maxSlowdown+100); // (+100 us: timer noise on tiny stages)
+        } else if (name.size()>6 && name.substr(name.size()-6)=="_error") {
+            check(name+" (vs baseline)", results[i].second, MAX(before*maxErrorGrowth, 1e-4));
+        }
+    }
+    return passed;
+}
+
+bool BenchmarkSuite::run(string outputFile, string baselineFile) {
+    passed=true;
+    results.clear();
+
+    setupScene();
+    benchmarkDetection();
+    benchmarkCameraCalibration();
+    benchmarkStereoCalibration();
+    benchmarkCalibrationGraph();
+    benchmarkStaleSolverResult();
+    bool ok=checkResults(baselineFile);
+
+    ofstream output(ofToDataPath(outputFile).c_str());
+    for (int i=0; i<results.size(); i++) output << results[i].first << " " << results[i].second << endl;
+    cout << (ok ? "Benchmark passed" : "Benchmark FAILED") << " (results in " << outputFile << ")" << endl;
+    return ok;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "SyntheticScene.h"
+
+// ==================================================================
+// Headless accuracy-vs-time benchmark on synthetic frames (see SyntheticScene), for the build servers:
+//   cameraProjectorCalib --benchmark [--output benchmark.txt] [--baseline benchmarkBaseline.txt]
+// (1) detection: time of the fast board test, of the printed pattern detection and of the projected pattern
+//     detection, and detection rate,
+// (2) camera calibrate() time and recovered intrinsics error (against the ground truth) versus the number of boards,
+// (3) projector calibration + stereo calibration (projector intrinsics and extrinsics errors),
+// (4) calibration graph with more than two devices (2 cameras, 4 projectors, exact observations + noise): solve time
+//     and extrinsics errors,
+// (5) background solver: a result fetched while a newer snapshot is pending (stale) must keep the boards added since,
+//     with camera pose i still the pose of camera board i.
+// The results are written as "key value" lines. Keys ending in _us are times (microseconds), keys ending in _error are
+// errors: with a baseline file (a previous output), the run FAILS if a time is more than maxSlowdown times the baseline
+// or an error more than maxErrorGrowth times the baseline; it also fails if an error exceeds an absolute limit.
+// ==================================================================
+
+class BenchmarkSuite {
+public:
+    BenchmarkSuite();
+
+    // Returns false if a check failed (regression):
+    bool run(string outputFile, string baselineFile = "");
+
+protected:
+    void setupScene();
+    void benchmarkDetection();
+    void benchmarkCameraCalibration();
+    void benchmarkStereoCalibration();
+    void benchmarkCalibrationGraph();
+    void benchmarkStaleSolverResult();
+    bool checkResults(string baselineFile);
+
+    void record(string key, double value);
+    void check(string key, double value, double limit);
+
+    SyntheticScene scene;
+    vector<cv::Point2f> projectorDots;
+
+    // Detected boards (one per synthetic frame where both patterns were found):
+    vector<vector<cv::Point2f> > cameraImagePoints, dotImagePoints;
+    vector<vector<cv::Point3f> > cameraObjectPoints;
+
+    vector<pair<string, double> > results;
+    bool passed;
+};
@@ -0,0 +1,136 @@
+#include "BoardCleaner.h"
+#include "IncrementalCalibration.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+// Per board reprojection error (one board per index):
+class BoardErrorTask : public ParallelTask {
+public:
+    BoardErrorTask(Calibration& calibration, vector<float>& errors) : calibration(calibration), errors(errors) {
+        cameraMatrix=calibration.getDistortedIntrinsics().getCameraMatrix();
+        distCoeffs=calibration.getDistCoeffs();
+    }
+    void run(int begin, int end) {
+        vector<Point2f> projected;
+        for (int i=begin; i<end; i++) {
+            const vector<Point3f>& objectPoints=calibration.objectPoints[i];
+            const vector<Point2f>& imagePoints=calibration.imagePoints[i];
+            projectPoints(Mat(objectPoints), calibration.boardRotations[i], calibration.boardTranslations[i], cameraMatrix, distCoeffs, projected);
+            double squaredError=0;
+            for (int k=0; k<projected.size(); k++) {
+                Point2f d=projected[k]-imagePoints[k];
+                squaredError+=d.dot(d);
+            }
+            errors[i]=projected.empty() ? 0 : sqrt(squaredError/projected.size());
+        }
+    }
+    Calibration& calibration;
+    vector<float>& errors;
+    Mat cameraMatrix, distCoeffs;
+};
+
+// Total error of the calibration without one of the candidate boards (one candidate per index):
+class LeaveOneOutTask : public ParallelTask {
+public:
+    LeaveOneOutTask(Calibration& calibration, const vector<int>& candidates, vector<double>& errors)
+    : calibration(calibration), candidates(candidates), errors(errors) {
+        cameraMatrix=calibration.getDistortedIntrinsics().getCameraMatrix();
+        distCoeffs=calibration.getDistCoeffs();
+        imageSize=calibration.getDistortedIntrinsics().getImageSize();
+    }
+    void run(int begin, int end) {
+        for (int c=begin; c<end; c++) {
+            vector<vector<Point3f> > objectPoints;
+            vector<vector<Point2f> > imagePoints;
+            for (int i=0; i<calibration.size(); i++) {
+                if (i==candidates[c]) continue;
+                objectPoints.push_back(calibration.objectPoints[i]);
+                imagePoints.push_back(calibration.imagePoints[i]);
+            }
+            // Warm start from the current intrinsics (we only need to RANK the candidates):
+            Mat K=cameraMatrix.clone(), D=distCoeffs.clone();
+            vector<Mat> rvecs, tvecs;
+            errors[c]=calibrateCamera(objectPoints, imagePoints, imageSize, K, D, rvecs, tvecs, IncrementalCalibration::warmStartFlags);
+        }
+    }
+    Calibration& calibration;
+    const vector<int>& candidates;
+    vector<double>& errors;
+    Mat cameraMatrix, distCoeffs;
+    cv::Size imageSize;
+};
+
+void BoardCleaner::boardErrors(Calibration& calibration, vector<float>& errors) {
+    errors.assign(calibration.size(), 0);
+    // The board poses must be up to date (i.e. right after calibrate()):
+    if (calibration.boardRotations.size()!=calibration.size()) return;
+    BoardErrorTask task(calibration, errors);
+    TaskPool::shared().parallelFor(task, calibration.size());
+}
+
+int BoardCleaner::worstBoardLeaveOneOut(Calibration& calibration, const vector<int>& candidates) {
+    vector<double> errors(candidates.size(), 0);
+    LeaveOneOutTask task(calibration, candidates, errors);
+    TaskPool::shared().parallelFor(task, candidates.size());
+    int best=0;
+    for (int c=1; c<candidates.size(); c++) if (errors[c]<errors[best]) best=c;
+    return candidates[best];
+}
+
+void BoardCleaner::removeBoard(Calibration& calibration, int board) {
+    if (board<calibration.imagePoints.size()) calibration.imagePoints.erase(calibration.imagePoints.begin()+board);
+    if (board<calibration.objectPoints.size()) calibration.objectPoints.erase(calibration.objectPoints.begin()+board);
+    if (board<calibration.boardRotations.size()) calibration.boardRotations.erase(calibration.boardRotations.begin()+board);
+    if (board<calibration.boardTranslations.size()) calibration.boardTranslations.erase(calibration.boardTranslations.begin()+board);
+}
+
+int BoardCleaner::cleanBoards(EditableCalibration& calibration, Calibration* camera, float maxError, CleaningMode mode) {
+    int initialSize=calibration.size();
+
+    if (mode==CLEAN_SERIAL) {
+        if (camera) calibration.simultaneousClean(*camera, maxError);
+        else calibration.clean(maxError);
+        return initialSize-calibration.size();
+    }
+
+    vector<float> errors;
+    int removed=0;
+    while (calibration.size()>1) {
+        boardErrors(calibration, errors);
+        vector<int> outliers;
+        int bestBoard=0;
+        for (int i=0; i<errors.size(); i++) {
+            if (errors[i]>maxError) outliers.push_back(i);
+            if (errors[i]<errors[bestBoard]) bestBoard=i;
+        }
+        if (outliers.empty()) break;
+
+        if (mode==CLEAN_BATCH) {
+            // Everything above the threshold in one round (but never ALL the boards), from the end to keep the indices valid:
+            for (int k=outliers.size()-1; k>=0; k--) {
+                if (outliers[k]==bestBoard) continue;
+                removeBoard(calibration, outliers[k]);
+                if (camera) removeBoard(*camera, outliers[k]);
+                removed++;
+            }
+            IncrementalCalibration::refine(calibration);
+            break;
+        } else {
+            int board=worstBoardLeaveOneOut(calibration, outliers);
+            removeBoard(calibration, board);
+            if (camera) removeBoard(*camera, board);
+            removed++;
+            IncrementalCalibration::refine(calibration);
+        }
+    }
+    return removed;
+}
+
+int BoardCleaner::clean(EditableCalibration& calibration, float maxError, CleaningMode mode) {
+    return cleanBoards(calibration, NULL, maxError, mode);
+}
+
+int BoardCleaner::simultaneousClean(EditableCalibration& projector, Calibration& camera, float maxError, CleaningMode mode) {
+    return cleanBoards(projector, &camera, maxError, mode);
+}
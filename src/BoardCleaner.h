@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+#include "EditableCalibration.h"
+
+// ==================================================================
+// Removal of the boards with large reprojection error, replacing Calibration::clean() and simultaneousClean(), which
+// prune the boards one at a time and re-calibrate serially.
+// - CLEAN_SERIAL: the original methods of the calibration object.
+// - CLEAN_BATCH: the per board errors are computed in parallel, every board above the threshold is removed in ONE round,
+//   and the object is re-calibrated once.
+// - CLEAN_LEAVE_ONE_OUT: for each board above the threshold, the calibration WITHOUT that board is evaluated in parallel
+//   (all cores, warm started from the current intrinsics); the board whose removal gives the lowest total error is
+//   removed, the object is re-calibrated, and we start again until no board is above the threshold.
+// The re-calibrations after a removal are warm started (IncrementalCalibration::refine): the intrinsics barely move.
+// The simultaneous version removes the same boards from the camera list (the camera intrinsics are fixed: only the
+// projector is re-calibrated), exactly as simultaneousClean.
+// ==================================================================
+
+enum CleaningMode {CLEAN_SERIAL, CLEAN_BATCH, CLEAN_LEAVE_ONE_OUT};
+
+class BoardCleaner {
+public:
+    // Returns the number of removed boards.
+    static int clean(EditableCalibration& calibration, float maxError, CleaningMode mode = CLEAN_BATCH);
+    static int simultaneousClean(EditableCalibration& projector, ofxCv::Calibration& camera, float maxError, CleaningMode mode = CLEAN_BATCH);
+
+    // RMS reprojection error of each board, with the current intrinsics and board poses (in parallel):
+    static void boardErrors(ofxCv::Calibration& calibration, vector<float>& errors);
+
+protected:
+    static int cleanBoards(EditableCalibration& calibration, ofxCv::Calibration* camera, float maxError, CleaningMode mode);
+    static int worstBoardLeaveOneOut(ofxCv::Calibration& calibration, const vector<int>& candidates);
+    static void removeBoard(ofxCv::Calibration& calibration, int board);
+};
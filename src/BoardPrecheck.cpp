@@ -0,0 +1,50 @@
+#include "BoardPrecheck.h"
+
+using namespace cv;
+
+BoardPrecheck::BoardPrecheck() {
+    enabled=false;
+    hasRegion=false;
+    rejectedFrames=0;
+}
+
+void BoardPrecheck::setup(cv::Size patternSize) {
+    this->patternSize=patternSize;
+    hasRegion=false;
+    enabled=true;
+}
+
+bool BoardPrecheck::findInRegion(const Mat& gray, cv::Rect region, int scale) {
+    region&=cv::Rect(0, 0, gray.cols, gray.rows);
+    if (region.width<2*patternSize.width || region.height<2*patternSize.height) return false;
+    if (!findChessboardCorners(gray(region), patternSize, corners, CALIB_CB_FAST_CHECK | CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE)) return false;
+    for (int i=0; i<corners.size(); i++) corners[i]=(corners[i]+Point2f(region.x, region.y))*(float)scale;
+    return true;
+}
+
+bool BoardPrecheck::check(const Mat& gray, int scale) {
+    if (!enabled) return true;
+
+    // (1) Around the last known board region (grown by 50% on each side, in downscaled coordinates):
+    if (hasRegion) {
+        cv::Rect region(lastRegion.x/scale, lastRegion.y/scale, lastRegion.width/scale, lastRegion.height/scale);
+        region-=cv::Point(region.width/2, region.height/2);
+        region+=cv::Size(region.width, region.height);
+        if (findInRegion(gray, region, scale)) return true;
+    }
+
+    // (2) Whole (downscaled) frame:
+    if (findInRegion(gray, cv::Rect(0, 0, gray.cols, gray.rows), scale)) return true;
+
+    rejectedFrames++;
+    return false;
+}
+
+void BoardPrecheck::setDetected(const vector<Point2f>& imagePoints) {
+    if (imagePoints.empty()) {
+        hasRegion=false;
+        return;
+    }
+    lastRegion=boundingRect(Mat(imagePoints));
+    hasRegion=true;
+}
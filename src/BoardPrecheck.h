@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Fast "is there a chessboard in this frame?" test, run BEFORE the full resolution detection + sub-pixel refinement of
+// the calibration object (which is very slow when the board is NOT in the image).
+// The test runs findChessboardCorners with CALIB_CB_FAST_CHECK on a downscaled grayscale image (a level of the shared
+// frame pyramid, see FramePreprocessor): first around the last known board region (if any), then on the whole image.
+// Note: a very small board (far from the camera) may be missed at the reduced resolution, so the test is only used where
+// the board is looked for on every frame (AR_DEMO, PHASE1), not in the acquisition states (see testApp::detectPrintedPattern).
+// When the test passes, its corners are kept (getCorners, full resolution coordinates): refined at full resolution
+// (cornerSubPix), they replace the full detection, which would find the same board again from scratch.
+// ==================================================================
+
+class BoardPrecheck {
+public:
+    BoardPrecheck();
+
+    void setup(cv::Size patternSize);
+    void setEnabled(bool enabled) {this->enabled=enabled;}
+
+    // true if it is worth running the full detection on this frame (gray: grayscale frame downscaled by "scale")
+    bool check(const cv::Mat& gray, int scale);
+    // Corners found by the last successful check, in full resolution coordinates (not refined):
+    const vector<cv::Point2f>& getCorners() const {return corners;}
+    // Feedback from the full detector, to look first around the last board region:
+    void setDetected(const vector<cv::Point2f>& imagePoints);
+    void setLost() {hasRegion=false;}
+
+    int getRejectedFrames() const {return rejectedFrames;}
+
+protected:
+    bool findInRegion(const cv::Mat& gray, cv::Rect region, int scale);
+
+    bool enabled;
+    cv::Size patternSize;
+    vector<cv::Point2f> corners;
+
+    cv::Rect lastRegion; // full resolution coordinates
+    bool hasRegion;
+    int rejectedFrames;
+};
@@ -0,0 +1,341 @@
+#include "CalibrationGraph.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+// Residuals (and Jacobians with respect to the 6 device and 6 board parameters) of each observation:
+class GraphLinearizeTask : public ParallelTask {
+public:
+    GraphLinearizeTask(CalibrationGraph& graph, bool withJacobians) : graph(graph), withJacobians(withJacobians) {}
+
+    void run(int begin, int end) {
+        vector<Point2f> projected;
+        Mat rotation, translation, jacobian;
+        Mat dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2;
+        for (int i=begin; i<end; i++) {
+            CalibrationGraph::Observation& o=graph.observations[i];
+            const CalibrationGraph::Pose& device=graph.devices[o.device].pose;
+            const CalibrationGraph::Pose& board=graph.boards[o.board];
+            const CalibrationGraph::Device& d=graph.devices[o.device];
+            // board -> device = (world -> device) * (board -> world), with the derivatives of the composition:
+            composeRT(Mat(board.r), Mat(board.t), Mat(device.r), Mat(device.t), rotation, translation,
+                      dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2);
+            if (withJacobians) projectPoints(Mat(o.objectPoints), rotation, translation, Mat(d.K), Mat(8, 1, CV_64F, (void*)d.distortion), projected, jacobian);
+            else projectPoints(Mat(o.objectPoints), rotation, translation, Mat(d.K), Mat(8, 1, CV_64F, (void*)d.distortion), projected);
+            int n=projected.size();
+            vector<double> residuals(2*n);
+            o.cost=0;
+            for (int k=0; k<n; k++) {
+                residuals[2*k]=projected[k].x-o.imagePoints[k].x;
+                residuals[2*k+1]=projected[k].y-o.imagePoints[k].y;
+                o.cost+=residuals[2*k]*residuals[2*k]+residuals[2*k+1]*residuals[2*k+1];
+            }
+            if (!withJacobians) continue;
+
+            // Chain rule (2n x 12: device rotation and translation, then board rotation and translation). The first 6
+            // columns of the projectPoints Jacobian are the derivatives with respect to its rotation and translation:
+            Mat dpdr=jacobian.colRange(0, 3), dpdt=jacobian.colRange(3, 6);
+            Mat J(2*n, 12, CV_64F);
+            Mat(dpdr*dr3dr2+dpdt*dt3dr2).copyTo(J.colRange(0, 3));
+            Mat(dpdr*dr3dt2+dpdt*dt3dt2).copyTo(J.colRange(3, 6));
+            Mat(dpdr*dr3dr1+dpdt*dt3dr1).copyTo(J.colRange(6, 9));
+            Mat(dpdr*dr3dt1+dpdt*dt3dt1).copyTo(J.colRange(9, 12));
+            Mat r(2*n, 1, CV_64F, &residuals[0]);
+            Mat Jd=J.colRange(0, 6), Jb=J.colRange(6, 12);
+            Mat Udd=Jd.t()*Jd, Wdb=Jd.t()*Jb, Vbb=Jb.t()*Jb, gd=Jd.t()*r, gb=Jb.t()*r;
+            Udd.copyTo(Mat(o.Udd));
+            Wdb.copyTo(Mat(o.Wdb));
+            Vbb.copyTo(Mat(o.Vbb));
+            gd.copyTo(Mat(o.gd));
+            gb.copyTo(Mat(o.gb));
+        }
+    }
+    CalibrationGraph& graph;
+    bool withJacobians;
+};
+
+CalibrationGraph::CalibrationGraph() {
+    reprojectionError=0;
+}
+
+void CalibrationGraph::clear() {
+    devices.clear();
+    boards.clear();
+    observations.clear();
+    reprojectionError=0;
+}
+
+int CalibrationGraph::addDevice(string name, const Mat& cameraMatrix, const Mat& distCoeffs) {
+    Device device;
+    device.name=name;
+    Mat K;
+    cameraMatrix.convertTo(K, CV_64F);
+    device.K=Matx33d((double*)K.data);
+    Mat D;
+    distCoeffs.convertTo(D, CV_64F);
+    D=D.reshape(1, D.total());
+    for (int i=0; i<8; i++) device.distortion[i]=(i<D.total() ? D.at<double>(i) : 0);
+    device.pose.r=device.pose.t=Vec3d(0, 0, 0);
+    device.pose.known=devices.empty(); // (device 0 is the world frame)
+    devices.push_back(device);
+    return devices.size()-1;
+}
+
+int CalibrationGraph::addBoard() {
+    Pose pose;
+    pose.r=pose.t=Vec3d(0, 0, 0);
+    pose.known=false;
+    boards.push_back(pose);
+    return boards.size()-1;
+}
+
+void CalibrationGraph::addObservation(int device, int board, const vector<Point2f>& imagePoints, const vector<Point3f>& objectPoints) {
+    if (device<0 || device>=devices.size() || imagePoints.size()!=objectPoints.size() || imagePoints.size()<4) return;
+    while (board>=boards.size()) addBoard();
+    Observation observation;
+    observation.device=device;
+    observation.board=board;
+    observation.imagePoints=imagePoints;
+    observation.objectPoints=objectPoints;
+    observation.cost=0;
+    observations.push_back(observation);
+}
+
+void CalibrationGraph::addCalibration(int device, Calibration& calibration, int firstBoard) {
+    for (int i=0; i<calibration.size(); i++) addObservation(device, firstBoard+i, calibration.imagePoints[i], calibration.objectPoints[i]);
+}
+
+int CalibrationGraph::getDeviceIndex(string name) const {
+    for (int i=0; i<devices.size(); i++) if (devices[i].name==name) return i;
+    return -1;
+}
+
+// ---- Poses ----
+
+void CalibrationGraph::composePoses(const Pose& inner, const Pose& outer, Pose& result) {
+    Mat r, t;
+    composeRT(Mat(inner.r), Mat(inner.t), Mat(outer.r), Mat(outer.t), r, t);
+    result.r=Vec3d(r.at<double>(0), r.at<double>(1), r.at<double>(2));
+    result.t=Vec3d(t.at<double>(0), t.at<double>(1), t.at<double>(2));
+    result.known=true;
+}
+
+void CalibrationGraph::invertPose(const Pose& pose, Pose& result) {
+    Mat R;
+    Rodrigues(Mat(pose.r), R);
+    Matx33d Rt=Matx33d((double*)R.data).t();
+    result.r=-pose.r; // (rotation of the inverse)
+    result.t=-(Rt*pose.t);
+    result.known=pose.known;
+}
+
+void CalibrationGraph::projectObservation(const Observation& observation, const Pose& device, const Pose& board, vector<Point2f>& projected) const {
+    Pose boardToDevice;
+    composePoses(board, device, boardToDevice);
+    const Device& d=devices[observation.device];
+    projectPoints(Mat(observation.objectPoints), Mat(boardToDevice.r), Mat(boardToDevice.t), Mat(d.K), Mat(8, 1, CV_64F, (void*)d.distortion), projected);
+}
+
+void CalibrationGraph::getDevicePose(int device, Mat& rotation, Mat& translation) const {
+    if (device<0 || device>=devices.size()) return;
+    Mat(devices[device].pose.r).copyTo(rotation);
+    Mat(devices[device].pose.t).copyTo(translation);
+}
+
+void CalibrationGraph::getExtrinsics(int from, int to, Mat& rotation, Mat& translation) const {
+    if (from<0 || from>=devices.size() || to<0 || to>=devices.size()) return;
+    // (from -> world -> to)
+    Pose fromInverse, result;
+    invertPose(devices[from].pose, fromInverse);
+    composePoses(fromInverse, devices[to].pose, result);
+    Mat(result.r).copyTo(rotation);
+    Mat(result.t).copyTo(translation);
+}
+
+float CalibrationGraph::getDeviceReprojectionError(int device) const {
+    double squaredError=0;
+    int points=0;
+    vector<Point2f> projected;
+    for (int i=0; i<observations.size(); i++) {
+        const Observation& o=observations[i];
+        if (o.device!=device) continue;
+        projectObservation(o, devices[o.device].pose, boards[o.board], projected);
+        for (int k=0; k<projected.size(); k++) {
+            Point2f d=projected[k]-o.imagePoints[k];
+            squaredError+=d.dot(d);
+        }
+        points+=projected.size();
+    }
+    return points ? sqrt(squaredError/points) : 0;
+}
+
+// ---- Solver ----
+
+bool CalibrationGraph::initialize(bool fixedDevices) {
+    for (int i=0; i<observations.size(); i++) {
+        Observation& o=observations[i];
+        Mat r, t;
+        solvePnP(Mat(o.objectPoints), Mat(o.imagePoints), Mat(devices[o.device].K), Mat(8, 1, CV_64F, devices[o.device].distortion), r, t);
+        r.convertTo(r, CV_64F);
+        t.convertTo(t, CV_64F);
+        o.initial.r=Vec3d(r.at<double>(0), r.at<double>(1), r.at<double>(2));
+        o.initial.t=Vec3d(t.at<double>(0), t.at<double>(1), t.at<double>(2));
+        o.initial.known=true;
+    }
+    for (int i=1; i<devices.size(); i++) devices[i].pose.known=fixedDevices;
+    for (int i=0; i<boards.size(); i++) boards[i].known=false;
+
+    // Propagation from device 0 (each pass crosses at least one more edge, or nothing changes):
+    bool changed=true;
+    while (changed) {
+        changed=false;
+        for (int i=0; i<observations.size(); i++) {
+            const Observation& o=observations[i];
+            Pose& device=devices[o.device].pose;
+            Pose& board=boards[o.board];
+            if (device.known && !board.known) {
+                // board -> world = (world -> device)^-1 * (board -> device)
+                Pose deviceInverse;
+                invertPose(device, deviceInverse);
+                composePoses(o.initial, deviceInverse, board);
+                changed=true;
+            } else if (board.known && !device.known) {
+                // world -> device = (board -> device) * (board -> world)^-1
+                Pose boardInverse;
+                invertPose(board, boardInverse);
+                composePoses(boardInverse, o.initial, device);
+                changed=true;
+            }
+        }
+    }
+    for (int i=0; i<devices.size(); i++) {
+        if (!devices[i].pose.known) {
+            ofLogError() << "CalibrationGraph: device " << devices[i].name << " is not connected to " << devices[0].name;
+            return false;
+        }
+    }
+    return true;
+}
+
+double CalibrationGraph::linearize(bool withJacobians) {
+    GraphLinearizeTask task(*this, withJacobians);
+    TaskPool::shared().parallelFor(task, observations.size());
+    double cost=0;
+    for (int i=0; i<observations.size(); i++) cost+=observations[i].cost;
+    return cost;
+}
+
+bool CalibrationGraph::solve(int maxIterations) {
+    return optimize(maxIterations, false);
+}
+
+void CalibrationGraph::setDevicePose(int device, const Mat& rotation, const Mat& translation) {
+    if (device<=0 || device>=devices.size()) return;
+    Mat r, t;
+    rotation.convertTo(r, CV_64F);
+    translation.convertTo(t, CV_64F);
+    devices[device].pose.r=Vec3d(r.at<double>(0), r.at<double>(1), r.at<double>(2));
+    devices[device].pose.t=Vec3d(t.at<double>(0), t.at<double>(1), t.at<double>(2));
+}
+
+bool CalibrationGraph::solveBoards(int maxIterations) {
+    return optimize(maxIterations, true);
+}
+
+// fixedDevices: only the board poses are solved (the board blocks are then independent, the reduced system is empty).
+bool CalibrationGraph::optimize(int maxIterations, bool fixedDevices) {
+    if (devices.size()<2 || observations.empty() || !initialize(fixedDevices)) return false;
+
+    // Observations of each board (for the Schur complement):
+    vector<vector<int> > boardObservations(boards.size());
+    for (int i=0; i<observations.size(); i++) boardObservations[observations[i].board].push_back(i);
+
+    int numDevices=fixedDevices ? 0 : devices.size()-1; // (device 0 is fixed)
+    double lambda=1e-3;
+    double cost=linearize(true);
+    for (int iteration=0; iteration<maxIterations; iteration++) {
+        // Reduced system on the devices: S * dDevices = rhs
+        Mat S=Mat::zeros(6*numDevices, 6*numDevices, CV_64F), rhs=Mat::zeros(6*numDevices, 1, CV_64F);
+        for (int i=0; i<observations.size(); i++) {
+            const Observation& o=observations[i];
+            if (o.device==0 || fixedDevices) continue;
+            int d=o.device-1;
+            S(Rect(6*d, 6*d, 6, 6))+=Mat(o.Udd);
+            rhs.rowRange(6*d, 6*d+6)-=Mat(o.gd);
+        }
+        for (int d=0; d<6*numDevices; d++) S.at<double>(d, d)*=(1+lambda);
+
+        vector<Mat> boardInverse(boards.size()), boardGradient(boards.size());
+        for (int b=0; b<boards.size(); b++) {
+            const vector<int>& seen=boardObservations[b];
+            if (seen.empty()) continue;
+            Mat V=Mat::zeros(6, 6, CV_64F), g=Mat::zeros(6, 1, CV_64F);
+            for (int k=0; k<seen.size(); k++) {
+                V+=Mat(observations[seen[k]].Vbb);
+                g+=Mat(observations[seen[k]].gb);
+            }
+            for (int j=0; j<6; j++) V.at<double>(j, j)*=(1+lambda);
+            boardInverse[b]=V.inv(DECOMP_CHOLESKY);
+            boardGradient[b]=g;
+            // S -= W V^-1 W^T, rhs += W V^-1 g (only the devices that saw this board):
+            for (int k=0; k<seen.size(); k++) {
+                const Observation& oi=observations[seen[k]];
+                if (oi.device==0 || fixedDevices) continue;
+                Mat WiV=Mat(oi.Wdb)*boardInverse[b];
+                rhs.rowRange(6*(oi.device-1), 6*oi.device)+=WiV*g;
+                for (int l=0; l<seen.size(); l++) {
+                    const Observation& oj=observations[seen[l]];
+                    if (oj.device==0) continue;
+                    S(Rect(6*(oj.device-1), 6*(oi.device-1), 6, 6))-=WiV*Mat(oj.Wdb).t();
+                }
+            }
+        }
+
+        Mat deviceStep=Mat::zeros(6*numDevices, 1, CV_64F);
+        if (numDevices>0 && !cv::solve(S, rhs, deviceStep, DECOMP_CHOLESKY)) cv::solve(S, rhs, deviceStep, DECOMP_SVD);
+
+        // Back substitution of the boards, and trial step:
+        vector<Device> previousDevices=devices;
+        vector<Pose> previousBoards=boards;
+        for (int d=1; d<=numDevices; d++) {
+            for (int j=0; j<3; j++) {
+                devices[d].pose.r[j]+=deviceStep.at<double>(6*(d-1)+j);
+                devices[d].pose.t[j]+=deviceStep.at<double>(6*(d-1)+3+j);
+            }
+        }
+        for (int b=0; b<boards.size(); b++) {
+            const vector<int>& seen=boardObservations[b];
+            if (seen.empty()) continue;
+            Mat rhsBoard=-boardGradient[b];
+            for (int k=0; k<seen.size(); k++) {
+                const Observation& o=observations[seen[k]];
+                if (o.device==0 || fixedDevices) continue;
+                rhsBoard-=Mat(o.Wdb).t()*deviceStep.rowRange(6*(o.device-1), 6*o.device);
+            }
+            Mat boardStep=boardInverse[b]*rhsBoard;
+            for (int j=0; j<3; j++) {
+                boards[b].r[j]+=boardStep.at<double>(j);
+                boards[b].t[j]+=boardStep.at<double>(3+j);
+            }
+        }
+
+        double newCost=linearize(false);
+        if (newCost<cost) {
+            bool converged=(cost-newCost)<1e-10*cost;
+            cost=linearize(true);
+            lambda=MAX(lambda/10, 1e-9);
+            if (converged) break;
+        } else {
+            devices=previousDevices;
+            boards=previousBoards;
+            lambda*=10;
+            if (lambda>1e8) break;
+        }
+    }
+    linearize(false);
+
+    int points=0;
+    for (int i=0; i<observations.size(); i++) points+=observations[i].imagePoints.size();
+    reprojectionError=points ? sqrt(cost/points) : 0;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+
+// ==================================================================
+// Extrinsics of ANY number of cameras and projectors, solved jointly (instead of one rotCamToProj/transCamToProj pair
+// per couple of devices):
+// - nodes: devices (fixed intrinsics: calibrate each one first) and board poses; device 0 defines the world frame,
+// - edges: observations (a device saw a board: image points <-> board points). A projector "sees" the board through
+//   the back-projected pattern, exactly as in the stereo calibration.
+// The poses are initialized by solvePnP on each observation, propagated through the graph (breadth first from device
+// 0), then refined together by Levenberg-Marquardt on the total reprojection error. The normal equations are sparse:
+// each observation only touches one device and one board, so the board blocks are eliminated (Schur complement) and
+// only a (6 x devices)^2 system is solved. The per observation Jacobians are analytic (the derivatives of projectPoints,
+// chained through the ones of composeRT) and computed in parallel (TaskPool): the cost
+// grows with the number of observations, not with the number of device pairs.
+// ==================================================================
+
+class CalibrationGraph {
+public:
+    CalibrationGraph();
+
+    void clear();
+    int addDevice(string name, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+    int addBoard();
+    void addObservation(int device, int board, const vector<cv::Point2f>& imagePoints, const vector<cv::Point3f>& objectPoints);
+    // All the boards of a calibration object; board i of the calibration is board firstBoard+i of the graph (boards
+    // added during the same acquisition, e.g. camera and projector in PHASE2, are the same physical boards):
+    void addCalibration(int device, ofxCv::Calibration& calibration, int firstBoard = 0);
+
+    bool solve(int maxIterations = 30);
+    // Board poses only, with the device poses given (e.g. extrinsics from the stereo calibration): the reprojection error
+    // is then comparable with the one of solve() (same model, same observations).
+    void setDevicePose(int device, const cv::Mat& rotation, const cv::Mat& translation); // world -> device (device > 0)
+    bool solveBoards(int maxIterations = 30);
+
+    int getNumDevices() const {return devices.size();}
+    int getNumBoards() const {return boards.size();}
+    int getDeviceIndex(string name) const;
+    // Pose of the device (world -> device), and extrinsics between two devices (from -> to):
+    void getDevicePose(int device, cv::Mat& rotation, cv::Mat& translation) const;
+    void getExtrinsics(int from, int to, cv::Mat& rotation, cv::Mat& translation) const;
+    float getReprojectionError() const {return reprojectionError;} // RMS (pixels) over all the observations
+    float getDeviceReprojectionError(int device) const;
+
+protected:
+    struct Pose {
+        cv::Vec3d r, t; // rotation vector, translation
+        bool known;
+    };
+    struct Device {
+        string name;
+        cv::Matx33d K;
+        double distortion[8];
+        Pose pose; // world -> device
+    };
+    struct Observation {
+        int device, board;
+        vector<cv::Point2f> imagePoints;
+        vector<cv::Point3f> objectPoints;
+        Pose initial; // board -> device (solvePnP)
+        // Linearization (filled in parallel):
+        cv::Matx<double, 6, 6> Udd, Wdb, Vbb;
+        cv::Vec<double, 6> gd, gb;
+        double cost;
+    };
+
+    bool initialize(bool fixedDevices);
+    bool optimize(int maxIterations, bool fixedDevices);
+    double linearize(bool withJacobians);
+    static void composePoses(const Pose& inner, const Pose& outer, Pose& result); // outer * inner
+    static void invertPose(const Pose& pose, Pose& result);
+    void projectObservation(const Observation& observation, const Pose& device, const Pose& board, vector<cv::Point2f>& projected) const;
+
+    vector<Device> devices;
+    vector<Pose> boards; // board -> world
+    vector<Observation> observations;
+    float reprojectionError;
+
+    friend class GraphLinearizeTask;
+};
@@ -0,0 +1,223 @@
+#include "CalibrationSolver.h"
+#include <cassert>
+
+using namespace ofxCv;
+using namespace cv;
+
+// Boards added to a calibration object after a snapshot (points, and poses when the frame thread added them):
+struct NewBoards {
+    vector<vector<Point2f> > imagePoints;
+    vector<vector<Point3f> > objectPoints;
+    vector<Mat> rotations, translations;
+};
+
+static void takeNewBoards(const Calibration& calibration, int first, NewBoards& boards) {
+    first=MIN(first, (int)calibration.imagePoints.size());
+    boards.imagePoints.assign(calibration.imagePoints.begin()+first, calibration.imagePoints.end());
+    boards.objectPoints.assign(calibration.objectPoints.begin()+first, calibration.objectPoints.end());
+    if (calibration.boardRotations.size()==calibration.imagePoints.size()) {
+        boards.rotations.assign(calibration.boardRotations.begin()+first, calibration.boardRotations.end());
+        boards.translations.assign(calibration.boardTranslations.begin()+first, calibration.boardTranslations.end());
+    }
+}
+
+// Appends them to the solved lists, keeping pose i with board i (the poses are appended only if both lists are aligned):
+static void appendNewBoards(const NewBoards& boards, Calibration& calibration) {
+    if (calibration.boardRotations.size()==calibration.imagePoints.size() && boards.rotations.size()==boards.imagePoints.size()) {
+        calibration.boardRotations.insert(calibration.boardRotations.end(), boards.rotations.begin(), boards.rotations.end());
+        calibration.boardTranslations.insert(calibration.boardTranslations.end(), boards.translations.begin(), boards.translations.end());
+    }
+    calibration.imagePoints.insert(calibration.imagePoints.end(), boards.imagePoints.begin(), boards.imagePoints.end());
+    calibration.objectPoints.insert(calibration.objectPoints.end(), boards.objectPoints.begin(), boards.objectPoints.end());
+}
+
+CalibrationSolver::CalibrationSolver() {
+    snapshotSlot=0; backSlot=1; frontSlot=2;
+    hasSnapshot=false; solving=false; hasResult=false;
+    submittedGeneration=0; publishedGeneration=0; currentEpoch=0;
+    startCleaning=0; maxError=0;
+    cleaningMode=CLEAN_BATCH;
+    jointExtrinsics=false;
+    alwaysRefineAbove=0;
+    resetIncremental=false;
+    profiler=NULL; profilerState=0;
+    lastSolveTime=0;
+    droppedResults=0;
+    staleResults=0;
+}
+
+CalibrationSolver::~CalibrationSolver() {
+    stop();
+}
+
+void CalibrationSolver::setup(int startCleaningProjector, float maxErrorProjector, StageProfiler* profiler, int profilerState) {
+    startCleaning=startCleaningProjector;
+    maxError=maxErrorProjector;
+    this->profiler=profiler;
+    this->profilerState=profilerState;
+    startThread(true, false);
+}
+
+void CalibrationSolver::setIncremental(int refineEvery, float errorJump, int alwaysRefineAbove) {
+    incrementalProjector.setup(refineEvery, errorJump);
+    this->alwaysRefineAbove=alwaysRefineAbove;
+}
+
+void CalibrationSolver::stop() {
+    if (isThreadRunning()) {
+        stopThread();
+        wakeUp.set();
+        waitForThread(false);
+    }
+}
+
+void CalibrationSolver::submit(const EditableCalibration& camera, const EditableCalibration& projector, const Mat& rotCamToProj, const Mat& transCamToProj) {
+    // Camera pose i is the pose of camera board i (the cleaning and the stereo calibration pair them by index):
+    assert(camera.boardRotations.size()==camera.size());
+    lock();
+    if (hasSnapshot) droppedResults++; // the previous snapshot was never picked: it is replaced by this (larger) one
+    StereoSolution& snapshot=slots[snapshotSlot];
+    snapshot.camera.deepCopy(camera);
+    snapshot.projector.deepCopy(projector);
+    snapshot.cameraBoards=camera.size();
+    snapshot.projectorBoards=projector.size();
+    rotCamToProj.copyTo(snapshot.rotCamToProj);
+    transCamToProj.copyTo(snapshot.transCamToProj);
+    snapshot.generation=++submittedGeneration;
+    snapshot.epoch=currentEpoch;
+    hasSnapshot=true;
+    unlock();
+    wakeUp.set();
+}
+
+bool CalibrationSolver::fetch(EditableCalibration& camera, EditableCalibration& projector, Mat& rotCamToProj, Mat& transCamToProj) {
+    bool published=false;
+    lock();
+    if (hasResult) {
+        hasResult=false;
+        StereoSolution& result=slots[frontSlot];
+        // The session was reset since this snapshot:
+        if (result.epoch!=currentEpoch) {
+            droppedResults++;
+        } else {
+            // Stale: more boards were added after this snapshot (a newer solve is pending). They are kept (appended
+            // to the solved lists with their camera poses, the frame thread only adds boards) until the next result
+            // solves them:
+            NewBoards newCameraBoards, newProjectorBoards;
+            if (result.generation!=submittedGeneration) {
+                staleResults++;
+                takeNewBoards(camera, result.cameraBoards, newCameraBoards);
+                takeNewBoards(projector, result.projectorBoards, newProjectorBoards);
+            }
+            camera.deepCopy(result.camera);
+            projector.deepCopy(result.projector);
+            appendNewBoards(newCameraBoards, camera);
+            appendNewBoards(newProjectorBoards, projector);
+            result.rotCamToProj.copyTo(rotCamToProj);
+            result.transCamToProj.copyTo(transCamToProj);
+            publishedGeneration=result.generation;
+            lastSolveTime=result.solveTime;
+            published=true;
+        }
+    }
+    unlock();
+    return published;
+}
+
+void CalibrationSolver::reset() {
+    lock();
+    currentEpoch++;
+    hasSnapshot=false;
+    resetIncremental=true;
+    hasResult=false;
+    unlock();
+}
+
+bool CalibrationSolver::isSolving() {
+    lock();
+    bool busy=hasSnapshot||solving;
+    unlock();
+    return busy;
+}
+
+void CalibrationSolver::threadedFunction() {
+    while (isThreadRunning()) {
+        wakeUp.tryWait(100);
+
+        lock();
+        if (!hasSnapshot) {
+            unlock();
+            continue;
+        }
+        swap(snapshotSlot, backSlot);
+        hasSnapshot=false;
+        solving=true;
+        if (resetIncremental) {
+            incrementalProjector.reset();
+            resetIncremental=false;
+        }
+        unlock();
+
+        // Same sequence that used to run on the frame thread (see testApp::update(), PHASE2):
+        StereoSolution& work=slots[backSlot];
+        float startTime=ofGetElapsedTimef();
+
+        unsigned long long stageStart=ofGetElapsedTimeMicros();
+        work.refined=incrementalProjector.addBoard(work.projector) || (work.projector.size()>alwaysRefineAbove);
+        if (work.refined) {
+            IncrementalCalibration::refine(work.projector); // recompute the projector instrinsics (warm start), as well as the board translation and rotation for all the boards
+            incrementalProjector.fullRefinementDone();
+        }
+        recordStage(STAGE_CALIBRATE_PROJECTOR, stageStart);
+
+        if (work.refined) {
+            // Cleaning: this needs to be done SIMULTANEOUSLY for projector and camera.
+            if (work.projector.size() > startCleaning) {
+                stageStart=ofGetElapsedTimeMicros();
+                BoardCleaner::simultaneousClean(work.projector, work.camera, maxError, cleaningMode);
+                recordStage(STAGE_CLEAN_PROJECTOR, stageStart);
+            }
+
+            // Stereo calibration with FIXED INTRINSICS for both the camera and projector:
+            stageStart=ofGetElapsedTimeMicros();
+            work.projector.stereoCalibrationCameraProjector(work.camera, work.rotCamToProj, work.transCamToProj);
+            recordStage(STAGE_STEREO_CALIBRATION, stageStart);
+
+            // Joint refinement (the camera and projector boards are the same physical boards, in the same order):
+            if (jointExtrinsics && work.camera.size()==work.projector.size()) {
+                stageStart=ofGetElapsedTimeMicros();
+                graph.clear();
+                graph.addDevice("camera", work.camera.getDistortedIntrinsics().getCameraMatrix(), work.camera.getDistCoeffs());
+                graph.addDevice("projector", work.projector.getDistortedIntrinsics().getCameraMatrix(), work.projector.getDistCoeffs());
+                graph.addCalibration(0, work.camera);
+                graph.addCalibration(1, work.projector);
+                if (graph.solve()) {
+                    Mat graphRotation, graphTranslation;
+                    graph.getExtrinsics(0, 1, graphRotation, graphTranslation);
+                    float graphError=graph.getReprojectionError();
+                    // Only if it explains the observations better than the stereo extrinsics, evaluated on the same model
+                    // (the board poses are re-optimized for them too):
+                    graph.setDevicePose(1, work.rotCamToProj, work.transCamToProj);
+                    if (graph.solveBoards() && graphError<graph.getReprojectionError()) {
+                        graphRotation.copyTo(work.rotCamToProj);
+                        graphTranslation.copyTo(work.transCamToProj);
+                    }
+                }
+                recordStage(STAGE_JOINT_EXTRINSICS, stageStart);
+            }
+        }
+
+        work.solveTime=ofGetElapsedTimef()-startTime;
+
+        // Publish:
+        lock();
+        swap(backSlot, frontSlot);
+        hasResult=true;
+        solving=false;
+        unlock();
+    }
+}
+
+void CalibrationSolver::recordStage(ProfilerStage stage, unsigned long long startMicros) {
+    if (profiler && profiler->isEnabled()) profiler->record(stage, profilerState, ofGetElapsedTimeMicros()-startMicros);
+}
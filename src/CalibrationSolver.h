@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "Poco/Event.h"
+#include "StageProfiler.h"
+#include "IncrementalCalibration.h"
+#include "BoardCleaner.h"
+#include "CalibrationGraph.h"
+#include "EditableCalibration.h"
+
+// ==================================================================
+// Background solver for the projector calibration + cleaning + stereo calibration step of PHASE2.
+// These three calls re-solve ALL the boards, so with more than ~15 boards they take hundreds of milliseconds and used to
+// freeze capture and the (dynamic) projected pattern. Now the frame thread only SUBMITS a snapshot (a copy of both
+// calibration objects, i.e. of their board lists), and keeps detecting at camera rate while the solver works on the copies.
+//
+// Buffers (all copies are made on the frame thread, the worker only swaps indices; the copies are deep, see
+// EditableCalibration::deepCopy, so the solver never writes into Mats the frame thread reads):
+// - one input snapshot slot: a newer submission simply overwrites an older one that was not yet picked by the worker,
+// - a double-buffered result (back: being solved, front: last finished result), published atomically by swapping indices.
+// Projector calibration is incremental (see IncrementalCalibration): if only the pose of the new board is computed, the
+// cleaning and the stereo calibration are skipped too (the extrinsics of the snapshot are kept).
+// Optionally (setJointExtrinsics), the stereo extrinsics are then refined by the calibration graph (see CalibrationGraph),
+// which solves the poses of all the devices and boards together; its extrinsics replace the stereo ones only if its
+// reprojection error is lower than the one of the stereo extrinsics on the same model (board poses solved in the graph
+// with the stereo extrinsics fixed, see CalibrationGraph::solveBoards).
+// A finished result is dropped if the calibration was reset in the meantime (initialization). If boards were submitted
+// after its snapshot, it is still published (otherwise nothing would be published while boards arrive faster than one
+// solve), with the boards added since appended to its board lists (with the camera poses added by the frame thread, so
+// camera pose i stays the pose of board i); the newer snapshot is solved next.
+// ==================================================================
+
+struct StereoSolution {
+    EditableCalibration camera, projector;
+    cv::Mat rotCamToProj, transCamToProj;
+    int generation; // snapshot number (monotonic)
+    int cameraBoards, projectorBoards; // board counts as submitted (before the solver cleaning)
+    int epoch;      // calibration session (incremented by reset())
+    float solveTime; // seconds spent in the solver thread
+    bool refined;    // true if this was a full calibration (and not just the pose of the new board)
+};
+
+class CalibrationSolver : public ofThread {
+public:
+    CalibrationSolver();
+    ~CalibrationSolver();
+
+    // The solver stages are recorded in the profiler (if any) under the given state.
+    void setup(int startCleaningProjector, float maxErrorProjector, StageProfiler* profiler = NULL, int profilerState = 0);
+    void stop();
+    // Full calibration every refineEvery boards, on error jumps, and always above alwaysRefineAbove boards:
+    void setIncremental(int refineEvery, float errorJump, int alwaysRefineAbove);
+    void setCleaningMode(CleaningMode mode) {cleaningMode=mode;}
+    void setJointExtrinsics(bool joint) {jointExtrinsics=joint;}
+
+    // Frame thread: copy the current board lists and wake up the worker.
+    void submit(const EditableCalibration& camera, const EditableCalibration& projector, const cv::Mat& rotCamToProj, const cv::Mat& transCamToProj);
+    // Frame thread: if a NEW result of the current session is available, copy it into the arguments and return true.
+    bool fetch(EditableCalibration& camera, EditableCalibration& projector, cv::Mat& rotCamToProj, cv::Mat& transCamToProj);
+    // Frame thread: forget everything submitted so far (results in flight will be dropped).
+    void reset();
+
+    bool isSolving(); // true if a snapshot is waiting or being solved
+    float getLastSolveTime() const {return lastSolveTime;}
+    int getDroppedResults() const {return droppedResults;}
+    int getStaleResults() const {return staleResults;} // results published while a newer snapshot was pending
+
+protected:
+    void threadedFunction();
+    void recordStage(ProfilerStage stage, unsigned long long startMicros);
+
+    StereoSolution slots[3];
+    int snapshotSlot, backSlot, frontSlot;
+    bool hasSnapshot, solving, hasResult;
+
+    int submittedGeneration, publishedGeneration, currentEpoch;
+    int startCleaning;
+    IncrementalCalibration incrementalProjector; // (solver thread only)
+    int alwaysRefineAbove;
+    bool resetIncremental;
+    float maxError;
+    CleaningMode cleaningMode;
+    bool jointExtrinsics;
+    CalibrationGraph graph; // (solver thread only)
+    StageProfiler* profiler;
+    int profilerState;
+    float lastSolveTime;
+    int droppedResults, staleResults;
+
+    Poco::Event wakeUp;
+};
@@ -0,0 +1,238 @@
+#include "CalibrationStore.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ofxCv;
+using namespace cv;
+
+static const char storeMagic[4]={'C', 'P', 'C', 'B'};
+static const uint32_t storeVersion=1;
+
+CalibrationStore::CalibrationStore() {
+    header=NULL;
+    mapped=NULL;
+    mappedSize=0;
+    writtenBoards=0;
+}
+
+CalibrationStore::~CalibrationStore() {
+    close();
+}
+
+// ---- Reading ----
+
+bool CalibrationStore::open(string filename, bool absolute) {
+    close();
+    string path=ofToDataPath(filename, absolute);
+    int fd=::open(path.c_str(), O_RDONLY);
+    if (fd<0) return false;
+    struct stat info;
+    if (fstat(fd, &info)!=0 || info.st_size<sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    mappedSize=info.st_size;
+    mapped=mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // (the mapping keeps the file)
+    if (mapped==MAP_FAILED) {
+        mapped=NULL;
+        return false;
+    }
+    header=(const Header*)mapped;
+    if (memcmp(header->magic, storeMagic, 4)!=0 || header->version!=storeVersion) {
+        ofLogError() << "CalibrationStore: " << path << " is not a calibration store (or a different version)";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CalibrationStore::close() {
+    if (mapped) munmap(mapped, mappedSize);
+    mapped=NULL;
+    header=NULL;
+    mappedSize=0;
+    boards.clear();
+}
+
+Mat CalibrationStore::getCameraMatrix() const {
+    if (!header) return Mat();
+    return Mat(3, 3, CV_64F, (void*)header->cameraMatrix).clone();
+}
+
+Mat CalibrationStore::getDistCoeffs() const {
+    if (!header) return Mat();
+    return Mat(header->numDistCoeffs, 1, CV_64F, (void*)header->distCoeffs).clone();
+}
+
+cv::Size CalibrationStore::getImageSize() const {
+    return header ? cv::Size(header->imageWidth, header->imageHeight) : cv::Size();
+}
+
+float CalibrationStore::getReprojectionError() const {
+    return header ? header->reprojectionError : 0;
+}
+
+bool CalibrationStore::hasExtrinsics() const {
+    return header && header->hasExtrinsics;
+}
+
+void CalibrationStore::getExtrinsics(Mat& rotation, Mat& translation) const {
+    if (!hasExtrinsics()) return;
+    Mat(3, 1, CV_64F, (void*)header->rotation).copyTo(rotation);
+    Mat(3, 1, CV_64F, (void*)header->translation).copyTo(translation);
+}
+
+int CalibrationStore::size() const {
+    return header ? header->numBoards : 0;
+}
+
+bool CalibrationStore::indexBoards() {
+    if (!boards.empty() || !header) return true;
+    const char* position=(const char*)mapped+sizeof(Header);
+    const char* end=(const char*)mapped+mappedSize;
+    for (int i=0; i<header->numBoards; i++) {
+        const BoardRecord* record=(const BoardRecord*)position;
+        if (position+sizeof(BoardRecord)>end) break;
+        position+=sizeof(BoardRecord)+record->numPoints*5*sizeof(float);
+        if (position>end) break;
+        boards.push_back(record);
+    }
+    if (boards.size()!=header->numBoards) {
+        ofLogError() << "CalibrationStore: truncated file";
+        boards.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CalibrationStore::getBoard(int board, vector<Point2f>& imagePoints, vector<Point3f>& objectPoints) {
+    if (!indexBoards() || board<0 || board>=boards.size()) return false;
+    const BoardRecord* record=boards[board];
+    const Point2f* image=(const Point2f*)(record+1);
+    const Point3f* object=(const Point3f*)(image+record->numPoints);
+    imagePoints.assign(image, image+record->numPoints);
+    objectPoints.assign(object, object+record->numPoints);
+    return true;
+}
+
+bool CalibrationStore::toCalibration(EditableCalibration& calibration, bool withBoards) {
+    if (!header) return false;
+    calibration.deleteAllBoards();
+    calibration.setIntrinsics(getCameraMatrix(), getDistCoeffs(), getImageSize(), header->reprojectionError);
+
+    if (withBoards) {
+        vector<Point2f> imagePoints;
+        vector<Point3f> objectPoints;
+        for (int i=0; i<size(); i++) {
+            if (!getBoard(i, imagePoints, objectPoints)) return false;
+            calibration.imagePoints.push_back(imagePoints);
+            calibration.objectPoints.push_back(objectPoints);
+        }
+    }
+    return true;
+}
+
+// ---- Writing ----
+
+void CalibrationStore::fillHeader(Header& header, Calibration& calibration, const Mat& rotation, const Mat& translation, int numBoards) {
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, storeMagic, 4);
+    header.version=storeVersion;
+
+    cv::Size imageSize=calibration.getDistortedIntrinsics().getImageSize();
+    header.imageWidth=imageSize.width;
+    header.imageHeight=imageSize.height;
+
+    Mat cameraMatrix;
+    calibration.getDistortedIntrinsics().getCameraMatrix().convertTo(cameraMatrix, CV_64F);
+    for (int i=0; i<9 && i<cameraMatrix.total(); i++) header.cameraMatrix[i]=cameraMatrix.at<double>(i/3, i%3);
+
+    Mat distCoeffs;
+    calibration.getDistCoeffs().convertTo(distCoeffs, CV_64F);
+    distCoeffs=distCoeffs.reshape(1, distCoeffs.total());
+    header.numDistCoeffs=MIN(distCoeffs.total(), 8);
+    for (int i=0; i<header.numDistCoeffs; i++) header.distCoeffs[i]=distCoeffs.at<double>(i);
+
+    header.reprojectionError=calibration.getReprojectionError();
+
+    if (!rotation.empty() && !translation.empty()) {
+        Mat r, t;
+        rotation.reshape(1, 3).convertTo(r, CV_64F);
+        translation.reshape(1, 3).convertTo(t, CV_64F);
+        for (int i=0; i<3; i++) {
+            header.rotation[i]=r.at<double>(i);
+            header.translation[i]=t.at<double>(i);
+        }
+        header.hasExtrinsics=1;
+    }
+    header.numBoards=numBoards;
+}
+
+bool CalibrationStore::writeBoard(FILE* file, const vector<Point2f>& imagePoints, const vector<Point3f>& objectPoints) {
+    BoardRecord record;
+    record.numPoints=MIN(imagePoints.size(), objectPoints.size());
+    record.reserved=0;
+    if (fwrite(&record, sizeof(record), 1, file)!=1) return false;
+    if (record.numPoints==0) return true;
+    return fwrite(&imagePoints[0], sizeof(Point2f), record.numPoints, file)==record.numPoints &&
+           fwrite(&objectPoints[0], sizeof(Point3f), record.numPoints, file)==record.numPoints;
+}
+
+bool CalibrationStore::save(string filename, Calibration& calibration, const Mat& rotation, const Mat& translation, bool absolute) {
+    string path=ofToDataPath(filename, absolute);
+    if (header) close(); // (do not write under a mapping)
+
+    FILE* file=fopen(path.c_str(), "wb");
+    if (!file) return false;
+    int numBoards=MIN(calibration.imagePoints.size(), calibration.objectPoints.size());
+    Header newHeader;
+    fillHeader(newHeader, calibration, rotation, translation, numBoards);
+    bool ok=fwrite(&newHeader, sizeof(Header), 1, file)==1;
+    for (int i=0; ok && i<numBoards; i++) ok=writeBoard(file, calibration.imagePoints[i], calibration.objectPoints[i]);
+    ok=(fclose(file)==0) && ok;
+
+    writtenFile=ok ? path : "";
+    writtenBoards=numBoards;
+    if (numBoards>0 && !calibration.imagePoints[numBoards-1].empty()) writtenLastPoint=calibration.imagePoints[numBoards-1][0];
+    return ok;
+}
+
+bool CalibrationStore::checkpoint(string filename, Calibration& calibration, const Mat& rotation, const Mat& translation, bool absolute) {
+    string path=ofToDataPath(filename, absolute);
+    int numBoards=MIN(calibration.imagePoints.size(), calibration.objectPoints.size());
+
+    // Can we append? Same file, no board removed since the last write (the last written board is still at its place):
+    bool append=(path==writtenFile && numBoards>=writtenBoards);
+    if (append && writtenBoards>0) {
+        const vector<Point2f>& last=calibration.imagePoints[writtenBoards-1];
+        append=!last.empty() && last[0]==writtenLastPoint;
+    }
+    if (!append) return save(filename, calibration, rotation, translation, absolute);
+    if (header) close();
+
+    FILE* file=fopen(path.c_str(), "r+b");
+    if (!file) return save(filename, calibration, rotation, translation, absolute);
+    bool ok=(fseek(file, 0, SEEK_END)==0);
+    for (int i=writtenBoards; ok && i<numBoards; i++) ok=writeBoard(file, calibration.imagePoints[i], calibration.objectPoints[i]);
+    // Header last (number of boards, new intrinsics):
+    Header newHeader;
+    fillHeader(newHeader, calibration, rotation, translation, numBoards);
+    ok=ok && fflush(file)==0 && fseek(file, 0, SEEK_SET)==0 && fwrite(&newHeader, sizeof(Header), 1, file)==1;
+    ok=(fclose(file)==0) && ok;
+    if (!ok) return save(filename, calibration, rotation, translation, absolute);
+
+    writtenBoards=numBoards;
+    if (numBoards>0 && !calibration.imagePoints[numBoards-1].empty()) writtenLastPoint=calibration.imagePoints[numBoards-1][0];
+    return true;
+}
+
+void CalibrationStore::discard(string filename, bool absolute) {
+    string path=ofToDataPath(filename, absolute);
+    if (header) close();
+    remove(path.c_str());
+    if (path==writtenFile) writtenFile="";
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include <stdint.h>
+#include "EditableCalibration.h"
+
+// ==================================================================
+// Compact binary calibration file (instead of the YAML text of Calibration::save, mostly made of the "features"):
+//
+//      [header: intrinsics, distortion, image size, reprojection error, extrinsics (optional), number of boards]
+//      [board 0: number of points, image points (float x, y), object points (float x, y, z)]
+//      [board 1...]
+//
+// Reading: open() maps the file in memory and only reads the header (startup in AR mode does not touch the boards);
+// the board records are indexed and read only if asked for (getBoard, or toCalibration(..., true)).
+// Writing: checkpoint() APPENDS the boards added since the last call and rewrites the (fixed size) header in place, so
+// saving after every board costs a few microseconds. If boards were removed (cleaning), the whole file is rewritten.
+// The header is written AFTER the board records: if the program dies in between, the file is still valid (the extra
+// record is ignored).
+// Note: native byte order (this file is a cache of the calibration, the YAML files are still the exchange format).
+// ==================================================================
+
+class CalibrationStore {
+public:
+    CalibrationStore();
+    ~CalibrationStore();
+
+    // ---- Reading ----
+    bool open(string filename, bool absolute = false);
+    void close();
+    bool isOpen() const {return header!=NULL;}
+
+    cv::Mat getCameraMatrix() const;
+    cv::Mat getDistCoeffs() const;
+    cv::Size getImageSize() const;
+    float getReprojectionError() const;
+    bool hasExtrinsics() const;
+    void getExtrinsics(cv::Mat& rotation, cv::Mat& translation) const;
+
+    int size() const;
+    bool getBoard(int board, vector<cv::Point2f>& imagePoints, vector<cv::Point3f>& objectPoints);
+
+    // Set the intrinsics (and optionally all the boards) of a Calibration object:
+    bool toCalibration(EditableCalibration& calibration, bool withBoards = false);
+
+    // ---- Writing ----
+    // Rotation/translation: extrinsics to store with this calibration (empty: none).
+    bool save(string filename, ofxCv::Calibration& calibration, const cv::Mat& rotation = cv::Mat(), const cv::Mat& translation = cv::Mat(), bool absolute = false);
+    bool checkpoint(string filename, ofxCv::Calibration& calibration, const cv::Mat& rotation = cv::Mat(), const cv::Mat& translation = cv::Mat(), bool absolute = false);
+    // Delete a checkpoint file (the session it resumes is complete):
+    void discard(string filename, bool absolute = false);
+
+protected:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        int32_t imageWidth, imageHeight;
+        double cameraMatrix[9];
+        double distCoeffs[8];
+        int32_t numDistCoeffs;
+        int32_t hasExtrinsics;
+        double rotation[3], translation[3];
+        double reprojectionError;
+        uint32_t numBoards;
+        uint32_t reserved;
+    };
+    struct BoardRecord {
+        uint32_t numPoints;
+        uint32_t reserved;
+        // followed by numPoints*2 floats (image points) and numPoints*3 floats (object points)
+    };
+
+    static void fillHeader(Header& header, ofxCv::Calibration& calibration, const cv::Mat& rotation, const cv::Mat& translation, int numBoards);
+    static bool writeBoard(FILE* file, const vector<cv::Point2f>& imagePoints, const vector<cv::Point3f>& objectPoints);
+    bool indexBoards();
+
+    // Reading (memory mapped file):
+    const Header* header;
+    void* mapped;
+    size_t mappedSize;
+    vector<const BoardRecord*> boards; // (indexed on first access)
+
+    // Writing (what the last save/checkpoint wrote, to append only the new boards):
+    string writtenFile;
+    int writtenBoards;
+    cv::Point2f writtenLastPoint; // first image point of the last written board
+};
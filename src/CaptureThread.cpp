@@ -0,0 +1,43 @@
+#include "CaptureThread.h"
+
+using namespace cv;
+
+CaptureThread::CaptureThread() {
+    captureFps=0;
+}
+
+CaptureThread::~CaptureThread() {
+    stop();
+}
+
+bool CaptureThread::setup(int width, int height, int numSlots) {
+    grabber.setUseTexture(false);
+    grabber.listDevices();
+    if (!grabber.initGrabber(width, height)) return false;
+    ring.setup(grabber.getWidth(), grabber.getHeight(), CV_8UC3, numSlots);
+    startThread(true, false);
+    return true;
+}
+
+void CaptureThread::stop() {
+    if (isThreadRunning()) {
+        stopThread();
+        waitForThread(false);
+    }
+}
+
+void CaptureThread::threadedFunction() {
+    unsigned long long lastCapture=0;
+    while (isThreadRunning()) {
+        grabber.update();
+        if (!grabber.isFrameNew()) {
+            ofSleepMillis(1);
+            continue;
+        }
+        unsigned long long now=FrameRing::nowMicros();
+        ring.push(grabber.getPixels(), now);
+
+        if (lastCapture>0) captureFps=0.9*captureFps+0.1*(1000000.0/MAX(now-lastCapture, 1ULL));
+        lastCapture=now;
+    }
+}
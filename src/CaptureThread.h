@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "FrameRing.h"
+
+// ==================================================================
+// Camera capture in its own thread: cam.update() used to be polled from testApp::update(), i.e. at the display (vsync)
+// rate, so capture, processing and rendering were locked together, and any slow step (calibrate...) dropped frames.
+// Now the grabber is polled here, and each new frame is copied (with its monotonic capture timestamp) into a FrameRing:
+// processing never blocks the capture, and the consumer picks the newest frame or every frame (see FramePolicy).
+// Note: the grabber does not use a texture (no OpenGL in this thread); to display the frames, draw the acquired image.
+// ==================================================================
+
+class CaptureThread : public ofThread {
+public:
+    CaptureThread();
+    ~CaptureThread();
+
+    // (the grabber is initialized in the calling thread, then the capture thread starts)
+    bool setup(int width, int height, int numSlots = 4);
+    void stop();
+
+    bool acquire(CapturedFrame& frame, FramePolicy policy) {return ring.acquire(frame, policy);}
+    void release() {ring.release();}
+
+    unsigned int getCaptured() const {return ring.getPushed();}
+    unsigned int getDropped() const {return ring.getDropped();}
+    float getCaptureFps() const {return captureFps;}
+
+protected:
+    void threadedFunction();
+
+    ofVideoGrabber grabber;
+    FrameRing ring;
+    float captureFps;
+};
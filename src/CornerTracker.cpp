@@ -0,0 +1,76 @@
+#include "CornerTracker.h"
+
+using namespace cv;
+
+CornerTracker::CornerTracker() {
+    tracking=false;
+    framesSinceDetection=0;
+    maxFramesWithoutDetection=60;
+    maxForwardBackwardError=0.5;
+    maxGeometryError=1.5;
+    arena=NULL;
+    initialized=false;
+}
+
+void CornerTracker::setDetected(const Mat& gray, const vector<Point2f>& corners, const vector<Point3f>& objectPoints) {
+    if (corners.size()<4 || corners.size()!=objectPoints.size()) {
+        tracking=false;
+        return;
+    }
+    gray.copyTo(previousGray);
+    previousPoints=corners;
+    modelPoints.resize(objectPoints.size());
+    for (int i=0; i<objectPoints.size(); i++) modelPoints[i]=Point2f(objectPoints[i].x, objectPoints[i].y);
+    framesSinceDetection=0;
+    tracking=true;
+}
+
+bool CornerTracker::track(const Mat& gray, vector<Point2f>& corners) {
+    if (!tracking) return false;
+    if (++framesSinceDetection>maxFramesWithoutDetection) {
+        tracking=false;
+        return false;
+    }
+
+    // The outputs keep their capacity from frame to frame (they must not be allocated in the arena):
+    int n=previousPoints.size();
+    nextPoints.reserve(n); backPoints.reserve(n); fittedPoints.reserve(n);
+    status.reserve(n); backStatus.reserve(n); errors.reserve(n);
+    Mat H;
+    {
+        FrameArenaScope scope(initialized ? arena : NULL);
+        initialized=true;
+
+        // Forward and backward flow:
+        calcOpticalFlowPyrLK(previousGray, gray, previousPoints, nextPoints, status, errors, cv::Size(15, 15), 2);
+        calcOpticalFlowPyrLK(gray, previousGray, nextPoints, backPoints, backStatus, errors, cv::Size(15, 15), 2);
+        // Pattern geometry: all the corners must be explained by the homography of the (planar) board.
+        H=findHomography(Mat(modelPoints), Mat(nextPoints), 0);
+        if (!H.empty()) perspectiveTransform(modelPoints, fittedPoints, H);
+    }
+    for (int i=0; i<nextPoints.size(); i++) {
+        if (!status[i] || !backStatus[i] || norm(backPoints[i]-previousPoints[i])>maxForwardBackwardError) {
+            tracking=false;
+            return false;
+        }
+    }
+    if (H.empty()) {
+        tracking=false;
+        return false;
+    }
+    double squaredError=0;
+    for (int i=0; i<fittedPoints.size(); i++) {
+        Point2f d=fittedPoints[i]-nextPoints[i];
+        squaredError+=d.dot(d);
+    }
+    if (sqrt(squaredError/fittedPoints.size())>maxGeometryError) {
+        tracking=false;
+        return false;
+    }
+
+    // Accepted: this frame becomes the reference for the next one.
+    gray.copyTo(previousGray); // (own copy, the buffer is reused: the caller's image may be overwritten before the next call)
+    previousPoints.swap(nextPoints);
+    corners=previousPoints;
+    return true;
+}
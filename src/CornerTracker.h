@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "FrameArena.h"
+
+// ==================================================================
+// Frame to frame tracking of the printed pattern corners (AR_DEMO), instead of running the full pattern detection on
+// every frame. Seeded with the corners of a full detection, the corners are propagated with pyramidal Lucas-Kanade
+// optical flow and validated:
+// - forward-backward check (each corner must come back to where it was),
+// - pattern geometry: the board is planar, so the tracked corners must fit the homography of the board model points.
+// If a test fails (or after maxFramesWithoutDetection frames, to bound the drift), the tracking is lost and the caller
+// must go back to the full detection.
+// With a frame arena (setArena), the temporaries of the optical flow and of the homography fit (OpenCV's pyramids and
+// work buffers) come from the arena instead of the heap (see FrameArena).
+// ==================================================================
+
+class CornerTracker {
+public:
+    CornerTracker();
+
+    void setMaxFramesWithoutDetection(int frames) {maxFramesWithoutDetection=frames;}
+    void setMaxError(float forwardBackward, float geometry) {maxForwardBackwardError=forwardBackward; maxGeometryError=geometry;}
+
+    // Seed (gray: full resolution grayscale frame; objectPoints: board model points in the same order as the corners)
+    void setDetected(const cv::Mat& gray, const vector<cv::Point2f>& corners, const vector<cv::Point3f>& objectPoints);
+    // Propagate the corners to the new frame. Returns false if tracking is lost.
+    // Note: the reference image is copied into the tracker (the preprocessor buffers are overwritten by the frames where
+    // track() is not called: loopback mode, other AR path, state changes).
+    bool track(const cv::Mat& gray, vector<cv::Point2f>& corners);
+    void reset() {tracking=false;}
+    void setArena(FrameArena* arena) {this->arena=arena;}
+    bool isTracking() const {return tracking;}
+
+protected:
+    bool tracking;
+    int framesSinceDetection, maxFramesWithoutDetection;
+    float maxForwardBackwardError, maxGeometryError;
+    FrameArena* arena;
+    bool initialized; // (the first track() runs on the heap: one time initializations of OpenCV)
+
+    cv::Mat previousGray;
+    vector<cv::Point2f> modelPoints, previousPoints, nextPoints, backPoints, fittedPoints;
+    vector<uchar> status, backStatus;
+    vector<float> errors;
+};
@@ -0,0 +1,99 @@
+#include "CoverageMap.h"
+
+using namespace cv;
+using namespace ofxCv;
+
+CoverageMap::CoverageMap() {
+    setThresholds(2, 10, 0.15);
+    setup(cv::Size(640, 480));
+}
+
+void CoverageMap::setup(cv::Size imageSize, int cols, int rows) {
+    this->imageSize=imageSize;
+    this->cols=MAX(cols, 1);
+    this->rows=MAX(rows, 1);
+    reset();
+}
+
+void CoverageMap::setThresholds(int minNewCells, float minAngleDegrees, float minRelativeTranslation) {
+    this->minNewCells=minNewCells;
+    minAngle=ofDegToRad(minAngleDegrees);
+    this->minRelativeTranslation=minRelativeTranslation;
+}
+
+void CoverageMap::reset() {
+    counts.assign(cols*rows, 0);
+    poses.clear();
+}
+
+// Cells touched by the points (each cell once):
+void CoverageMap::cellsOf(const vector<Point2f>& imagePoints, vector<int>& cells) const {
+    cells.clear();
+    for (int i=0; i<imagePoints.size(); i++) {
+        int cx=imagePoints[i].x*cols/imageSize.width, cy=imagePoints[i].y*rows/imageSize.height;
+        if (cx<0 || cx>=cols || cy<0 || cy>=rows) continue;
+        int cell=cy*cols+cx;
+        if (find(cells.begin(), cells.end(), cell)==cells.end()) cells.push_back(cell);
+    }
+}
+
+int CoverageMap::countNewCells(const vector<Point2f>& imagePoints) const {
+    cellsOf(imagePoints, cells);
+    int newCells=0;
+    for (int i=0; i<cells.size(); i++) if (counts[cells[i]]==0) newCells++;
+    return newCells;
+}
+
+bool CoverageMap::isDiverse(const Mat& rotation, const Mat& translation) const {
+    if (rotation.empty() || translation.empty()) return false;
+    RigidPose candidate=RigidPose::fromRodrigues(rotation, translation);
+    double distance=norm(candidate.t);
+    for (int i=0; i<poses.size(); i++) {
+        double r[3];
+        RigidPose::vectorFromRotation(candidate.R*poses[i].R.t(), r);
+        double angle=sqrt(r[0]*r[0]+r[1]*r[1]+r[2]*r[2]);
+        double translationChange=norm(candidate.t-poses[i].t)/MAX(MAX(distance, norm(poses[i].t)), 1e-6);
+        if (angle<minAngle && translationChange<minRelativeTranslation) return false; // (too close to this one)
+    }
+    return true;
+}
+
+void CoverageMap::add(const vector<Point2f>& imagePoints, const Mat& rotation, const Mat& translation) {
+    cellsOf(imagePoints, cells);
+    for (int i=0; i<cells.size(); i++) counts[cells[i]]++;
+    if (!rotation.empty() && !translation.empty()) poses.push_back(RigidPose::fromRodrigues(rotation, translation));
+}
+
+void CoverageMap::rebuild(const Calibration& calibration) {
+    reset();
+    for (int i=0; i<calibration.imagePoints.size(); i++) {
+        bool hasPose=(i<calibration.boardRotations.size() && i<calibration.boardTranslations.size());
+        add(calibration.imagePoints[i], hasPose ? calibration.boardRotations[i] : Mat(), hasPose ? calibration.boardTranslations[i] : Mat());
+    }
+}
+
+float CoverageMap::getCoverage() const {
+    int covered=0;
+    for (int i=0; i<counts.size(); i++) if (counts[i]) covered++;
+    return (float)covered/counts.size();
+}
+
+void CoverageMap::draw(float x, float y, float width, float height) const {
+    ofPushStyle();
+    ofFill();
+    float cellWidth=width/cols, cellHeight=height/rows;
+    for (int cy=0; cy<rows; cy++) {
+        for (int cx=0; cx<cols; cx++) {
+            int count=counts[cy*cols+cx];
+            // red: still needs samples, then yellow to green with the number of boards
+            if (count==0) ofSetColor(255, 0, 0, 70);
+            else ofSetColor(255*MAX(0, 3-count)/3, 255, 0, 40);
+            ofRect(x+cx*cellWidth, y+cy*cellHeight, cellWidth, cellHeight);
+        }
+    }
+    ofNoFill();
+    ofSetColor(255, 255, 255, 80);
+    for (int cx=0; cx<=cols; cx++) ofLine(x+cx*cellWidth, y, x+cx*cellWidth, y+height);
+    for (int cy=0; cy<=rows; cy++) ofLine(x, y+cy*cellHeight, x+width, y+cy*cellHeight);
+    ofPopStyle();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "FixedPattern.h"
+
+// ==================================================================
+// Board acceptance by coverage, instead of time and image difference only: near identical boards add nothing to the
+// calibration (and each of them costs a solve, before clean() throws them away).
+// - image space coverage: a coarse grid over the image (camera or projector), each cell counting the boards that had
+//   points in it; a candidate is "novel" if it has points in at least minNewCells empty cells,
+// - pose diversity: the distance of the candidate board pose to the nearest accepted pose (rotation angle, and
+//   translation relative to the distance to the board); a candidate is "diverse" if it is far enough from all of them.
+// The caller rejects a candidate that is neither novel nor diverse (in any of the maps it cares about), BEFORE adding
+// it. The maps are rebuilt from the board lists of the calibration object after cleaning or after a solver result.
+// draw() shows which cells still need samples.
+// ==================================================================
+
+class CoverageMap {
+public:
+    CoverageMap();
+
+    void setup(cv::Size imageSize, int cols = 8, int rows = 6);
+    void setThresholds(int minNewCells, float minAngleDegrees, float minRelativeTranslation);
+    void reset();
+
+    // Candidate tests (poses: board -> camera, rotation vector + translation; empty if unknown):
+    int countNewCells(const vector<cv::Point2f>& imagePoints) const;
+    bool isNovel(const vector<cv::Point2f>& imagePoints) const {return countNewCells(imagePoints)>=minNewCells;}
+    bool isDiverse(const cv::Mat& rotation, const cv::Mat& translation) const;
+
+    void add(const vector<cv::Point2f>& imagePoints, const cv::Mat& rotation = cv::Mat(), const cv::Mat& translation = cv::Mat());
+    // All the boards of a calibration object (its image points, and the board poses if any):
+    void rebuild(const ofxCv::Calibration& calibration);
+
+    float getCoverage() const; // fraction of covered cells
+    void draw(float x, float y, float width, float height) const;
+
+protected:
+    void cellsOf(const vector<cv::Point2f>& imagePoints, vector<int>& cells) const;
+
+    cv::Size imageSize;
+    int cols, rows;
+    vector<int> counts;
+    vector<RigidPose> poses;
+
+    int minNewCells;
+    float minAngle, minRelativeTranslation; // (radians)
+    mutable vector<int> cells; // (scratch)
+};
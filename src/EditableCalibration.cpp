@@ -0,0 +1,44 @@
+#include "EditableCalibration.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+void EditableCalibration::setIntrinsics(const Mat& cameraMatrix, const Mat& distCoeffs, cv::Size imageSize, float reprojectionError) {
+    this->distCoeffs=distCoeffs.clone();
+    addedImageSize=imageSize;
+    this->reprojectionError=reprojectionError;
+    distortedIntrinsics.setup(cameraMatrix.clone(), imageSize);
+    updateUndistortion();
+    ready=true;
+}
+
+void EditableCalibration::setSolution(const Mat& cameraMatrix, const Mat& distCoeffs, cv::Size imageSize,
+                                      const vector<Mat>& rotations, const vector<Mat>& translations) {
+    boardRotations=rotations;
+    boardTranslations=translations;
+    setIntrinsics(cameraMatrix, distCoeffs, imageSize, 0);
+    updateReprojectionError();
+}
+
+static void cloneAll(vector<Mat>& mats) {
+    for (int i=0; i<mats.size(); i++) mats[i]=mats[i].clone();
+}
+
+static void cloneIntrinsics(const Intrinsics& from, Intrinsics& to) {
+    if (from.getCameraMatrix().empty()) return;
+    to.setup(from.getCameraMatrix().clone(), from.getImageSize(), from.getSensorSize());
+}
+
+void EditableCalibration::deepCopy(const EditableCalibration& from) {
+    *this=from;
+    cloneAll(boardRotations);
+    cloneAll(boardTranslations);
+    candidateBoardRotation=from.candidateBoardRotation.clone();
+    candidateBoardTranslation=from.candidateBoardTranslation.clone();
+    distCoeffs=from.distCoeffs.clone();
+    undistortMapX=from.undistortMapX.clone();
+    undistortMapY=from.undistortMapY.clone();
+    grayMat=from.grayMat.clone();
+    cloneIntrinsics(from.distortedIntrinsics, distortedIntrinsics);
+    cloneIntrinsics(from.undistortedIntrinsics, undistortedIntrinsics);
+}
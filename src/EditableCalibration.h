@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// ofxCv::Calibration with public setters for its intrinsics. The addon only sets them through calibrate() or load()
+// (a YAML file); these set the same members from values we already have in memory (binary store, warm started
+// calibrateCamera), and update the undistortion like load() does.
+// deepCopy: the copy operator of Calibration shares the data of all its cv::Mat members (intrinsics, board poses,
+// undistortion maps), and calibrateCamera/initUndistortRectifyMap write into existing Mats of the right size IN PLACE,
+// so a copy handed to another thread must own its data.
+// The calibration objects whose intrinsics are set this way (the ones of testApp and of the solver) are of this type.
+// ==================================================================
+
+class EditableCalibration : public ofxCv::Calibration {
+public:
+    void setIntrinsics(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize, float reprojectionError);
+    // Intrinsics and board poses of a calibrateCamera solution (the per board errors are updated as by calibrate()):
+    void setSolution(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize,
+                     const vector<cv::Mat>& rotations, const vector<cv::Mat>& translations);
+    void deepCopy(const EditableCalibration& from);
+};
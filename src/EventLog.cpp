@@ -0,0 +1,164 @@
+#include "EventLog.h"
+
+static const char* eventTypeNames[NUM_LOG_EVENT_TYPES]={"message", "state", "board_accepted", "board_rejected", "reprojection_error", "stage_timing"};
+static const char* deviceNames[]={"camera", "projector", "stereo"};
+static const char* rejectReasonNames[NUM_REJECT_REASONS]={"printed_not_visible", "projected_not_visible", "board_moved", "not_enough_points", "camera_not_calibrated", "redundant"};
+static const char* rejectReasonHints[NUM_REJECT_REASONS]={
+    "move the board so that the PRINTED pattern is visible",
+    "move the board so that the PROJECTED pattern is visible too",
+    "the board moved during the structured light sequence",
+    "not enough decoded points",
+    "the camera must be calibrated (PHASE1 or PHASE2)",
+    "redundant board (move it to the regions still in red, or tilt it)"
+};
+static const char* messageNames[NUM_LOG_MESSAGES]={
+    "dynamic_pattern", "fixed_pattern", "printed_detected", "projected_detected", "camera_pose_only", "camera_recalibrated",
+    "projector_solving", "projector_solved", "structured_light_started", "structured_light_decoded",
+    "session_resumed"
+};
+
+EventLog::EventLog() {
+    head=tail=0;
+    currentFrame=0;
+    dropped=0;
+    file=NULL;
+    echo=true;
+    for (int i=0; i<4; i++) stateNames[i]=ofToString(i);
+}
+
+EventLog::~EventLog() {
+    stop();
+}
+
+void EventLog::setup(string filename, int capacity, bool echo) {
+    stop();
+    ring.resize(MAX(capacity, 16));
+    head=tail=0;
+    this->echo=echo;
+    file=fopen(ofToDataPath(filename).c_str(), "a");
+    if (!file) ofLogError() << "Cannot open the event log " << filename;
+    startThread(true, false);
+}
+
+void EventLog::stop() {
+    if (isThreadRunning()) {
+        stopThread();
+        waitForThread(false);
+    }
+    drain(); // (what was logged after the last pass)
+    if (file) {
+        fclose(file);
+        file=NULL;
+    }
+}
+
+void EventLog::setStateName(int state, string name) {
+    if (state>=0 && state<4) stateNames[state]=name;
+}
+
+string EventLog::getStateName(int state) const {
+    return (state>=0 && state<4) ? stateNames[state] : ofToString(state);
+}
+
+// ---- Frame thread ----
+
+void EventLog::push(unsigned short type, unsigned short code, int a, int b, float v0, float v1, float v2) {
+    if (ring.empty()) return;
+    if (head-tail>=ring.size()) { // full: drop (never wait for the drain thread)
+        dropped++;
+        return;
+    }
+    LogEvent& event=ring[head%ring.size()];
+    event.micros=ofGetElapsedTimeMicros();
+    event.frame=currentFrame;
+    event.type=type;
+    event.code=code;
+    event.a=a;
+    event.b=b;
+    event.values[0]=v0;
+    event.values[1]=v1;
+    event.values[2]=v2;
+    __sync_synchronize(); // (the event is complete before it is published)
+    head++;
+}
+
+void EventLog::message(LogMessage message, float value, float value2) {
+    push(LOG_MESSAGE, message, 0, 0, value, value2);
+}
+
+void EventLog::state(int state, int previous) {
+    push(LOG_STATE, 0, state, previous);
+}
+
+void EventLog::boardAccepted(LogDevice device, int boards) {
+    push(LOG_BOARD_ACCEPTED, device, boards);
+}
+
+void EventLog::boardRejected(LogRejectReason reason) {
+    push(LOG_BOARD_REJECTED, reason);
+}
+
+void EventLog::reprojectionError(LogDevice device, float error, int boards) {
+    push(LOG_REPROJECTION_ERROR, device, boards, 0, error);
+}
+
+void EventLog::stageTiming(ProfilerStage stage, int state, const LatencyHistogram& histogram) {
+    push(LOG_STAGE_TIMING, stage, state, histogram.getCount(), histogram.getMean()/1000, histogram.getPercentile(0.99)/1000, histogram.getMax()/1000.0);
+}
+
+// ---- Drain thread ----
+
+void EventLog::threadedFunction() {
+    while (isThreadRunning()) {
+        drain();
+        ofSleepMillis(20);
+    }
+}
+
+void EventLog::drain() {
+    bool wrote=false;
+    while (tail!=head) {
+        __sync_synchronize();
+        LogEvent event=ring[tail%ring.size()];
+        __sync_synchronize(); // (copied before the slot is given back)
+        tail++;
+        write(event);
+        wrote=true;
+    }
+    if (wrote && file) fflush(file);
+}
+
+void EventLog::write(const LogEvent& event) {
+    char line[256];
+    int n=snprintf(line, sizeof(line), "{\"t\":%.6f,\"frame\":%u,\"type\":\"%s\"", event.micros/1000000.0, event.frame, eventTypeNames[event.type]);
+    string text; // (console)
+    switch (event.type) {
+        case LOG_MESSAGE:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"message\":\"%s\",\"value\":%g,\"value2\":%g", messageNames[event.code], event.values[0], event.values[1]);
+            text=string(messageNames[event.code])+" "+ofToString(event.values[0]);
+            break;
+        case LOG_STATE:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"state\":\"%s\",\"previous\":\"%s\"", getStateName(event.a).c_str(), getStateName(event.b).c_str());
+            text=" ****** "+getStateName(event.a)+" ********** ";
+            break;
+        case LOG_BOARD_ACCEPTED:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"device\":\"%s\",\"boards\":%d", deviceNames[event.code], event.a);
+            text="Board accepted ("+string(deviceNames[event.code])+", "+ofToString(event.a)+" boards)";
+            break;
+        case LOG_BOARD_REJECTED:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"reason\":\"%s\"", rejectReasonNames[event.code]);
+            text="Board rejected: "+string(rejectReasonHints[event.code]);
+            break;
+        case LOG_REPROJECTION_ERROR:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"device\":\"%s\",\"error\":%g,\"boards\":%d", deviceNames[event.code], event.values[0], event.a);
+            text="Reproj error "+string(deviceNames[event.code])+": "+ofToString(event.values[0])+" from "+ofToString(event.a);
+            break;
+        case LOG_STAGE_TIMING:
+            n+=snprintf(line+n, sizeof(line)-n, ",\"stage\":\"%s\",\"state\":\"%s\",\"count\":%d,\"mean_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f",
+                        StageProfiler::getStageName((ProfilerStage)event.code).c_str(), getStateName(event.a).c_str(), event.b,
+                        event.values[0], event.values[1], event.values[2]);
+            break; // (not echoed: see the profiler overlay)
+    }
+    if (file) fprintf(file, "%s}\n", line);
+    if (echo && !text.empty()) cout << text << endl;
+}
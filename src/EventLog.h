@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ofMain.h"
+#include "StageProfiler.h"
+
+// ==================================================================
+// Structured event log, replacing the cout calls of the frame thread (on the kiosks stdout goes to a slow pipe, and
+// the synchronous writes added jitter to every PHASE1/PHASE2 frame).
+// The frame thread only copies a small POD event (type, code, frame number, a few values) into a preallocated ring:
+// no formatting, no allocation, no lock, and it never waits (if the ring is full the event is dropped and counted).
+// A background thread drains the ring to a JSON lines file (one object per event, e.g.
+//      {"t":12.503211,"frame":377,"type":"board_rejected","reason":"projected_not_visible"}
+// ) and, optionally, echoes a readable line on the console.
+// Single producer: only the frame thread (update/draw) logs.
+// ==================================================================
+
+enum LogEventType {
+    LOG_MESSAGE,            // code: LogMessage, values[0]: optional value
+    LOG_STATE,              // a: new state, b: previous state
+    LOG_BOARD_ACCEPTED,     // code: LogDevice, a: number of boards
+    LOG_BOARD_REJECTED,     // code: LogRejectReason
+    LOG_REPROJECTION_ERROR, // code: LogDevice, a: number of boards, values[0]: RMS error (pixels)
+    LOG_STAGE_TIMING,       // code: ProfilerStage, a: state, b: count, values: mean, p99, max (ms)
+    NUM_LOG_EVENT_TYPES
+};
+
+enum LogDevice {LOG_CAMERA, LOG_PROJECTOR, LOG_STEREO};
+
+enum LogRejectReason {
+    REJECT_PRINTED_NOT_VISIBLE,
+    REJECT_PROJECTED_NOT_VISIBLE,
+    REJECT_BOARD_MOVED,
+    REJECT_NOT_ENOUGH_POINTS,
+    REJECT_CAMERA_NOT_CALIBRATED,
+    REJECT_REDUNDANT,             // no new image cells and pose close to an accepted board (see CoverageMap)
+    NUM_REJECT_REASONS
+};
+
+enum LogMessage {
+    MSG_DYNAMIC_PATTERN,          // PHASE1 with the projected pattern following the printed one
+    MSG_FIXED_PATTERN,            // PHASE1 with the fixed projected pattern
+    MSG_PRINTED_DETECTED,
+    MSG_PROJECTED_DETECTED,
+    MSG_CAMERA_POSE_ONLY,         // values[0]: error of the new board
+    MSG_CAMERA_RECALIBRATED,
+    MSG_PROJECTOR_SOLVING,        // board lists submitted to the solver
+    MSG_PROJECTOR_SOLVED,         // values[0]: solve time (s)
+    MSG_STRUCTURED_LIGHT_STARTED, // values[0]: number of patterns
+    MSG_STRUCTURED_LIGHT_DECODED, // values[0]: projector points, values[1]: grid points
+    MSG_SESSION_RESUMED,          // values[0]: camera boards, values[1]: projector boards
+    NUM_LOG_MESSAGES
+};
+
+struct LogEvent {
+    unsigned long long micros; // ofGetElapsedTimeMicros
+    unsigned int frame;
+    unsigned short type, code;
+    int a, b;
+    float values[3];
+};
+
+class EventLog : public ofThread {
+public:
+    EventLog();
+    ~EventLog();
+
+    // The file is written in the data folder; capacity: events buffered between two drains.
+    void setup(string filename, int capacity = 4096, bool echo = true);
+    void stop();
+    void setStateName(int state, string name);
+
+    // Frame thread:
+    void setFrame(unsigned int frame) {currentFrame=frame;}
+    void message(LogMessage message, float value = 0, float value2 = 0);
+    void state(int state, int previous);
+    void boardAccepted(LogDevice device, int boards);
+    void boardRejected(LogRejectReason reason);
+    void reprojectionError(LogDevice device, float error, int boards);
+    void stageTiming(ProfilerStage stage, int state, const LatencyHistogram& histogram);
+
+    unsigned int getDropped() const {return dropped;}
+
+protected:
+    void push(unsigned short type, unsigned short code, int a = 0, int b = 0, float v0 = 0, float v1 = 0, float v2 = 0);
+    void threadedFunction();
+    void drain();
+    void write(const LogEvent& event);
+    string getStateName(int state) const;
+
+    vector<LogEvent> ring;
+    volatile unsigned int head, tail; // head: written by the frame thread, tail: by the drain thread
+    unsigned int currentFrame;
+    volatile unsigned int dropped;
+
+    FILE* file;
+    bool echo;
+    string stateNames[4];
+};
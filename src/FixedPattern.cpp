@@ -0,0 +1,73 @@
+#include "FixedPattern.h"
+
+using namespace cv;
+
+// ---- RigidPose ----
+
+RigidPose RigidPose::fromRodrigues(const Mat& rotation, const Mat& translation) {
+    double r[3], t[3];
+    readValues(rotation, r, 3);
+    readValues(translation, t, 3);
+    return RigidPose(rotationFromVector(r), Vec3d(t[0], t[1], t[2]));
+}
+
+Matx33d RigidPose::rotationFromVector(const double r[3]) {
+    double theta=sqrt(r[0]*r[0]+r[1]*r[1]+r[2]*r[2]);
+    if (theta<1e-12) return Matx33d::eye();
+    double x=r[0]/theta, y=r[1]/theta, z=r[2]/theta;
+    double c=cos(theta), s=sin(theta), c1=1-c;
+    // R = cos I + (1-cos) k k^T + sin [k]x
+    return Matx33d(c+c1*x*x,   c1*x*y-s*z, c1*x*z+s*y,
+                   c1*x*y+s*z, c+c1*y*y,   c1*y*z-s*x,
+                   c1*x*z-s*y, c1*y*z+s*x, c+c1*z*z);
+}
+
+void RigidPose::vectorFromRotation(const Matx33d& R, double r[3]) {
+    // Axis from the antisymmetric part, angle from the trace:
+    double x=R(2, 1)-R(1, 2), y=R(0, 2)-R(2, 0), z=R(1, 0)-R(0, 1);
+    double s=sqrt(x*x+y*y+z*z)/2, c=(R(0, 0)+R(1, 1)+R(2, 2)-1)/2;
+    double theta=atan2(s, MAX(MIN(c, 1.0), -1.0));
+    if (s<1e-6 && c<0) {
+        // (close to pi: the antisymmetric part vanishes, use the diagonal)
+        Mat vector;
+        Rodrigues(Mat(R), vector);
+        for (int i=0; i<3; i++) r[i]=vector.at<double>(i);
+        return;
+    }
+    double scale=(s<1e-12 ? 0.5 : theta/(2*s)); // (theta/sin(theta) -> 1 for small angles)
+    r[0]=x*scale; r[1]=y*scale; r[2]=z*scale;
+}
+
+void RigidPose::readValues(const Mat& m, double* values, int n) {
+    int count=m.total()*m.channels();
+    if (m.isContinuous() && m.depth()==CV_64F) {
+        const double* data=(const double*)m.data;
+        for (int i=0; i<n; i++) values[i]=(i<count ? data[i] : 0);
+    } else if (m.isContinuous() && m.depth()==CV_32F) {
+        const float* data=(const float*)m.data;
+        for (int i=0; i<n; i++) values[i]=(i<count ? data[i] : 0);
+    } else {
+        // (other types: slow path)
+        Mat m64;
+        m.convertTo(m64, CV_64F);
+        m64=m64.reshape(1, m64.total());
+        for (int i=0; i<n; i++) values[i]=(i<m64.total() ? m64.at<double>(i) : 0);
+    }
+}
+
+// ---- Pattern layouts ----
+
+void DynamicPattern::setup(const vector<Point3f>& canonical) {
+    int size=patternSize.width*patternSize.height;
+    coefficients.resize(size);
+    objectPoints.resize(size);
+    imagePoints.resize(size);
+    for (int i=0; i<size; i++) {
+        coefficients[i]=(i<canonical.size() ? Point2f(canonical[i].x, canonical[i].y) : Point2f(0, 0));
+        objectPoints[i]=Point3f(coefficients[i].x, coefficients[i].y, 0);
+    }
+}
+
+void DynamicPattern::place(const Point3f& origin, const Point3f& axisX, const Point3f& axisY) {
+    for (int i=0; i<objectPoints.size(); i++) objectPoints[i]=origin+axisX*coefficients[i].x+axisY*coefficients[i].y;
+}
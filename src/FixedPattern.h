@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Fixed size pattern path for the projector pattern we actually use (4x5 asymmetric circle grid, see
+// settingsProjectionPatternPixels.yml). The pattern geometry is still read at run time, but when it matches the known
+// layout the per frame points live in inline arrays of a FixedPattern<W, H> (sizes known at compile time, no vector
+// allocated or resized per frame); any other layout falls back to DynamicPattern (vectors).
+// The two classes have the same members but no common base: the code using them is a template on the layout class
+// (see testApp::projectFollowingPattern), so place() and the point loops are inlined for the fixed sizes, and the
+// layout is chosen once per frame, not per call.
+// The layout is given once in "canonical" form (origin 0, axisX (1,0,0), axisY (0,1,0), e.g. the output of
+// Calibration::createObjectPointsDynamic), so placing the pattern on a board is just origin + x*axisX + y*axisY per
+// point, instead of rebuilding the points with createObjectPointsDynamic on every frame.
+// RigidPose is the matching pose math: closed form Rodrigues, composition and inversion on Matx (stack only), instead
+// of the Rodrigues/inv/composeRT chain on Mat (which allocates at each step).
+// ==================================================================
+
+struct RigidPose {
+    cv::Matx33d R;
+    cv::Vec3d t;
+
+    RigidPose() : R(cv::Matx33d::eye()), t(0, 0, 0) {}
+    RigidPose(const cv::Matx33d& R, const cv::Vec3d& t) : R(R), t(t) {}
+    // From a rotation vector and a translation (3 values each, CV_32F or CV_64F):
+    static RigidPose fromRodrigues(const cv::Mat& rotation, const cv::Mat& translation);
+    static cv::Matx33d rotationFromVector(const double r[3]);
+    static void vectorFromRotation(const cv::Matx33d& R, double r[3]); // (inverse of rotationFromVector)
+    // Copy the first n values of a (float or double) Mat into values, without allocation for continuous Mats:
+    static void readValues(const cv::Mat& m, double* values, int n);
+
+    RigidPose inverse() const {
+        cv::Matx33d Rt=R.t();
+        return RigidPose(Rt, -(Rt*t));
+    }
+    RigidPose operator*(const RigidPose& inner) const {return RigidPose(R*inner.R, R*inner.t+t);} // (this after inner)
+    cv::Point3f operator()(const cv::Point3f& p) const {
+        return cv::Point3f(R(0, 0)*p.x+R(0, 1)*p.y+R(0, 2)*p.z+t[0], R(1, 0)*p.x+R(1, 1)*p.y+R(1, 2)*p.z+t[1], R(2, 0)*p.x+R(2, 1)*p.y+R(2, 2)*p.z+t[2]);
+    }
+};
+
+// Layout interface (FixedPattern and DynamicPattern):
+//  setup(canonical): canonical layout (see above); its size must match the pattern size,
+//  place(origin, axisX, axisY): object points of the pattern placed on a board,
+//  size(), getObjectPoints(), getImagePoints() (output buffer for the projection of the object points).
+
+template<int W, int H>
+class FixedPattern {
+public:
+    enum {WIDTH=W, HEIGHT=H, SIZE=W*H};
+    static bool matches(cv::Size patternSize) {return patternSize.width==W && patternSize.height==H;}
+
+    void setup(const vector<cv::Point3f>& canonical) {
+        for (int i=0; i<SIZE; i++) {
+            coefficients[i]=(i<canonical.size() ? cv::Point2f(canonical[i].x, canonical[i].y) : cv::Point2f(0, 0));
+            objectPoints[i]=cv::Point3f(coefficients[i].x, coefficients[i].y, 0);
+        }
+    }
+    void place(const cv::Point3f& origin, const cv::Point3f& axisX, const cv::Point3f& axisY) {
+        for (int i=0; i<SIZE; i++) objectPoints[i]=origin+axisX*coefficients[i].x+axisY*coefficients[i].y;
+    }
+
+    int size() const {return SIZE;}
+    const cv::Point3f* getObjectPoints() const {return objectPoints;}
+    cv::Point2f* getImagePoints() {return imagePoints;}
+
+protected:
+    cv::Point2f coefficients[SIZE];
+    cv::Point3f objectPoints[SIZE];
+    cv::Point2f imagePoints[SIZE];
+};
+
+class DynamicPattern {
+public:
+    DynamicPattern(cv::Size patternSize) : patternSize(patternSize) {}
+
+    void setup(const vector<cv::Point3f>& canonical);
+    void place(const cv::Point3f& origin, const cv::Point3f& axisX, const cv::Point3f& axisY);
+
+    int size() const {return objectPoints.size();}
+    const cv::Point3f* getObjectPoints() const {return objectPoints.empty() ? NULL : &objectPoints[0];}
+    cv::Point2f* getImagePoints() {return imagePoints.empty() ? NULL : &imagePoints[0];}
+
+protected:
+    cv::Size patternSize;
+    vector<cv::Point2f> coefficients;
+    vector<cv::Point3f> objectPoints;
+    vector<cv::Point2f> imagePoints;
+};
@@ -0,0 +1,58 @@
+#include "FrameArena.h"
+
+FrameArena* FrameArena::active=NULL;
+// Block of the arena (read by operator delete, in any thread):
+static const char* arenaBegin=NULL;
+static const char* arenaEnd=NULL;
+
+FrameArena::FrameArena() {
+    block=NULL;
+    capacity=used=peak=0;
+    overflows=0;
+}
+
+FrameArena::~FrameArena() {
+    if (active==this) active=NULL;
+    if (arenaBegin==block) arenaBegin=arenaEnd=NULL;
+    free(block);
+}
+
+void FrameArena::setup(size_t capacity) {
+    reset();
+    if (arenaBegin==block) arenaBegin=arenaEnd=NULL;
+    free(block);
+    block=(char*)malloc(capacity);
+    this->capacity=(block ? capacity : 0);
+    arenaBegin=block;
+    arenaEnd=block+this->capacity;
+    peak=0;
+    overflows=0;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    size_t start=(used+alignment-1)&~(alignment-1);
+    if (!block || start+bytes>capacity) {
+        overflows++;
+        return NULL;
+    }
+    used=start+bytes;
+    peak=MAX(peak, used);
+    return block+start;
+}
+
+void FrameArena::reset() {
+    used=0;
+}
+
+bool FrameArena::owns(const void* p) {
+    return p>=arenaBegin && p<arenaEnd;
+}
+
+FrameArenaScope::FrameArenaScope(FrameArena* arena) {
+    previous=FrameArena::active;
+    if (arena) FrameArena::active=arena;
+}
+
+FrameArenaScope::~FrameArenaScope() {
+    FrameArena::active=previous;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ofMain.h"
+
+// ==================================================================
+// Per frame scratch memory: a bump allocator on a block allocated once, reset at the frame boundary (all the
+// allocations of a frame are released at once, nothing is freed individually), so the steady state frames don't go
+// through malloc (allocator jitter used to show up as dropped projector frames).
+// Most of the temporaries of a frame are made inside OpenCV (pyramids and work buffers of calcOpticalFlowPyrLK,
+// findHomography...), so they can't be given an allocator: instead, inside a FrameArenaScope, the operator new of the
+// counted thread (see AllocationCounter) takes its memory from the arena, and operator delete ignores arena pointers.
+// This is only correct for calls whose allocations are ALL temporaries of the call: their outputs must already have
+// their capacity before the scope, and the first call (one time initializations) must be made outside of it.
+// If the block is full, the allocation goes to the heap (counted as a heap allocation, and in getOverflows(): the
+// block is too small, see setup).
+// Main thread only (no locking), and one arena per program (operator delete only knows the block of the last setup).
+// ==================================================================
+
+class FrameArena {
+public:
+    FrameArena();
+    ~FrameArena();
+
+    void setup(size_t capacity);
+    void* allocate(size_t bytes, size_t alignment = 16); // NULL if the block is full
+    void reset(); // frame boundary: everything allocated since the last reset is released
+
+    // True if p was allocated by an arena (any thread can ask, this only reads the block bounds):
+    static bool owns(const void* p);
+    // Arena of the current scope of the counted thread (NULL: heap):
+    static FrameArena* getActive() {return active;}
+
+    size_t getUsed() const {return used;}
+    size_t getPeak() const {return peak;}
+    size_t getCapacity() const {return capacity;}
+    int getOverflows() const {return overflows;}
+
+protected:
+    friend class FrameArenaScope;
+    static FrameArena* active;
+
+    char* block;
+    size_t capacity, used, peak;
+    int overflows;
+};
+
+// The operator new of the counted thread allocates from the arena until the end of the scope (NULL arena: no effect).
+class FrameArenaScope {
+public:
+    FrameArenaScope(FrameArena* arena);
+    ~FrameArenaScope();
+
+protected:
+    FrameArena* previous;
+};
@@ -0,0 +1,28 @@
+#include "FramePreprocessor.h"
+
+using namespace cv;
+
+FramePreprocessor::FramePreprocessor() {
+    current=0;
+    levels=2;
+    frameNumber=0;
+}
+
+void FramePreprocessor::setup(int pyramidLevels) {
+    levels=MAX(pyramidLevels, 0);
+    for (int i=0; i<2; i++) pyramids[i].resize(levels+1);
+}
+
+void FramePreprocessor::process(const Mat& frame) {
+    if (pyramids[0].empty()) setup(levels);
+    current=1-current;
+    frameNumber++;
+
+    // (the buffers are reused: no allocation once the size is known)
+    vector<Mat>& pyramid=pyramids[current];
+    if (frame.channels()==3) cvtColor(frame, pyramid[0], CV_RGB2GRAY);
+    else if (frame.channels()==4) cvtColor(frame, pyramid[0], CV_RGBA2GRAY);
+    else frame.copyTo(pyramid[0]);
+
+    for (int i=1; i<pyramid.size(); i++) pyrDown(pyramid[i-1], pyramid[i]);
+}
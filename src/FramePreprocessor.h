@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Preprocessing shared by all the consumers of a frame: grayscale conversion and gray pyramid are computed ONCE per
+// frame, and the consumers (fast board test, corner tracking, projected dot detection...) get views (Mat headers, no
+// copy) of these images.
+// The buffers are double-buffered (ping-pong), so the gray image of the PREVIOUS frame is still valid during the
+// current frame (optical flow).
+// ==================================================================
+
+class FramePreprocessor {
+public:
+    FramePreprocessor();
+
+    void setup(int pyramidLevels = 2);
+    void process(const cv::Mat& frame);
+
+    const cv::Mat& getGray() const {return pyramids[current][0];}
+    const cv::Mat& getPreviousGray() const {return pyramids[1-current][0];}
+    const cv::Mat& getLevel(int level) const {return pyramids[current][MIN(level, (int)pyramids[current].size()-1)];} // level 0: full resolution
+    int getFrameNumber() const {return frameNumber;}
+
+protected:
+    vector<cv::Mat> pyramids[2];
+    int current;
+    int levels;
+    int frameNumber;
+};
@@ -0,0 +1,126 @@
+#include "FrameRing.h"
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+using namespace cv;
+
+FrameRing::FrameRing() {
+    writeIndex=0;
+    pushed=0;
+    reading=-1;
+    lastSequence=0;
+    dropped=0;
+}
+
+void FrameRing::setup(int width, int height, int type, int numSlots) {
+    // (at least 3 slots: one being read, one being written, one ready)
+    slots.resize(MAX(numSlots, 3));
+    for (int i=0; i<slots.size(); i++) slots[i].image.create(height, width, type);
+    reset();
+}
+
+void FrameRing::reset() {
+    for (int i=0; i<slots.size(); i++) {
+        slots[i].sequence=0;
+        slots[i].captureMicros=0;
+    }
+    writeIndex=0;
+    pushed=0;
+    reading=-1;
+    lastSequence=0;
+    dropped=0;
+}
+
+unsigned long long FrameRing::nowMicros() {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom==0) mach_timebase_info(&timebase);
+    return mach_absolute_time()*timebase.numer/timebase.denom/1000;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec*1000000+now.tv_nsec/1000;
+#endif
+}
+
+// Producer: next slot that the consumer is NOT reading, invalidated before writing.
+int FrameRing::beginWrite(unsigned int& previousSequence) {
+    int n=slots.size();
+    int index=(writeIndex+1)%n;
+    while (true) {
+        previousSequence=slots[index].sequence;
+        slots[index].sequence=0;
+        __sync_synchronize();
+        if (reading!=index) return index;
+        // The consumer holds this one: give it back and take the next one (the consumer holds only one slot).
+        slots[index].sequence=previousSequence;
+        index=(index+1)%n;
+    }
+}
+
+void FrameRing::endWrite(int index, unsigned long long captureMicros) {
+    slots[index].captureMicros=captureMicros;
+    __sync_synchronize(); // (image and timestamp written before the sequence number)
+    slots[index].sequence=pushed+1;
+    pushed++;
+    writeIndex=index;
+}
+
+void FrameRing::push(const Mat& frame, unsigned long long captureMicros) {
+    if (slots.empty()) return;
+    unsigned int previousSequence;
+    int index=beginWrite(previousSequence);
+    frame.copyTo(slots[index].image); // (same size and type: no allocation)
+    endWrite(index, captureMicros);
+}
+
+void FrameRing::push(const unsigned char* pixels, unsigned long long captureMicros) {
+    if (slots.empty()) return;
+    unsigned int previousSequence;
+    int index=beginWrite(previousSequence);
+    Mat& image=slots[index].image;
+    memcpy(image.data, pixels, image.total()*image.elemSize());
+    endWrite(index, captureMicros);
+}
+
+bool FrameRing::acquire(CapturedFrame& frame, FramePolicy policy) {
+    while (true) {
+        // Choose the slot (newest, or oldest not yet read, frame):
+        int chosen=-1;
+        unsigned int chosenSequence=0;
+        for (int i=0; i<slots.size(); i++) {
+            unsigned int sequence=slots[i].sequence;
+            if (sequence<=lastSequence) continue;
+            if (chosen<0 || (policy==FRAME_LATEST ? sequence>chosenSequence : sequence<chosenSequence)) {
+                chosen=i;
+                chosenSequence=sequence;
+            }
+        }
+        if (chosen<0) return false;
+
+        // Claim it, and check that the producer did not start overwriting it in the meantime:
+        reading=chosen;
+        __sync_synchronize();
+        if (slots[chosen].sequence!=chosenSequence) {
+            reading=-1;
+            continue;
+        }
+
+        frame.image=slots[chosen].image;
+        frame.sequence=chosenSequence;
+        frame.captureMicros=slots[chosen].captureMicros;
+        frame.dropped=chosenSequence-lastSequence-1;
+        dropped+=frame.dropped;
+        lastSequence=chosenSequence;
+        return true;
+    }
+}
+
+void FrameRing::release() {
+    __sync_synchronize();
+    reading=-1;
+}
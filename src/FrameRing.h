@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Fixed size ring of preallocated frames, written by ONE producer (the capture thread) and read by ONE consumer (the
+// processing loop), without locks:
+// - the producer NEVER waits: when the ring is full it overwrites the oldest frame (the consumer sees the drop),
+//   except the slot the consumer is currently reading,
+// - each slot carries a sequence number (0 while being written) and the capture timestamp,
+// - the consumer chooses the policy: FRAME_LATEST (newest frame, skip the others: AR_DEMO) or FRAME_EVERY (oldest not
+//   yet read frame: recording, replay...).
+// The slot being read is announced by the consumer (reading), and checked by the producer after invalidating the slot
+// it is about to write (full barriers on both sides, so at least one of them sees the other).
+// ==================================================================
+
+enum FramePolicy {FRAME_LATEST, FRAME_EVERY};
+
+struct CapturedFrame {
+    cv::Mat image;                  // header on the ring slot: valid until release()
+    unsigned int sequence;          // 1, 2, 3... (capture order)
+    unsigned long long captureMicros; // monotonic clock (see FrameRing::nowMicros)
+    int dropped;                    // frames skipped since the previous acquired one
+};
+
+class FrameRing {
+public:
+    FrameRing();
+
+    void setup(int width, int height, int type = CV_8UC3, int numSlots = 4);
+    void reset();
+
+    // Producer: write the new frame in the next free slot (copy), never blocks.
+    void push(const cv::Mat& frame, unsigned long long captureMicros);
+    void push(const unsigned char* pixels, unsigned long long captureMicros); // (same size and type as setup)
+
+    // Consumer: false if there is no new frame. The frame must be released before the next acquire.
+    bool acquire(CapturedFrame& frame, FramePolicy policy);
+    void release();
+
+    unsigned int getPushed() const {return pushed;}
+    unsigned int getDropped() const {return dropped;}
+
+    // Monotonic clock (microseconds) used for the capture timestamps:
+    static unsigned long long nowMicros();
+
+protected:
+    struct Slot {
+        cv::Mat image;
+        volatile unsigned int sequence; // 0: being written (or never written)
+        unsigned long long captureMicros;
+    };
+
+    int beginWrite(unsigned int& previousSequence);
+    void endWrite(int index, unsigned long long captureMicros);
+
+    vector<Slot> slots;
+    int writeIndex;
+    volatile unsigned int pushed;
+    volatile int reading; // slot index read by the consumer, -1 if none
+    unsigned int lastSequence; // (consumer) last acquired frame
+    unsigned int dropped;
+};
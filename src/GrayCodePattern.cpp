@@ -0,0 +1,182 @@
+#include "GrayCodePattern.h"
+
+using namespace cv;
+
+static int numBits(int size) {
+    int bits=0;
+    while ((1<<bits)<size) bits++;
+    return bits;
+}
+
+// Decode a range of camera rows (one row per index):
+class GrayCodeDecodeTask : public ParallelTask {
+public:
+    GrayCodeDecodeTask(const GrayCodePattern& pattern, const vector<Mat>& frames, Mat& projectorX, Mat& projectorY, Mat& mask)
+    : pattern(pattern), frames(frames), projectorX(projectorX), projectorY(projectorY), mask(mask) {}
+
+    void run(int begin, int end) {
+        int numFrames=frames.size();
+        vector<const uchar*> rows(numFrames);
+        for (int y=begin; y<end; y++) {
+            for (int f=0; f<numFrames; f++) rows[f]=frames[f].ptr<uchar>(y);
+            unsigned short* outX=projectorX.ptr<unsigned short>(y);
+            unsigned short* outY=projectorY.ptr<unsigned short>(y);
+            uchar* outMask=mask.ptr<uchar>(y);
+            const uchar* white=rows[0];
+            const uchar* black=rows[1];
+            for (int x=0; x<projectorX.cols; x++) {
+                outMask[x]=0;
+                outX[x]=outY[x]=0;
+                if (white[x]-black[x]<pattern.minContrast) continue;
+                int codeX, codeY;
+                if (!decodeBits(rows, 2, pattern.bitsX, x, codeX)) continue;
+                if (!decodeBits(rows, 2+2*pattern.bitsX, pattern.bitsY, x, codeY)) continue;
+                codeX=grayToBinary(codeX);
+                codeY=grayToBinary(codeY);
+                if (codeX>=pattern.projectorWidth || codeY>=pattern.projectorHeight) continue;
+                outX[x]=codeX;
+                outY[x]=codeY;
+                outMask[x]=255;
+            }
+        }
+    }
+
+    // Bits (most significant first), each pattern followed by its inverse:
+    bool decodeBits(const vector<const uchar*>& rows, int first, int bits, int x, int& code) {
+        code=0;
+        for (int b=0; b<bits; b++) {
+            int positive=rows[first+2*b][x], negative=rows[first+2*b+1][x];
+            if (abs(positive-negative)<pattern.minBitContrast) return false;
+            code=(code<<1)|(positive>negative ? 1 : 0);
+        }
+        return true;
+    }
+    static int grayToBinary(int code) {
+        for (int shift=1; shift<16; shift<<=1) code^=code>>shift;
+        return code;
+    }
+
+    const GrayCodePattern& pattern;
+    const vector<Mat>& frames;
+    Mat& projectorX;
+    Mat& projectorY;
+    Mat& mask;
+};
+
+// One local homography per camera point:
+class LocalHomographyTask : public ParallelTask {
+public:
+    LocalHomographyTask(const GrayCodePattern& pattern, const vector<Point2f>& cameraPoints, vector<Point2f>& projectorPoints, vector<uchar>& status)
+    : pattern(pattern), cameraPoints(cameraPoints), projectorPoints(projectorPoints), status(status) {}
+
+    void run(int begin, int end) {
+        vector<Point2f> camera, projector;
+        const Mat& mask=pattern.decodedMask;
+        int radius=pattern.windowRadius;
+        for (int i=begin; i<end; i++) {
+            status[i]=0;
+            const Point2f& c=cameraPoints[i];
+            int x0=MAX(cvRound(c.x)-radius, 0), x1=MIN(cvRound(c.x)+radius, mask.cols-1);
+            int y0=MAX(cvRound(c.y)-radius, 0), y1=MIN(cvRound(c.y)+radius, mask.rows-1);
+            camera.clear();
+            projector.clear();
+            for (int y=y0; y<=y1; y++) {
+                const uchar* m=mask.ptr<uchar>(y);
+                const unsigned short* px=pattern.decodedX.ptr<unsigned short>(y);
+                const unsigned short* py=pattern.decodedY.ptr<unsigned short>(y);
+                for (int x=x0; x<=x1; x++) {
+                    if (!m[x]) continue;
+                    camera.push_back(Point2f(x, y));
+                    projector.push_back(Point2f(px[x], py[x]));
+                }
+            }
+            // At least half of the window must be decoded:
+            if (camera.size()<2*radius*radius) continue;
+            Mat H=findHomography(Mat(camera), Mat(projector), 0);
+            if (H.empty()) continue;
+            double w=H.at<double>(2, 0)*c.x+H.at<double>(2, 1)*c.y+H.at<double>(2, 2);
+            if (fabs(w)<1e-12) continue;
+            projectorPoints[i]=Point2f((H.at<double>(0, 0)*c.x+H.at<double>(0, 1)*c.y+H.at<double>(0, 2))/w,
+                                       (H.at<double>(1, 0)*c.x+H.at<double>(1, 1)*c.y+H.at<double>(1, 2))/w);
+            status[i]=1;
+        }
+    }
+
+    const GrayCodePattern& pattern;
+    const vector<Point2f>& cameraPoints;
+    vector<Point2f>& projectorPoints;
+    vector<uchar>& status;
+};
+
+GrayCodePattern::GrayCodePattern() {
+    projectorWidth=projectorHeight=0;
+    bitsX=bitsY=0;
+    minContrast=40;
+    minBitContrast=10;
+    windowRadius=15;
+}
+
+void GrayCodePattern::setup(int projectorWidth, int projectorHeight) {
+    this->projectorWidth=projectorWidth;
+    this->projectorHeight=projectorHeight;
+    bitsX=numBits(projectorWidth);
+    bitsY=numBits(projectorHeight);
+}
+
+void GrayCodePattern::generate(int index, Mat& pattern) const {
+    pattern.create(projectorHeight, projectorWidth, CV_8UC1);
+    if (index<=0) {
+        pattern.setTo(255);
+        return;
+    }
+    if (index==1) {
+        pattern.setTo(0);
+        return;
+    }
+    int bit=(index-2)/2;
+    bool inverse=(index-2)%2==1;
+    bool columns=bit<bitsX;
+    if (!columns) bit-=bitsX;
+    int shift=(columns ? bitsX : bitsY)-1-bit;
+    uchar on=inverse ? 0 : 255, off=inverse ? 255 : 0;
+
+    if (columns) {
+        // One row, copied to all the rows:
+        uchar* row=pattern.ptr<uchar>(0);
+        for (int x=0; x<projectorWidth; x++) row[x]=(((x^(x>>1))>>shift)&1) ? on : off;
+        for (int y=1; y<projectorHeight; y++) memcpy(pattern.ptr<uchar>(y), row, projectorWidth);
+    } else {
+        for (int y=0; y<projectorHeight; y++) memset(pattern.ptr<uchar>(y), (((y^(y>>1))>>shift)&1) ? on : off, projectorWidth);
+    }
+}
+
+bool GrayCodePattern::decode(const vector<Mat>& frames, Mat& projectorX, Mat& projectorY, Mat& mask) {
+    if (frames.size()!=getNumPatterns() || frames[0].empty()) return false;
+    for (int i=0; i<frames.size(); i++) {
+        if (frames[i].size()!=frames[0].size() || frames[i].type()!=CV_8UC1) return false;
+    }
+    projectorX.create(frames[0].size(), CV_16UC1);
+    projectorY.create(frames[0].size(), CV_16UC1);
+    mask.create(frames[0].size(), CV_8UC1);
+
+    GrayCodeDecodeTask task(*this, frames, projectorX, projectorY, mask);
+    TaskPool::shared().parallelFor(task, frames[0].rows, 8);
+
+    decodedX=projectorX;
+    decodedY=projectorY;
+    decodedMask=mask;
+    return true;
+}
+
+int GrayCodePattern::projectorPoints(const vector<Point2f>& cameraPoints, vector<Point2f>& projectorPoints, vector<uchar>& status) {
+    projectorPoints.assign(cameraPoints.size(), Point2f(0, 0));
+    status.assign(cameraPoints.size(), 0);
+    if (decodedMask.empty() || cameraPoints.empty()) return 0;
+
+    LocalHomographyTask task(*this, cameraPoints, projectorPoints, status);
+    TaskPool::shared().parallelFor(task, cameraPoints.size(), 8);
+
+    int found=0;
+    for (int i=0; i<status.size(); i++) found+=status[i];
+    return found;
+}
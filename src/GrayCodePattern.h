@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+
+// ==================================================================
+// Structured light (Gray code) correspondences between camera and projector pixels, for a DENSE projector calibration
+// (instead of the few dots of the projected circle grid):
+//
+// (1) Patterns: full white, full black, then for each bit of the projector column (then row) number, the Gray code
+//     stripes and their inverse (2+2*(bitsX+bitsY) images, i.e. 42 images for 800x600).
+// (2) decode(): for each camera pixel, the projector column and row (bits compared with their inverse, so no global
+//     threshold is needed; the pixels with low contrast are masked). The rows are decoded in parallel (TaskPool), with
+//     plain loops over the row pointers.
+// (3) projectorPoints(): projector position of arbitrary camera points (e.g. points of the printed board), each one
+//     through a LOCAL homography fitted on the decoded pixels around it (robust to the projector lens distortion, and
+//     sub-pixel even if the decoding is integer).
+// Any set of images can be decoded (e.g. synthetic ones, see generate()).
+// ==================================================================
+
+class GrayCodePattern {
+public:
+    GrayCodePattern();
+
+    void setup(int projectorWidth, int projectorHeight);
+    int getNumPatterns() const {return 2+2*(bitsX+bitsY);}
+
+    // Projector image of pattern index (CV_8UC1, projector size; allocated if needed):
+    void generate(int index, cv::Mat& pattern) const;
+
+    // frames: the captured images (gray CV_8UC1), in pattern order. Outputs: projector column and row (CV_16UC1) and
+    // mask (CV_8UC1, 255 where decoded).
+    bool decode(const vector<cv::Mat>& frames, cv::Mat& projectorX, cv::Mat& projectorY, cv::Mat& mask);
+
+    // Projector points of the camera points (status: 1 if found). Needs a previous decode().
+    int projectorPoints(const vector<cv::Point2f>& cameraPoints, vector<cv::Point2f>& projectorPoints, vector<uchar>& status);
+
+    void setMinContrast(int white, int bit) {minContrast=white; minBitContrast=bit;}
+    void setWindowRadius(int radius) {windowRadius=radius;}
+
+protected:
+    int projectorWidth, projectorHeight;
+    int bitsX, bitsY;
+    int minContrast, minBitContrast;
+    int windowRadius;
+
+    cv::Mat decodedX, decodedY, decodedMask; // (headers on the last decode outputs)
+
+    friend class GrayCodeDecodeTask;
+    friend class LocalHomographyTask;
+};
@@ -0,0 +1,80 @@
+#include "IncrementalCalibration.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+// Flags of the calibrateCamera of Calibration::calibrate() (ofxCv2, to be kept in sync with the addon): the warm start
+// only adds CV_CALIB_USE_INTRINSIC_GUESS, so it solves the same model as a cold calibration.
+static const int calibrateFlags = 0;
+const int IncrementalCalibration::warmStartFlags = calibrateFlags | CV_CALIB_USE_INTRINSIC_GUESS;
+
+IncrementalCalibration::IncrementalCalibration() {
+    refineEvery=5;
+    errorJump=2.0;
+    reset();
+}
+
+void IncrementalCalibration::setup(int refineEvery, float errorJump) {
+    this->refineEvery=MAX(refineEvery, 1);
+    this->errorJump=errorJump;
+    reset();
+}
+
+void IncrementalCalibration::reset() {
+    boardsSinceRefinement=0;
+    fullRefinements=0;
+    lastBoardError=0;
+}
+
+// RMS reprojection error of the candidate board, with its current pose and the current intrinsics:
+float IncrementalCalibration::candidateReprojectionError(Calibration& calibration) {
+    if (calibration.candidateObjectPoints.empty()) return 0;
+    vector<Point2f> projected;
+    projectPoints(Mat(calibration.candidateObjectPoints), calibration.candidateBoardRotation, calibration.candidateBoardTranslation,
+                  calibration.getDistortedIntrinsics().getCameraMatrix(), calibration.getDistCoeffs(), projected);
+    double squaredError=0;
+    for (int i=0; i<projected.size(); i++) {
+        Point2f d=projected[i]-calibration.candidateImagePoints[i];
+        squaredError+=d.dot(d);
+    }
+    return sqrt(squaredError/projected.size());
+}
+
+bool IncrementalCalibration::addBoard(Calibration& calibration, bool poseComputed) {
+    // Nothing to start from, or the pose list is not aligned with the boards (more than one new board):
+    if (!calibration.isReady() || calibration.boardRotations.size()+1!=calibration.size()) return true;
+    if (boardsSinceRefinement+1>=refineEvery) return true;
+
+    if (!poseComputed) calibration.computeCandidateBoardPose();
+    lastBoardError=candidateReprojectionError(calibration);
+    if (lastBoardError>errorJump*calibration.getReprojectionError()) return true;
+
+    calibration.addCandidateBoardPose();
+    boardsSinceRefinement++;
+    return false;
+}
+
+void IncrementalCalibration::refine(EditableCalibration& calibration) {
+    if (!calibration.isReady() || calibration.size()<2) {
+        calibration.calibrate();
+        return;
+    }
+    Mat cameraMatrix=calibration.getDistortedIntrinsics().getCameraMatrix().clone();
+    Mat distCoeffs=calibration.getDistCoeffs().clone();
+    cv::Size imageSize=calibration.getDistortedIntrinsics().getImageSize();
+    vector<Mat> rotations, translations;
+    calibrateCamera(calibration.objectPoints, calibration.imagePoints, imageSize, cameraMatrix, distCoeffs, rotations, translations,
+                    warmStartFlags);
+    // Same validity test as calibrate(); a diverged warm start is redone cold (by the addon, with all its post-processing):
+    if (!checkRange(cameraMatrix) || !checkRange(distCoeffs)) {
+        ofLogWarning() << "IncrementalCalibration: warm started calibration diverged, full calibration";
+        calibration.calibrate();
+        return;
+    }
+    calibration.setSolution(cameraMatrix, distCoeffs, imageSize, rotations, translations);
+}
+
+void IncrementalCalibration::fullRefinementDone() {
+    boardsSinceRefinement=0;
+    fullRefinements++;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "EditableCalibration.h"
+
+// ==================================================================
+// Incremental calibration policy: calibrate() re-solves the intrinsics and ALL the board poses, so calling it for every
+// new board makes a session quadratic in the number of boards. Instead, when a board is added to a calibrated object:
+// - only the pose of the new board is estimated (PnP with the current intrinsics) and appended to the board poses,
+// - a full refinement is requested every refineEvery boards, or when the reprojection error of the new board jumps
+//   above errorJump times the current total reprojection error (the intrinsics are probably not good anymore).
+//   refine() warm starts it: calibrateCamera with the flags of calibrate() plus CV_CALIB_USE_INTRINSIC_GUESS, from the
+//   current intrinsics (the first calibration, without intrinsics yet, and a diverged warm start are a plain calibrate()).
+// Note: cleaning uses the per board errors of the last calibrate(), so it must only be done after a full refinement.
+// ==================================================================
+
+class IncrementalCalibration {
+public:
+    IncrementalCalibration();
+
+    void setup(int refineEvery, float errorJump);
+    void reset();
+
+    // To be called right after adding the candidate image/object points to the board lists. Returns true if a full
+    // calibrate() must be done now; otherwise the new board pose has been computed and added. poseComputed: the candidate
+    // pose was already computed with the current intrinsics (coverage test), no second PnP.
+    bool addBoard(ofxCv::Calibration& calibration, bool poseComputed = false);
+    void fullRefinementDone();
+    // Full refinement (intrinsics + all the board poses), warm started from the current intrinsics:
+    static void refine(EditableCalibration& calibration);
+    static const int warmStartFlags; // calibrateCamera flags of refine()
+    bool hasPendingBoards() const {return boardsSinceRefinement>0;}
+
+    float getLastBoardError() const {return lastBoardError;}
+    int getFullRefinements() const {return fullRefinements;}
+
+    static float candidateReprojectionError(ofxCv::Calibration& calibration);
+
+protected:
+    int refineEvery;
+    float errorJump;
+    int boardsSinceRefinement, fullRefinements;
+    float lastBoardError;
+};
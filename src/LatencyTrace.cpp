@@ -0,0 +1,96 @@
+#include "LatencyTrace.h"
+#include "FrameRing.h"
+
+const int latencyHistorySize = 1024; // completed frames kept for dump()
+
+LatencyTrace::LatencyTrace() {
+    history.resize(latencyHistorySize);
+    reset();
+}
+
+void LatencyTrace::reset() {
+    active=false;
+    completed=0;
+    endToEnd.reset();
+    for (int i=0; i<NUM_LATENCY_MARKS; i++) segments[i].reset();
+}
+
+void LatencyTrace::beginFrame(unsigned int id, unsigned long long captureMicros) {
+    current.id=id;
+    for (int i=0; i<NUM_LATENCY_MARKS; i++) current.marks[i]=0;
+    current.marks[MARK_CAPTURE]=captureMicros;
+    current.marks[MARK_PROCESS]=FrameRing::nowMicros();
+    active=true;
+}
+
+void LatencyTrace::mark(LatencyMark mark) {
+    if (active && current.marks[mark]==0) current.marks[mark]=FrameRing::nowMicros();
+}
+
+void LatencyTrace::endFrame() {
+    if (!active) return;
+    if (current.marks[MARK_PROJECTED]==0) return; // (not projected yet: maybe in a later draw... or never)
+    current.marks[MARK_DRAWN]=FrameRing::nowMicros();
+    active=false; // (the next draws show the same frame: counted once)
+
+    endToEnd.add(current.marks[MARK_DRAWN]-current.marks[MARK_CAPTURE]);
+    unsigned long long previous=current.marks[MARK_CAPTURE];
+    for (int i=1; i<NUM_LATENCY_MARKS; i++) {
+        if (current.marks[i]==0) continue;
+        segments[i].add(current.marks[i]-previous);
+        previous=current.marks[i];
+    }
+    history[completed%history.size()]=current;
+    completed++;
+}
+
+string LatencyTrace::getMarkName(LatencyMark mark) {
+    switch (mark) {
+        case MARK_CAPTURE: return "capture";
+        case MARK_PROCESS: return "process";
+        case MARK_DETECTED: return "detected";
+        case MARK_POSE: return "pose";
+        case MARK_PROJECTED: return "projected";
+        case MARK_DRAWN: return "drawn";
+        default: return "?";
+    }
+}
+
+string LatencyTrace::getSummary() const {
+    char line[128];
+    snprintf(line, sizeof(line), "Capture to projector: p50 %.1f ms, p99 %.1f ms (%u frames)",
+             endToEnd.getPercentile(0.5)/1000.0, endToEnd.getPercentile(0.99)/1000.0, completed);
+    return line;
+}
+
+void LatencyTrace::dump(string filename, bool absolute) const {
+    ofstream file(ofToDataPath(filename, absolute).c_str());
+    file << "segment              count   mean ms    p50 ms    p99 ms    max ms" << endl;
+    for (int i=0; i<=NUM_LATENCY_MARKS; i++) {
+        const LatencyHistogram& h=(i<NUM_LATENCY_MARKS ? segments[i] : endToEnd);
+        if (h.getCount()==0) continue;
+        string name=(i<NUM_LATENCY_MARKS ? "-> "+getMarkName((LatencyMark)i) : "capture -> drawn");
+        char line[160];
+        snprintf(line, sizeof(line), "%-18s %7u %9.3f %9.3f %9.3f %9.3f", name.c_str(), h.getCount(),
+                 h.getMean()/1000.0, h.getPercentile(0.5)/1000.0, h.getPercentile(0.99)/1000.0, h.getMax()/1000.0);
+        file << line << endl;
+    }
+    file << endl << "frame";
+    for (int i=1; i<NUM_LATENCY_MARKS; i++) file << " " << getMarkName((LatencyMark)i);
+    file << " total (ms from the previous mark)" << endl;
+    unsigned int first=(completed>history.size() ? completed-history.size() : 0);
+    for (unsigned int n=first; n<completed; n++) {
+        const FrameTrace& trace=history[n%history.size()];
+        file << trace.id;
+        unsigned long long previous=trace.marks[MARK_CAPTURE];
+        for (int i=1; i<NUM_LATENCY_MARKS; i++) {
+            if (trace.marks[i]==0) file << " -";
+            else {
+                file << " " << (trace.marks[i]-previous)/1000.0;
+                previous=trace.marks[i];
+            }
+        }
+        file << " " << (trace.marks[MARK_DRAWN]-trace.marks[MARK_CAPTURE])/1000.0 << endl;
+    }
+    ofLogNotice() << "Latency trace saved to " << filename;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ofMain.h"
+#include "StageProfiler.h"
+
+// ==================================================================
+// End to end (motion to projection) latency of the frames: each captured frame keeps its capture sequence number and
+// timestamp (see FrameRing), and the frame thread marks its progress through the pipeline:
+//      capture -> processing starts -> pattern detected -> board pose -> projector points -> projector drawn
+// A frame is complete when the projector image computed from it has been drawn (the first draw after its processing;
+// frames that did not lead to a projection, e.g. board not visible, are not counted). For complete frames, the total
+// latency (capture -> drawn) and each segment go into LatencyHistograms; the last completed traces can be dumped
+// frame by frame. Note: "drawn" is the end of draw(), i.e. BEFORE the buffer swap and the projector's own latency:
+// the glass to glass part is measured by the loopback mode (see LoopbackLatency).
+// All the marks use the capture clock (FrameRing::nowMicros). Frame thread only.
+// ==================================================================
+
+enum LatencyMark {
+    MARK_CAPTURE,   // camera frame delivered (capture thread)
+    MARK_PROCESS,   // processFrame starts
+    MARK_DETECTED,  // printed pattern detected/tracked
+    MARK_POSE,      // board pose computed
+    MARK_PROJECTED, // projector image points computed from the pose
+    MARK_DRAWN,     // projector viewport drawn
+    NUM_LATENCY_MARKS
+};
+
+struct FrameTrace {
+    unsigned int id; // capture sequence number
+    unsigned long long marks[NUM_LATENCY_MARKS]; // 0: not reached
+};
+
+class LatencyTrace {
+public:
+    LatencyTrace();
+
+    void reset();
+    // Processing of a captured frame starts (id and timestamp of the capture):
+    void beginFrame(unsigned int id, unsigned long long captureMicros);
+    void mark(LatencyMark mark); // (current frame; the first mark of each kind is kept)
+    void endFrame(); // projector drawn: the current frame is complete (if it was projected)
+
+    const LatencyHistogram& getEndToEnd() const {return endToEnd;}
+    const LatencyHistogram& getSegment(LatencyMark mark) const {return segments[mark];} // previous reached mark -> mark
+    unsigned int getCompleted() const {return completed;}
+
+    string getSummary() const; // one line (median and p99 of the end to end latency), for the overlay
+    // Histograms, then the last completed frames (one line per frame: id, then each segment in ms):
+    void dump(string filename, bool absolute = false) const;
+
+    static string getMarkName(LatencyMark mark);
+
+protected:
+    FrameTrace current;
+    bool active;
+
+    LatencyHistogram endToEnd, segments[NUM_LATENCY_MARKS];
+    vector<FrameTrace> history; // ring of the last completed frames
+    unsigned int completed;
+};
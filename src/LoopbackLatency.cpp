@@ -0,0 +1,124 @@
+#include "LoopbackLatency.h"
+#include "FrameRing.h"
+
+using namespace cv;
+
+const int loopbackMinContrast = 40; // minimum gray difference between the white and black reference stripes
+const unsigned long long loopbackMaxLatency = 1000000; // (microseconds) older matches are a wrapped counter
+
+LoopbackLatency::LoopbackLatency() {
+    running=false;
+    setup();
+}
+
+void LoopbackLatency::setup(int bits, int settleFrames) {
+    this->bits=MAX(MIN(bits, 16), 2);
+    this->settleFrames=settleFrames;
+    numStripes=this->bits+2;
+    drawMicros.assign(1<<this->bits, 0);
+}
+
+void LoopbackLatency::start() {
+    running=true;
+    phase=LOCATE_WHITE;
+    waitFrames=0;
+    drawCounter=0;
+    drawMicros.assign(drawMicros.size(), 0);
+    lastDecoded=-1;
+    decodeErrors=0;
+    glassToGlass.reset();
+}
+
+void LoopbackLatency::draw(int width, int height) {
+    if (!running) return;
+    ofFill();
+    ofSetColor(0);
+    ofRect(0, 0, width, height);
+    ofSetColor(255);
+    if (phase==LOCATE_WHITE) {
+        ofRect(0, 0, width, height);
+        return;
+    }
+    if (phase==LOCATE_BLACK) return;
+
+    // Counter (Gray code, most significant bit first), after the white and black reference stripes:
+    unsigned int value=drawCounter&(drawMicros.size()-1);
+    unsigned int code=value^(value>>1);
+    float stripeWidth=(float)width/numStripes;
+    ofRect(0, 0, stripeWidth, height);
+    for (int i=0; i<bits; i++)
+        if (code&(1<<(bits-1-i))) ofRect((i+2)*stripeWidth, 0, stripeWidth, height);
+    drawMicros[value]=FrameRing::nowMicros();
+    drawCounter++;
+}
+
+bool LoopbackLatency::readStripe(const Mat& gray, int stripe, float& value) const {
+    // Middle of the stripe (a third of its width, a third of the height):
+    float stripeWidth=(float)region.width/numStripes;
+    Rect sample(region.x+(stripe+1.0/3)*stripeWidth, region.y+region.height/3, MAX(stripeWidth/3, 1.0f), MAX(region.height/3, 1));
+    sample&=Rect(0, 0, gray.cols, gray.rows);
+    if (sample.area()==0) return false;
+    value=mean(gray(sample))[0];
+    return true;
+}
+
+void LoopbackLatency::process(const Mat& gray, unsigned long long captureMicros) {
+    if (!running) return;
+    if (phase!=MEASURE) {
+        if (++waitFrames<settleFrames) return;
+        waitFrames=0;
+        if (phase==LOCATE_WHITE) {
+            gray.copyTo(whiteFrame);
+            phase=LOCATE_BLACK;
+        } else {
+            // Lit area: bounding box of the pixels much brighter with the white image
+            Mat lit=(whiteFrame-gray)>loopbackMinContrast;
+            vector<Point> points;
+            for (int y=0; y<lit.rows; y+=2) {
+                const uchar* row=lit.ptr<uchar>(y);
+                for (int x=0; x<lit.cols; x+=2) if (row[x]) points.push_back(Point(x, y));
+            }
+            if (points.size()<100) {
+                ofLogError() << "Loopback latency: the projected image is not visible by the camera";
+                running=false;
+                return;
+            }
+            region=boundingRect(Mat(points));
+            phase=MEASURE;
+        }
+        return;
+    }
+
+    float white, black;
+    if (!readStripe(gray, 0, white) || !readStripe(gray, 1, black) || white-black<loopbackMinContrast) {
+        decodeErrors++;
+        return;
+    }
+    float threshold=(white+black)/2;
+    unsigned int code=0;
+    for (int i=0; i<bits; i++) {
+        float v;
+        if (!readStripe(gray, i+2, v)) return;
+        code=(code<<1)|(v>threshold ? 1 : 0);
+    }
+    unsigned int value=code;
+    for (unsigned int shift=code>>1; shift; shift>>=1) value^=shift; // (Gray -> binary)
+
+    // First frame showing this value:
+    if ((int)value==lastDecoded) return;
+    lastDecoded=value;
+    unsigned long long drawn=drawMicros[value];
+    if (drawn==0 || drawn>captureMicros || captureMicros-drawn>loopbackMaxLatency) {
+        decodeErrors++;
+        return;
+    }
+    glassToGlass.add(captureMicros-drawn);
+}
+
+string LoopbackLatency::getSummary() const {
+    char line[128];
+    if (phase!=MEASURE) snprintf(line, sizeof(line), "Loopback: locating the projected image...");
+    else snprintf(line, sizeof(line), "Loopback draw to capture: p50 %.1f ms, p99 %.1f ms (%u frames, %d errors)",
+                  glassToGlass.getPercentile(0.5)/1000.0, glassToGlass.getPercentile(0.99)/1000.0, glassToGlass.getCount(), decodeErrors);
+    return line;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "StageProfiler.h"
+
+// ==================================================================
+// Glass to glass latency (projector draw -> light -> camera -> frame delivered), measured by projecting a frame
+// counter that the camera reads back. The whole projector image is used (this is a tuning mode: no calibration
+// meanwhile), as vertical stripes: a white and a black reference stripe, then the counter bits (Gray code, so a stripe
+// caught during the transition gives a neighbour value, not garbage).
+// (1) Locate: the projector shows white, then black (settle frames for each); the lit area of the camera image
+//     (difference white - black) gives the region where the stripes are read. The projector must face the camera
+//     roughly: the stripes are sampled along the horizontal axis of that region.
+// (2) Measure: each draw shows the next counter value and keeps its draw time; the first camera frame decoding a
+//     value gives capture time - draw time.
+// The sum of this and the pipeline latency (capture -> projector drawn, see LatencyTrace) is the motion to photon
+// latency of the dynamic projection.
+// ==================================================================
+
+class LoopbackLatency {
+public:
+    LoopbackLatency();
+
+    void setup(int bits = 8, int settleFrames = 3);
+    void start();
+    void stop() {running=false;}
+    bool isRunning() const {return running;}
+
+    // Projector image (call in the projector viewport, once per draw):
+    void draw(int width, int height);
+    // Camera frame (grayscale, full resolution) and its capture timestamp (FrameRing::nowMicros):
+    void process(const cv::Mat& gray, unsigned long long captureMicros);
+
+    const LatencyHistogram& getGlassToGlass() const {return glassToGlass;}
+    int getDecodeErrors() const {return decodeErrors;}
+    string getSummary() const;
+
+protected:
+    enum Phase {LOCATE_WHITE, LOCATE_BLACK, MEASURE};
+    bool readStripe(const cv::Mat& gray, int stripe, float& value) const;
+
+    bool running;
+    Phase phase;
+    int bits, numStripes, settleFrames, waitFrames;
+    cv::Mat whiteFrame;
+    cv::Rect region; // lit area in the camera image
+
+    unsigned int drawCounter;
+    vector<unsigned long long> drawMicros; // draw time of each counter value (0: not drawn since start)
+    int lastDecoded;
+    int decodeErrors;
+    LatencyHistogram glassToGlass;
+};
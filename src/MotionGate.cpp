@@ -0,0 +1,96 @@
+#include "MotionGate.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace cv;
+
+MotionGate::MotionGate() {
+    previous=0;
+    hasPrevious=false;
+    decimation=1;
+    diffMean=255;
+}
+
+void MotionGate::setDecimation(int step) {
+    decimation=MAX(step, 1);
+    hasPrevious=false;
+}
+
+void MotionGate::setRoi(cv::Rect roi) {
+    this->roi=roi;
+    hasPrevious=false;
+}
+
+void MotionGate::allocate(const Mat& region) {
+    int rows=(region.rows+decimation-1)/decimation;
+    int cols=(region.cols+decimation-1)/decimation;
+    for (int i=0; i<2; i++) buffers[i].create(rows, cols*region.channels(), CV_8UC1);
+}
+
+// Sum of |a-b| over n bytes, storing a into next:
+static inline unsigned long long sadAndStore(const uchar* a, const uchar* b, uchar* next, int n) {
+    unsigned long long sum=0;
+    int i=0;
+#ifdef __SSE2__
+    __m128i accumulator=_mm_setzero_si128();
+    for (; i+16<=n; i+=16) {
+        __m128i current=_mm_loadu_si128((const __m128i*)(a+i));
+        __m128i prev=_mm_loadu_si128((const __m128i*)(b+i));
+        accumulator=_mm_add_epi64(accumulator, _mm_sad_epu8(current, prev));
+        _mm_storeu_si128((__m128i*)(next+i), current);
+    }
+    unsigned long long partial[2];
+    _mm_storeu_si128((__m128i*)partial, accumulator);
+    sum=partial[0]+partial[1];
+#endif
+    for (; i<n; i++) {
+        sum+=abs((int)a[i]-(int)b[i]);
+        next[i]=a[i];
+    }
+    return sum;
+}
+
+float MotionGate::update(const Mat& frame) {
+    // (an ROI outside the frame, e.g. set for another resolution, falls back to the whole frame: an empty region would
+    // give a NaN mean and the gate would never open)
+    cv::Rect clipped=roi & cv::Rect(0, 0, frame.cols, frame.rows);
+    Mat region=(clipped.area()>0) ? frame(clipped) : frame;
+    CV_Assert(region.depth()==CV_8U);
+
+    int channels=region.channels();
+    int rows=(region.rows+decimation-1)/decimation;
+    int cols=(region.cols+decimation-1)/decimation;
+    if (buffers[0].rows!=rows || buffers[0].cols!=cols*channels) {
+        allocate(region);
+        hasPrevious=false;
+    }
+
+    Mat& prev=buffers[previous];
+    Mat& next=buffers[1-previous];
+    unsigned long long sum=0;
+
+    for (int r=0; r<rows; r++) {
+        const uchar* cur=region.ptr<uchar>(r*decimation);
+        const uchar* p=prev.ptr<uchar>(r);
+        uchar* n=next.ptr<uchar>(r);
+        if (decimation==1) {
+            sum+=sadAndStore(cur, p, n, cols*channels);
+        } else {
+            int step=decimation*channels;
+            for (int c=0, i=0; c<cols; c++, cur+=step) {
+                for (int k=0; k<channels; k++, i++) {
+                    sum+=abs((int)cur[k]-(int)p[i]);
+                    n[i]=cur[k];
+                }
+            }
+        }
+    }
+    previous=1-previous; // ping-pong: the samples of this frame are the "previous" ones for the next call
+
+    if (hasPrevious) diffMean=(float)((double)sum/((double)rows*cols*channels));
+    else diffMean=255;
+    hasPrevious=true;
+    return diffMean;
+}
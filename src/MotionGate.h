@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Motion test used to decide if the board is still enough to be acquired: mean absolute difference between the current
+// and the previous frame (mean over pixels AND channels, i.e. the same value as mean(Mat(mean(absdiff(prev, cur))))).
+// It is done in ONE pass, without intermediate difference image: the pass accumulates the absolute differences (SSE2
+// _mm_sad_epu8 when available) and at the same time stores the current samples into the second of two ping-pong
+// buffers, which becomes the "previous" frame for the next call (no extra copy of the frame).
+// Optionally, only a ROI and/or one pixel every "decimation" pixels (in x and y) are compared, which keeps the test cheap
+// for large camera resolutions.
+// ==================================================================
+
+class MotionGate {
+public:
+    MotionGate();
+
+    void setDecimation(int step);      // 1 = every pixel (default)
+    void setRoi(cv::Rect roi);         // empty rectangle (or outside the frame) = whole frame (default)
+
+    // Returns the mean absolute difference with the previous frame (255 for the first frame, or after changing the
+    // settings, so that it never passes the threshold).
+    float update(const cv::Mat& frame);
+    float getDiffMean() const {return diffMean;}
+
+protected:
+    void allocate(const cv::Mat& region);
+
+    cv::Mat buffers[2];   // sampled frames (one row per sampled row, channels interleaved)
+    int previous;         // index of the buffer holding the previous frame
+    bool hasPrevious;
+    int decimation;
+    cv::Rect roi;
+    float diffMean;
+};
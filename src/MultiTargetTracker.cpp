@@ -0,0 +1,139 @@
+#include "MultiTargetTracker.h"
+
+using namespace cv;
+
+const float targetMaskGrowth = 1.5; // the board hull is grown by this factor (around its center) before masking: the printed board extends beyond the inner corners
+const float targetSameBoard = 0.1; // two targets closer than this (fraction of the image width) found the same board
+const float targetReacquire = 0.25; // a lost target closer than this (fraction of the image width) to a new board is that board, found again
+
+static Point2f centroid(const vector<Point2f>& points) {
+    Point2f center(0, 0);
+    for (int i=0; i<points.size(); i++) center+=points[i];
+    return center*(1.0/points.size());
+}
+
+// Re-detection, sub-pixel refinement and pose of one known target per job. The chessboard is looked for in a window
+// around its last position (grown by 50% on each side, as in BoardPrecheck), in the downscaled image:
+class TargetPoseTask : public ParallelTask {
+public:
+    TargetPoseTask(MultiTargetTracker& tracker, const Mat& gray, const Mat& level, int scale) : tracker(tracker), gray(gray), level(level), scale(scale) {}
+
+    void run(int begin, int end) {
+        vector<Point2f> corners;
+        for (int i=begin; i<end; i++) {
+            TrackedTarget& target=tracker.targets[i];
+            cv::Rect last=boundingRect(Mat(target.imagePoints));
+            cv::Rect window(last.x/scale, last.y/scale, last.width/scale, last.height/scale);
+            window-=cv::Point(window.width/2, window.height/2);
+            window+=cv::Size(window.width, window.height);
+            window&=cv::Rect(0, 0, level.cols, level.rows);
+            if (window.width<2*tracker.patternSize.width || window.height<2*tracker.patternSize.height) continue;
+            if (!findChessboardCorners(level(window), tracker.patternSize, corners, CALIB_CB_FAST_CHECK | CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE)) continue;
+            for (int k=0; k<corners.size(); k++) corners[k]=(corners[k]+Point2f(window.x, window.y))*(float)scale;
+            target.imagePoints=corners;
+            tracker.computePose(target, gray, scale);
+        }
+    }
+    MultiTargetTracker& tracker;
+    const Mat& gray;
+    const Mat& level;
+    int scale;
+};
+
+MultiTargetTracker::MultiTargetTracker() {
+    maxTargets=4;
+    maxLostTime=0.5;
+    nextId=0;
+}
+
+void MultiTargetTracker::setup(cv::Size patternSize, const vector<Point3f>& objectPoints, int maxTargets, float maxLostTime) {
+    this->patternSize=patternSize;
+    this->objectPoints=objectPoints;
+    this->maxTargets=maxTargets;
+    this->maxLostTime=maxLostTime;
+    targets.clear();
+}
+
+void MultiTargetTracker::setIntrinsics(const Mat& cameraMatrix, const Mat& distCoeffs) {
+    cameraMatrix.convertTo(this->cameraMatrix, CV_64F);
+    distCoeffs.convertTo(this->distCoeffs, CV_64F);
+}
+
+void MultiTargetTracker::computePose(TrackedTarget& target, const Mat& gray, int scale) {
+    cornerSubPix(gray, target.imagePoints, cv::Size(2+2*scale, 2+2*scale), cv::Size(-1, -1), TermCriteria(CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 20, 0.05));
+    solvePnP(Mat(objectPoints), Mat(target.imagePoints), cameraMatrix, distCoeffs, target.rotation, target.translation, target.poseValid);
+    target.poseValid=true;
+    target.visible=true;
+}
+
+bool MultiTargetTracker::findNewTarget(const Mat& level, int scale) {
+    // The whole image, with the boards already tracked masked out (grown hull, filled with mid gray):
+    level.copyTo(masked);
+    for (int t=0; t<targets.size(); t++) {
+        if (!targets[t].visible) continue;
+        Point2f center=centroid(targets[t].imagePoints);
+        convexHull(Mat(targets[t].imagePoints), hull);
+        polygon.resize(hull.size());
+        for (int i=0; i<hull.size(); i++) polygon[i]=(center+(hull[i]-center)*targetMaskGrowth)*(1.0f/scale);
+        fillConvexPoly(masked, &polygon[0], polygon.size(), Scalar(128));
+    }
+    if (!findChessboardCorners(masked, patternSize, newCorners, CALIB_CB_FAST_CHECK | CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE)) return false;
+    for (int i=0; i<newCorners.size(); i++) newCorners[i]*=(float)scale;
+    return true;
+}
+
+int MultiTargetTracker::update(const Mat& gray, const Mat& level, int scale, unsigned long long captureMicros) {
+    if (cameraMatrix.empty() || objectPoints.empty()) return 0;
+
+    // (1) Known targets, one per job:
+    for (int t=0; t<targets.size(); t++) targets[t].visible=false;
+    if (!targets.empty()) {
+        TargetPoseTask task(*this, gray, level, scale);
+        TaskPool::shared().parallelFor(task, targets.size(), 1);
+    }
+    // (two windows may have found the same board: keep the oldest target)
+    float sameBoard=targetSameBoard*gray.cols;
+    for (int t=0; t<targets.size(); t++)
+        for (int u=0; u<t && targets[t].visible; u++)
+            if (targets[u].visible && norm(centroid(targets[t].imagePoints)-centroid(targets[u].imagePoints))<sameBoard) targets[t].visible=false;
+
+    // (2) At most one new target per frame (a single whole image search, whatever the number of targets):
+    int visible=0;
+    for (int t=0; t<targets.size(); t++) visible+=targets[t].visible;
+    if (visible<maxTargets && findNewTarget(level, scale)) {
+        // The closest lost target, if near enough, is the same board found outside its window: it keeps its id and filter
+        // (otherwise it would come back under a new id, and the dedupe would hide one of the two):
+        Point2f center=centroid(newCorners);
+        int found=-1;
+        float closest=targetReacquire*gray.cols;
+        for (int t=0; t<targets.size(); t++) {
+            if (targets[t].visible) continue;
+            float distance=norm(centroid(targets[t].imagePoints)-center);
+            if (distance<closest) {closest=distance; found=t;}
+        }
+        if (found<0) {
+            // (replaces a lost target if there is no room left)
+            if ((int)targets.size()>=maxTargets) {
+                for (int t=0; t<targets.size(); t++) if (!targets[t].visible) {targets.erase(targets.begin()+t); break;}
+            }
+            TrackedTarget target;
+            target.id=nextId++;
+            targets.push_back(target);
+            found=targets.size()-1;
+        }
+        targets[found].poseValid=false; // (the last pose of a lost target is no initial guess for where it is now)
+        targets[found].imagePoints=newCorners;
+        computePose(targets[found], gray, scale);
+        visible++;
+    }
+
+    for (int t=targets.size()-1; t>=0; t--) {
+        if (targets[t].visible) {
+            targets[t].lastSeenMicros=captureMicros;
+            targets[t].filter.update(targets[t].rotation, targets[t].translation, captureMicros);
+        }
+        // Lost:
+        else if (captureMicros-targets[t].lastSeenMicros>maxLostTime*1000000) targets.erase(targets.begin()+t);
+    }
+    return visible;
+}
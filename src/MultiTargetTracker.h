@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+#include "PoseFilter.h"
+
+// ==================================================================
+// Several printed targets (same chessboard layout) in AR_DEMO, instead of the single calibrationCamera pattern:
+// (1) known targets, in parallel on the TaskPool (one target per job): the chessboard is looked for in a window around
+//     its last position in the downscaled gray image (a level of the frame pyramid, see FramePreprocessor), then
+//     sub-pixel refinement at full resolution and solvePnP (last pose as initial guess). Each target keeps its id and
+//     its own PoseFilter; the cost of several targets is spread over the cores,
+// (2) new targets: ONE whole image search per frame (findChessboardCorners with the fast check), with the boards
+//     already tracked masked out (hull filled with gray). So the serial part does not grow with the number of targets;
+//     a new board is acquired per frame at most.
+// A target not found in the last frame is not visible (no overlay); it is dropped after maxLostTime seconds (until
+// then, its window is still searched, and a new board found near it by the whole image search is matched to it, to get
+// it back with the same id and filter).
+// ==================================================================
+
+struct TrackedTarget {
+    int id;
+    vector<cv::Point2f> imagePoints; // full resolution
+    cv::Mat rotation, translation;   // board -> camera
+    PoseFilter filter;
+    unsigned long long lastSeenMicros;
+    bool visible; // found in the last frame (only visible targets are drawn)
+    bool poseValid;
+};
+
+class MultiTargetTracker {
+public:
+    MultiTargetTracker();
+
+    void setup(cv::Size patternSize, const vector<cv::Point3f>& objectPoints, int maxTargets = 4, float maxLostTime = 0.5);
+    void setIntrinsics(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+    void reset() {targets.clear();}
+
+    // gray: full resolution; level: the same image downscaled by "scale". Returns the number of visible targets.
+    int update(const cv::Mat& gray, const cv::Mat& level, int scale, unsigned long long captureMicros);
+
+    int size() const {return targets.size();}
+    const TrackedTarget& getTarget(int i) const {return targets[i];}
+    const vector<cv::Point3f>& getObjectPoints() const {return objectPoints;}
+
+protected:
+    bool findNewTarget(const cv::Mat& level, int scale);
+    void computePose(TrackedTarget& target, const cv::Mat& gray, int scale);
+
+    cv::Size patternSize;
+    vector<cv::Point3f> objectPoints;
+    int maxTargets;
+    float maxLostTime;
+    cv::Mat cameraMatrix, distCoeffs;
+
+    vector<TrackedTarget> targets;
+    int nextId;
+
+    // (buffers reused from frame to frame)
+    cv::Mat masked;
+    vector<cv::Point2f> newCorners, hull;
+    vector<cv::Point> polygon;
+
+    friend class TargetPoseTask;
+};
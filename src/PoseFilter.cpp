@@ -0,0 +1,106 @@
+#include "PoseFilter.h"
+
+using namespace cv;
+
+PoseFilter::PoseFilter() {
+    valid=false;
+    lastMicros=0;
+    R=Matx33d::eye();
+    setup(2000, 20, 0.5, 0.005);
+}
+
+void PoseFilter::setup(float accelerationNoise, float angularAccelerationNoise, float positionNoise, float rotationNoise, float maxGap) {
+    this->accelerationNoise=accelerationNoise;
+    this->angularAccelerationNoise=angularAccelerationNoise;
+    this->positionNoise=positionNoise;
+    this->rotationNoise=rotationNoise;
+    this->maxGap=maxGap;
+    valid=false;
+}
+
+void PoseFilter::initAxis(Axis& axis, double x, double variance) {
+    axis.x=x;
+    axis.v=0;
+    axis.P[0][0]=variance; axis.P[0][1]=axis.P[1][0]=0;
+    axis.P[1][1]=variance*100; // (velocity unknown)
+}
+
+// x += v dt, P = F P F^T + Q (white acceleration of standard deviation q)
+void PoseFilter::predictAxis(Axis& axis, double dt, double q) {
+    axis.x+=axis.v*dt;
+    double p00=axis.P[0][0]+dt*(axis.P[1][0]+axis.P[0][1])+dt*dt*axis.P[1][1];
+    double p01=axis.P[0][1]+dt*axis.P[1][1];
+    double p11=axis.P[1][1];
+    double q2=q*q, dt2=dt*dt;
+    axis.P[0][0]=p00+q2*dt2*dt2/4;
+    axis.P[0][1]=axis.P[1][0]=p01+q2*dt2*dt/2;
+    axis.P[1][1]=p11+q2*dt2;
+}
+
+// Measurement of x (residual: measured - predicted, variance r)
+void PoseFilter::correctAxis(Axis& axis, double residual, double r) {
+    double s=axis.P[0][0]+r;
+    double k0=axis.P[0][0]/s, k1=axis.P[1][0]/s;
+    axis.x+=k0*residual;
+    axis.v+=k1*residual;
+    double p00=axis.P[0][0], p01=axis.P[0][1], p11=axis.P[1][1];
+    axis.P[0][0]=(1-k0)*p00;
+    axis.P[0][1]=axis.P[1][0]=(1-k0)*p01;
+    axis.P[1][1]=p11-k1*p01;
+}
+
+void PoseFilter::update(const Mat& rotationVector, const Mat& translation, unsigned long long captureMicros) {
+    if (rotationVector.empty() || translation.empty()) return;
+    RigidPose measured=RigidPose::fromRodrigues(rotationVector, translation);
+
+    double dt=valid ? (captureMicros-(double)lastMicros)/1000000.0 : 0;
+    if (!valid || dt<=0 || dt>maxGap) {
+        for (int i=0; i<3; i++) {
+            initAxis(position[i], measured.t[i], positionNoise*positionNoise);
+            initAxis(rotation[i], 0, rotationNoise*rotationNoise);
+        }
+        R=measured.R;
+        lastMicros=captureMicros;
+        valid=true;
+        return;
+    }
+    lastMicros=captureMicros;
+
+    // Prediction to the capture time:
+    double w[3];
+    for (int i=0; i<3; i++) {
+        predictAxis(position[i], dt, accelerationNoise);
+        predictAxis(rotation[i], dt, angularAccelerationNoise);
+        w[i]=rotation[i].x; // (v*dt: rotation since the last update)
+        rotation[i].x=0;
+    }
+    Matx33d predictedR=RigidPose::rotationFromVector(w)*R;
+
+    // Correction:
+    double residual[3];
+    RigidPose::vectorFromRotation(measured.R*predictedR.t(), residual);
+    for (int i=0; i<3; i++) {
+        correctAxis(position[i], measured.t[i]-position[i].x, positionNoise*positionNoise);
+        correctAxis(rotation[i], residual[i], rotationNoise*rotationNoise);
+        w[i]=rotation[i].x;
+        rotation[i].x=0;
+    }
+    R=RigidPose::rotationFromVector(w)*predictedR;
+}
+
+RigidPose PoseFilter::getFiltered() const {
+    return RigidPose(R, Vec3d(position[0].x, position[1].x, position[2].x));
+}
+
+RigidPose PoseFilter::predict(unsigned long long micros, float maxPrediction) const {
+    if (!valid) return RigidPose();
+    double dt=(micros-(double)lastMicros)/1000000.0;
+    dt=MAX(MIN(dt, (double)maxPrediction), 0.0);
+    double w[3];
+    Vec3d t;
+    for (int i=0; i<3; i++) {
+        t[i]=position[i].x+position[i].v*dt;
+        w[i]=rotation[i].v*dt;
+    }
+    return RigidPose(RigidPose::rotationFromVector(w)*R, t);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "FixedPattern.h"
+
+// ==================================================================
+// Constant velocity Kalman filter on the board pose (SE(3)), for AR_DEMO: the detected pose is smoothed, and
+// extrapolated to the time the projector will actually show the image (capture timestamp + pipeline + display
+// latency), so the projection does not lag behind a moving board.
+// - translation: 3 independent (position, velocity) filters,
+// - rotation: the filtered rotation R plus an angular velocity w; the measurement residual is the rotation vector of
+//   R_measured * R_predicted^T, i.e. each axis of the tangent space is again a (angle, angular velocity) filter, and
+//   the correction is applied back on R (multiplicative update).
+// The process noise is a white acceleration (translation: board units/s^2, as squareSize; rotation: rad/s^2); the measurement
+// noise comes from the pose estimation (board units, rad). After a gap longer than maxGap (board lost) the filter
+// restarts from the next measurement.
+// Timestamps: microseconds, on the capture clock (FrameRing::nowMicros).
+// ==================================================================
+
+class PoseFilter {
+public:
+    PoseFilter();
+
+    void setup(float accelerationNoise, float angularAccelerationNoise, float positionNoise, float rotationNoise, float maxGap = 0.5);
+    void reset() {valid=false;}
+
+    // New detected pose (board -> camera, rotation vector + translation) captured at captureMicros:
+    void update(const cv::Mat& rotation, const cv::Mat& translation, unsigned long long captureMicros);
+    bool isValid() const {return valid;}
+
+    // Filtered pose at the last measurement:
+    RigidPose getFiltered() const;
+    // Pose extrapolated to the given time (constant velocity; at most maxPrediction seconds after the last measurement):
+    RigidPose predict(unsigned long long micros, float maxPrediction = 0.1) const;
+    unsigned long long getLastMeasurementMicros() const {return lastMicros;}
+
+protected:
+    // One axis: value and velocity, 2x2 covariance
+    struct Axis {
+        double x, v;
+        double P[2][2];
+    };
+    static void initAxis(Axis& axis, double x, double variance);
+    static void predictAxis(Axis& axis, double dt, double q);
+    static void correctAxis(Axis& axis, double residual, double r);
+
+    bool valid;
+    unsigned long long lastMicros;
+    Axis position[3], rotation[3]; // rotation: x is the pending correction angle (0 after each update), v the angular velocity
+    cv::Matx33d R;
+
+    double accelerationNoise, angularAccelerationNoise, positionNoise, rotationNoise, maxGap;
+};
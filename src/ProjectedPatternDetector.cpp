@@ -0,0 +1,171 @@
+#include "ProjectedPatternDetector.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+const float dotWindowSize = 0.4; // half size of the search window of each dot, as a fraction of the smallest distance between two predicted dots
+const int minDotWindow = 4; // (pixels)
+const int minDotContrast = 30; // gray levels between the dot and its surroundings
+const int minDotArea = 4; // (pixels)
+const float maxGridError = 0.2; // topology check: maximum distance of a dot to the homography of the predicted grid (fraction of the dot spacing)
+
+ProjectedPatternDetector::ProjectedPatternDetector() {
+    flags=CALIB_CB_ASYMMETRIC_GRID;
+    enabled=false;
+    dotColor=ofColor(255);
+    found=false;
+    detectionMicros=0;
+    windowDetections=fullDetections=0;
+}
+
+bool ProjectedPatternDetector::setup(const Calibration& projectorCalibration) {
+    patternSize=projectorCalibration.myPatternShape.getPatternSize();
+    dotColor=projectorCalibration.myPatternShape.color;
+    enabled=true;
+    switch (projectorCalibration.myPatternShape.patternType) {
+        case ASYMMETRIC_CIRCLES_GRID: flags=CALIB_CB_ASYMMETRIC_GRID; break;
+        case CIRCLES_GRID: flags=CALIB_CB_SYMMETRIC_GRID; break;
+        default: enabled=false; // (chessboard: no dots)
+    }
+    found=false;
+    resetPrediction();
+    return enabled;
+}
+
+// Closeness to the dot color (255: same color), as the color segmentation of the pattern file. White dots: the gray
+// image is already that, and a gray dot color only needs the gray image; otherwise the mean absolute difference of the
+// RGB channels is used.
+const Mat& ProjectedPatternDetector::segment(const Mat& frame, const Mat& gray) {
+    if (dotColor.r==dotColor.g && dotColor.g==dotColor.b) {
+        if (dotColor.r==255) return gray;
+        absdiff(gray, Scalar(dotColor.r), segmented);
+    } else {
+        absdiff(frame, Scalar(dotColor.r, dotColor.g, dotColor.b), colorDistance);
+        transform(colorDistance, segmented, Matx13f(1/3.0, 1/3.0, 1/3.0));
+    }
+    bitwise_not(segmented, segmented);
+    return segmented;
+}
+
+bool ProjectedPatternDetector::detect(const Mat& frame, const Mat& gray) {
+    found=false;
+    detectionMicros=0;
+    if (!enabled || frame.empty() || gray.empty()) return false;
+    unsigned long long start=ofGetElapsedTimeMicros();
+    const Mat& image=segment(frame, gray);
+
+    // (1) Windows around the predicted dots, else around the dots of the last detection:
+    previous.swap(imagePoints);
+    if (!predicted.empty()) found=detectInWindows(image, predicted);
+    if (!found && !previous.empty()) found=detectInWindows(image, previous);
+    predicted.clear();
+    if (found) windowDetections++;
+    else {
+        // (2) Whole image. The segmented dots are BRIGHT, and the blob detector looks for dark blobs:
+        bitwise_not(image, inverted);
+        found=findCirclesGrid(inverted, patternSize, imagePoints, flags);
+        if (found) fullDetections++;
+        else imagePoints.clear();
+    }
+    detectionMicros=ofGetElapsedTimeMicros()-start;
+    return found;
+}
+
+bool ProjectedPatternDetector::detectInWindows(const Mat& image, const vector<Point2f>& expected) {
+    if ((int)expected.size()!=patternSize.area() || expected.size()<2) return false;
+
+    // Dot spacing (smallest distance between two predicted dots) gives the window size:
+    float spacing=norm(expected[1]-expected[0]);
+    for (int i=0; i<expected.size(); i++)
+        for (int j=i+1; j<expected.size(); j++) spacing=MIN(spacing, norm(expected[i]-expected[j]));
+    int halfSize=MAX(minDotWindow, cvRound(dotWindowSize*spacing));
+
+    imagePoints.resize(expected.size());
+    for (int i=0; i<expected.size(); i++)
+        if (!findDot(image, expected[i], halfSize, imagePoints[i])) return false;
+
+    // Topology: the found dots are the predicted grid seen through a homography (planar board), one dot per window:
+    Mat H=findHomography(Mat(expected), Mat(imagePoints), 0);
+    if (H.empty()) return false;
+    perspectiveTransform(Mat(expected), windowPoints, H);
+    float maxError=maxGridError*spacing;
+    for (int i=0; i<imagePoints.size(); i++)
+        if (norm(windowPoints[i]-imagePoints[i])>maxError) return false;
+    return true;
+}
+
+bool ProjectedPatternDetector::findDot(const Mat& image, Point2f expected, int halfSize, Point2f& dot) {
+    cv::Rect window(cvRound(expected.x)-halfSize, cvRound(expected.y)-halfSize, 2*halfSize+1, 2*halfSize+1);
+    window&=cv::Rect(0, 0, image.cols, image.rows);
+    if (window.width<=2 || window.height<=2) return false;
+    Mat patch=image(window);
+
+    double darkest, brightest;
+    minMaxLoc(patch, &darkest, &brightest);
+    if (brightest-darkest<minDotContrast) return false;
+    double level=(darkest+brightest)/2;
+    threshold(patch, binary, level, 255, THRESH_BINARY);
+    findContours(binary, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+    // Bright region closest to the window center (a region touching the window border is not a whole dot):
+    Point2f center=expected-Point2f(window.x, window.y);
+    int best=-1;
+    float bestDistance=2*window.width; // (any region of the window is closer)
+    cv::Rect bestBox;
+    for (int i=0; i<contours.size(); i++) {
+        cv::Rect box=boundingRect(Mat(contours[i]));
+        if (box.x==0 || box.y==0 || box.x+box.width==window.width || box.y+box.height==window.height) continue;
+        if (box.area()<minDotArea) continue;
+        float distance=norm(Point2f(box.x+box.width*0.5, box.y+box.height*0.5)-center);
+        if (distance<bestDistance) {
+            bestDistance=distance;
+            best=i;
+            bestBox=box;
+        }
+    }
+    if (best<0) return false;
+
+    // Centroid of the intensity above the threshold, in the bounding box of the region:
+    subtract(patch(bestBox), Scalar(level), weights);
+    Moments m=moments(weights);
+    if (m.m00<=0) return false;
+    dot=Point2f(window.x+bestBox.x+m.m10/m.m00, window.y+bestBox.y+m.m01/m.m00);
+    return true;
+}
+
+bool ProjectedPatternDetector::backProject(const Mat& cameraMatrix, const Mat& distCoeffs, const Mat& boardRotation, const Mat& boardTranslation,
+                                           vector<Point3f>& objectPoints) {
+    return found && backProject(imagePoints, cameraMatrix, distCoeffs, boardRotation, boardTranslation, objectPoints);
+}
+
+bool ProjectedPatternDetector::backProject(const vector<Point2f>& imagePoints, const Mat& cameraMatrix, const Mat& distCoeffs,
+                                           const Mat& boardRotation, const Mat& boardTranslation, vector<Point3f>& objectPoints) {
+    if (imagePoints.empty() || boardRotation.empty() || boardTranslation.empty()) return false;
+
+    Mat R, t;
+    Rodrigues(boardRotation, R);
+    R.convertTo(R, CV_64F);
+    boardTranslation.reshape(1, 3).convertTo(t, CV_64F);
+
+    // Board plane in camera coordinates: normal = third column of R, passing through t.
+    Vec3d n(R.at<double>(0, 2), R.at<double>(1, 2), R.at<double>(2, 2));
+    Vec3d p(t.at<double>(0), t.at<double>(1), t.at<double>(2));
+    double nDotP=n.dot(p);
+
+    // Normalized camera rays of the detected dots:
+    vector<Point2f> undistorted;
+    undistortPoints(Mat(imagePoints), undistorted, cameraMatrix, distCoeffs);
+
+    objectPoints.resize(undistorted.size());
+    for (int i=0; i<undistorted.size(); i++) {
+        Vec3d ray(undistorted[i].x, undistorted[i].y, 1);
+        double nDotRay=n.dot(ray);
+        if (fabs(nDotRay)<1e-9) return false; // ray parallel to the board
+        Vec3d X=ray*(nDotP/nDotRay)-p;
+        // Back to board coordinates (R transposed), z is 0 on the board:
+        objectPoints[i]=Point3f(R.at<double>(0, 0)*X[0]+R.at<double>(1, 0)*X[1]+R.at<double>(2, 0)*X[2],
+                                R.at<double>(0, 1)*X[0]+R.at<double>(1, 1)*X[1]+R.at<double>(2, 1)*X[2],
+                                0);
+    }
+    return true;
+}
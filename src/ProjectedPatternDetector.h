@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+
+// ==================================================================
+// Detection of the projected circle pattern, split in two steps so that the image space part can run CONCURRENTLY with
+// the detection of the printed pattern (PHASE2):
+// (1) detect(): circle grid in the camera image. It does not need the board pose, so it can run as a task on the
+//     TaskPool (run(0, 1)). The pattern type (symmetric or asymmetric circle grid) and the dot color come from the
+//     pattern shape of the projector calibration object (settingsProjectionPatternPixels.yml), and the dots are looked
+//     for in a segmentation of the frame by that color (closeness to the color, so the dots are BRIGHT): for white dots
+//     this is the shared gray image itself, otherwise it is computed from the color frame (in the task).
+//     When the dot positions can be predicted (setPrediction, or the dots found in the previous
+//     frame), each dot is looked for only in a small window around its predicted position: threshold halfway between
+//     the darkest and brightest pixel of the window, contours of the bright regions,
+//     and intensity weighted centroid (moments) of the region closest to the window center. The result is accepted
+//     only if the grid topology holds (a homography maps the predicted grid on the found dots; the windows do not
+//     overlap, so two windows cannot take the same dot).
+//     Otherwise, or without prediction, the generic findCirclesGrid runs on the whole (inverted) image.
+// (2) backProject(): once the printed board pose is known, each detected dot is intersected (camera ray / board plane)
+//     to get the projector "object points" in board coordinates.
+// ==================================================================
+
+class ProjectedPatternDetector : public ParallelTask {
+public:
+    ProjectedPatternDetector();
+
+    // Pattern size, type and dot color of the projector pattern. Returns false (and isEnabled() is false) if it is not a
+    // circle grid: the projected pattern must then be detected by the calibration object.
+    bool setup(const ofxCv::Calibration& projectorCalibration);
+    bool isEnabled() const {return enabled;}
+
+    // (1) Image space detection (frame: RGB camera frame; gray: its grayscale version). Use setInput() + TaskPool submit
+    // to run it in the background:
+    bool detect(const cv::Mat& frame, const cv::Mat& gray);
+    void setInput(const cv::Mat& frame, const cv::Mat& gray) {inputFrame=frame; inputGray=gray; found=false;} // (headers only: the images must stay valid until the task is done)
+    void run(int begin, int end) {detect(inputFrame, inputGray);}
+    bool isFound() const {return found;}
+    // Expected dot positions in the camera image (same order as the grid points), used by the next detect() only:
+    void setPrediction(const vector<cv::Point2f>& points) {predicted=points;}
+    void clearPrediction() {predicted.clear();} // (the next detect() starts from the dots of the last detection, if any)
+    void resetPrediction() {predicted.clear(); imagePoints.clear();}
+    int getWindowDetections() const {return windowDetections;} // detections by the window path / by the whole image path
+    int getFullDetections() const {return fullDetections;}
+    const vector<cv::Point2f>& getImagePoints() const {return imagePoints;}
+    unsigned long long getDetectionMicros() const {return detectionMicros;} // duration of the last detect()
+
+    // (2) Back-projection on the plane of the printed board (pose: rotation and translation vectors of the board in
+    // camera coordinates, as computed by Calibration::computeCandidateBoardPose):
+    bool backProject(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, const cv::Mat& boardRotation, const cv::Mat& boardTranslation,
+                     vector<cv::Point3f>& objectPoints);
+    static bool backProject(const vector<cv::Point2f>& imagePoints, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+                            const cv::Mat& boardRotation, const cv::Mat& boardTranslation, vector<cv::Point3f>& objectPoints);
+
+protected:
+    const cv::Mat& segment(const cv::Mat& frame, const cv::Mat& gray);
+    bool detectInWindows(const cv::Mat& image, const vector<cv::Point2f>& expected);
+    bool findDot(const cv::Mat& image, cv::Point2f expected, int halfSize, cv::Point2f& dot);
+
+    cv::Size patternSize;
+    int flags;
+    bool enabled;
+    ofColor dotColor;
+
+    cv::Mat inputFrame, inputGray, segmented, colorDistance, inverted;
+    vector<cv::Point2f> imagePoints, predicted, previous;
+    bool found;
+    unsigned long long detectionMicros;
+    int windowDetections, fullDetections;
+
+    // (buffers reused from frame to frame)
+    cv::Mat binary, weights;
+    vector<vector<cv::Point> > contours;
+    vector<cv::Point2f> windowPoints;
+};
@@ -0,0 +1,172 @@
+#include "ProjectionEngine.h"
+
+using namespace cv;
+
+const int parallelProjectionPoints = 4096; // split the projection over the TaskPool above this number of points
+
+// Copy the (up to n <= 9) values of a Mat into a double array; true if any of them changed:
+static bool updateValues(const Mat& m, double* values, int n) {
+    double read[9];
+    RigidPose::readValues(m, read, n); // (no allocation: this runs for every pose, on every frame)
+    bool changed=false;
+    for (int i=0; i<n; i++) {
+        double value=read[i];
+        if (values[i]!=value) {
+            values[i]=value;
+            changed=true;
+        }
+    }
+    return changed;
+}
+
+class ProjectTask : public ParallelTask {
+public:
+    ProjectTask(const ProjectionEngine& engine, const ProjectionEngine::Pose& pose, const Point3f* points, Point2f* imagePoints)
+    : engine(engine), pose(pose), points(points), imagePoints(imagePoints) {}
+
+    void run(int begin, int end) {
+        const Matx33d& R=pose.R;
+        const Vec3d& t=pose.t;
+        const double* k=engine.distortion;
+        double fx=engine.K(0, 0), fy=engine.K(1, 1), cx=engine.K(0, 2), cy=engine.K(1, 2), skew=engine.K(0, 1);
+        for (int i=begin; i<end; i++) {
+            const Point3f& p=points[i];
+            double X=R(0, 0)*p.x+R(0, 1)*p.y+R(0, 2)*p.z+t[0];
+            double Y=R(1, 0)*p.x+R(1, 1)*p.y+R(1, 2)*p.z+t[1];
+            double Z=R(2, 0)*p.x+R(2, 1)*p.y+R(2, 2)*p.z+t[2];
+            double invZ=(Z!=0 ? 1.0/Z : 1.0);
+            double x=X*invZ, y=Y*invZ;
+            // Distortion (same model as projectPoints):
+            double r2=x*x+y*y, r4=r2*r2, r6=r4*r2;
+            double radial=(1+k[0]*r2+k[1]*r4+k[4]*r6)/(1+k[5]*r2+k[6]*r4+k[7]*r6);
+            double xd=x*radial+2*k[2]*x*y+k[3]*(r2+2*x*x);
+            double yd=y*radial+k[2]*(r2+2*y*y)+2*k[3]*x*y;
+            imagePoints[i]=Point2f(fx*xd+skew*yd+cx, fy*yd+cy);
+        }
+    }
+    const ProjectionEngine& engine;
+    const ProjectionEngine::Pose& pose;
+    const Point3f* points;
+    Point2f* imagePoints;
+};
+
+ProjectionEngine::ProjectionEngine() {
+    K=Matx33d::eye();
+    for (int i=0; i<8; i++) distortion[i]=0;
+    extrinsicsR=Matx33d::eye();
+    extrinsicsT=Vec3d(0, 0, 0);
+    for (int i=0; i<6; i++) extrinsicsInput[i]=0;
+    extrinsicsVersion=0;
+    for (int i=0; i<MAX_POSE_SLOTS; i++) poses[i].valid=false;
+    textVersion=-1;
+    textRotationDecimals=textTranslationDecimals=-1;
+}
+
+void ProjectionEngine::setIntrinsics(const Mat& cameraMatrix, const Mat& distCoeffs) {
+    double values[9];
+    for (int i=0; i<9; i++) values[i]=K(i/3, i%3);
+    if (updateValues(cameraMatrix, values, 9)) K=Matx33d(values);
+    updateValues(distCoeffs, distortion, 8);
+}
+
+void ProjectionEngine::setExtrinsics(const Mat& rotation, const Mat& translation) {
+    if (rotation.empty() || translation.empty()) return;
+    bool changed=updateValues(rotation, extrinsicsInput, 3);
+    changed=updateValues(translation, extrinsicsInput+3, 3) || changed;
+    if (!changed && extrinsicsVersion>0) return;
+    extrinsicsR=RigidPose::rotationFromVector(extrinsicsInput);
+    extrinsicsT=Vec3d(extrinsicsInput[3], extrinsicsInput[4], extrinsicsInput[5]);
+    extrinsicsVersion++;
+}
+
+void ProjectionEngine::setPose(int slot, const Mat& rotation, const Mat& translation, bool throughExtrinsics) {
+    if (slot<0 || slot>=MAX_POSE_SLOTS) return;
+    Pose& pose=poses[slot];
+    if (rotation.empty() || translation.empty()) {
+        pose.valid=false;
+        return;
+    }
+    bool changed=!pose.valid || pose.throughExtrinsics!=throughExtrinsics || (throughExtrinsics && pose.extrinsicsVersion!=extrinsicsVersion);
+    changed=updateValues(rotation, pose.rotation, 3) || changed;
+    changed=updateValues(translation, pose.translation, 3) || changed;
+    pose.throughExtrinsics=throughExtrinsics;
+    if (changed) compose(pose);
+}
+
+void ProjectionEngine::setPose(int slot, const RigidPose& board, bool throughExtrinsics) {
+    if (slot<0 || slot>=MAX_POSE_SLOTS) return;
+    Pose& pose=poses[slot];
+    if (throughExtrinsics) {
+        pose.R=extrinsicsR*board.R;
+        pose.t=extrinsicsR*board.t+extrinsicsT;
+    } else {
+        pose.R=board.R;
+        pose.t=board.t;
+    }
+    // (forget the inputs: the next setPose with a rotation vector recomposes)
+    for (int i=0; i<3; i++) pose.rotation[i]=pose.translation[i]=NAN;
+    pose.throughExtrinsics=throughExtrinsics;
+    pose.extrinsicsVersion=extrinsicsVersion;
+    pose.valid=true;
+}
+
+void ProjectionEngine::compose(Pose& pose) {
+    Matx33d boardR=RigidPose::rotationFromVector(pose.rotation);
+    Vec3d boardT(pose.translation[0], pose.translation[1], pose.translation[2]);
+    if (pose.throughExtrinsics) {
+        // board -> camera -> projector:
+        pose.R=extrinsicsR*boardR;
+        pose.t=extrinsicsR*boardT+extrinsicsT;
+    } else {
+        pose.R=boardR;
+        pose.t=boardT;
+    }
+    pose.extrinsicsVersion=extrinsicsVersion;
+    pose.valid=true;
+}
+
+void ProjectionEngine::project(int slot, const Point3f* points, int count, Point2f* imagePoints) {
+    if (slot<0 || slot>=MAX_POSE_SLOTS || !poses[slot].valid || count<=0) return;
+    ProjectTask task(*this, poses[slot], points, imagePoints);
+    if (count<parallelProjectionPoints) task.run(0, count);
+    else TaskPool::shared().parallelFor(task, count, parallelProjectionPoints/4);
+}
+
+void ProjectionEngine::project(int slot, const vector<Point3f>& points, vector<Point2f>& imagePoints) {
+    if (slot<0 || slot>=MAX_POSE_SLOTS || !poses[slot].valid) {
+        imagePoints.clear();
+        return;
+    }
+    imagePoints.resize(points.size());
+    if (!points.empty()) project(slot, &points[0], points.size(), &imagePoints[0]);
+}
+
+void ProjectionEngine::getPose(int slot, Mat& rotation, Mat& translation) const {
+    if (slot<0 || slot>=MAX_POSE_SLOTS || !poses[slot].valid) return;
+    Rodrigues(Mat(poses[slot].R), rotation);
+    Mat(poses[slot].t).copyTo(translation);
+}
+
+ofMatrix4x4 ProjectionEngine::getPoseMatrix(int slot) const {
+    if (slot<0 || slot>=MAX_POSE_SLOTS || !poses[slot].valid) return ofMatrix4x4();
+    const Matx33d& R=poses[slot].R;
+    const Vec3d& t=poses[slot].t;
+    return ofMatrix4x4(R(0, 0), R(1, 0), R(2, 0), 0,
+                       R(0, 1), R(1, 1), R(2, 1), 0,
+                       R(0, 2), R(1, 2), R(2, 2), 0,
+                       t[0], t[1], t[2], 1);
+}
+
+const string& ProjectionEngine::getExtrinsicsText(int rotationDecimals, int translationDecimals) {
+    if (textVersion!=extrinsicsVersion || textRotationDecimals!=rotationDecimals || textTranslationDecimals!=translationDecimals) {
+        extrinsicsText="";
+        for (int i=0; i<3; i++) {
+            for (int j=0; j<3; j++) extrinsicsText+=ofToString(extrinsicsR(i, j), rotationDecimals)+"  ";
+            extrinsicsText+=ofToString(extrinsicsT[i], translationDecimals)+" \n";
+        }
+        textVersion=extrinsicsVersion;
+        textRotationDecimals=rotationDecimals;
+        textTranslationDecimals=translationDecimals;
+    }
+    return extrinsicsText;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+#include "FixedPattern.h"
+
+// ==================================================================
+// Projection of 3d points (board coordinates) into the projector image, replacing the repeated calls to
+// Calibration::createImagePointsFrom3dPoints in draw() (each of them composing the board pose with the extrinsics and
+// calling projectPoints):
+// - the intrinsics (camera matrix + distortion) and the extrinsics (camera -> projector) are cached, and compared by
+//   value on each set: nothing is recomputed if they did not change,
+// - each pose slot holds a board pose, composed ONCE with the extrinsics (if asked) into a 3x4 matrix, when it changes,
+// - project() writes into caller owned buffers (no allocation once they are big enough), with a plain loop over the
+//   points (same model as projectPoints: k1, k2, p1, p2[, k3[, k4, k5, k6]]), split over the TaskPool for large sets
+//   (dense meshes of thousands of points).
+// ==================================================================
+
+class ProjectionEngine {
+public:
+    ProjectionEngine();
+
+    void setIntrinsics(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+    void setExtrinsics(const cv::Mat& rotation, const cv::Mat& translation); // camera -> projector (rotation vector)
+    // Board pose (rotation vector, translation) in CAMERA coordinates if throughExtrinsics, else in projector coordinates:
+    void setPose(int slot, const cv::Mat& rotation, const cv::Mat& translation, bool throughExtrinsics);
+    // Board pose as a RigidPose (in camera coordinates if throughExtrinsics, else in projector coordinates):
+    void setPose(int slot, const RigidPose& board, bool throughExtrinsics = false);
+
+    void project(int slot, const cv::Point3f* points, int count, cv::Point2f* imagePoints);
+    void project(int slot, const vector<cv::Point3f>& points, vector<cv::Point2f>& imagePoints);
+
+    // Composed pose of a slot (board -> projector), e.g. for makeMatrix:
+    void getPose(int slot, cv::Mat& rotation, cv::Mat& translation) const;
+    ofMatrix4x4 getPoseMatrix(int slot) const; // (ofxCv::makeMatrix of the pose)
+    const cv::Matx33d& getExtrinsicsRotation() const {return extrinsicsR;}
+    // Extrinsics as text (3x3 rotation + translation), rebuilt only when they change:
+    const string& getExtrinsicsText(int rotationDecimals, int translationDecimals);
+
+    enum {MAX_POSE_SLOTS=4};
+
+protected:
+    struct Pose {
+        cv::Matx33d R;
+        cv::Vec3d t;
+        double rotation[3], translation[3]; // inputs of the last composition
+        bool throughExtrinsics;
+        int extrinsicsVersion;
+        bool valid;
+    };
+    void compose(Pose& pose);
+
+    cv::Matx33d K;
+    double distortion[8];
+    cv::Matx33d extrinsicsR;
+    cv::Vec3d extrinsicsT;
+    double extrinsicsInput[6];
+    int extrinsicsVersion;
+    Pose poses[MAX_POSE_SLOTS];
+
+    string extrinsicsText;
+    int textVersion, textRotationDecimals, textTranslationDecimals;
+
+    friend class ProjectTask;
+};
@@ -0,0 +1,73 @@
+#include "ReplaySource.h"
+
+using namespace ofxCv;
+using namespace cv;
+
+ReplaySource::ReplaySource() {
+    isMovie=false;
+    frameRate=30;
+    currentFrame=-1;
+    numFrames=0;
+}
+
+bool ReplaySource::open(string path, int width, int height, float fps) {
+    frameSize=cv::Size(width, height);
+    frameRate=fps;
+    currentFrame=-1;
+    files.clear();
+
+    ofDirectory dir(path);
+    if (dir.isDirectory()) {
+        isMovie=false;
+        dir.allowExt("png");
+        dir.allowExt("jpg");
+        dir.allowExt("bmp");
+        dir.allowExt("tif");
+        dir.listDir();
+        dir.sort();
+        for (int i=0; i<dir.size(); i++) files.push_back(dir.getPath(i));
+        numFrames=files.size();
+        image.setUseTexture(false);
+    } else {
+        isMovie=true;
+        movie.setUseTexture(false);
+        if (!movie.loadMovie(path)) {
+            ofLogError() << "ReplaySource: cannot open " << path;
+            return false;
+        }
+        movie.setPaused(true);
+        numFrames=movie.getTotalNumFrames();
+    }
+
+    ofLogNotice() << "ReplaySource: " << numFrames << " frames in " << path;
+    return numFrames>0;
+}
+
+bool ReplaySource::nextFrame(Mat& frame) {
+    if (currentFrame+1>=numFrames) return false;
+    currentFrame++;
+
+    if (isMovie) {
+        movie.setFrame(currentFrame);
+        movie.update();
+        toCalibrationFrame(toCv(movie.getPixelsRef()), frame);
+    } else {
+        if (!image.loadImage(files[currentFrame])) {
+            ofLogWarning() << "ReplaySource: cannot read " << files[currentFrame];
+            return nextFrame(frame);
+        }
+        toCalibrationFrame(toCv(image), frame);
+    }
+    return true;
+}
+
+// Same format as the grabber frames: RGB, calibration resolution.
+void ReplaySource::toCalibrationFrame(Mat src, Mat& frame) {
+    Mat rgb;
+    if (src.channels()==1) cvtColor(src, rgb, CV_GRAY2RGB);
+    else if (src.channels()==4) cvtColor(src, rgb, CV_RGBA2RGB);
+    else rgb=src;
+
+    if (rgb.size()!=frameSize) resize(rgb, frame, frameSize, 0, 0, INTER_AREA);
+    else rgb.copyTo(frame);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Recorded input for the headless replay mode: a directory of frames (sorted by name) or a video file. Frames are
+// returned as RGB images of the calibration resolution (CAM_WIDTH x CAM_HEIGHT), exactly like the frames coming from the
+// ofVideoGrabber, so they can go through the same state machine (testApp::processFrame).
+// No textures are created (this runs without an OpenGL context).
+// ==================================================================
+
+class ReplaySource {
+public:
+    ReplaySource();
+
+    bool open(string path, int width, int height, float fps = 30);
+    bool nextFrame(cv::Mat& frame); // false when the recording is over
+
+    // Time stamp of the last returned frame, in seconds. This is the RECORDING time (frame index / fps), not the wall
+    // clock, so the time based acquisition gate (timeThreshold) behaves the same whatever the replay speed.
+    float getFrameTime() const {return currentFrame/frameRate;}
+    int getCurrentFrame() const {return currentFrame;}
+    int getFrameCount() const {return numFrames;}
+
+protected:
+    void toCalibrationFrame(cv::Mat src, cv::Mat& frame);
+
+    bool isMovie;
+    vector<string> files;
+    ofVideoPlayer movie;
+    ofImage image;
+
+    cv::Size frameSize;
+    float frameRate;
+    int currentFrame, numFrames;
+};
@@ -0,0 +1,167 @@
+#include "StageProfiler.h"
+#include "ofxCv.h"
+
+using namespace ofxCv;
+
+// =========== LatencyHistogram ====================
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    for (int i=0; i<PROFILER_NUM_BUCKETS; i++) buckets[i]=0;
+    count=0;
+    sumMicros=0;
+    maxMicros=0;
+}
+
+int LatencyHistogram::bucketIndex(unsigned long long micros) {
+    if (micros<1) return 0;
+    int octave=63-__builtin_clzll(micros);
+    int sub=(octave>=2) ? (int)((micros>>(octave-2))&3) : 0;
+    return MIN(octave*PROFILER_BUCKETS_PER_OCTAVE+sub, PROFILER_NUM_BUCKETS-1);
+}
+
+float LatencyHistogram::bucketUpperBound(int index) {
+    int octave=index/PROFILER_BUCKETS_PER_OCTAVE, sub=index%PROFILER_BUCKETS_PER_OCTAVE;
+    return (float)(1ULL<<octave)*(1.0+(sub+1.0)/PROFILER_BUCKETS_PER_OCTAVE);
+}
+
+// Can be called from several threads (the solver records its own stages): atomic increments only.
+void LatencyHistogram::add(unsigned long long micros) {
+    __sync_fetch_and_add(&buckets[bucketIndex(micros)], 1);
+    __sync_fetch_and_add(&count, 1);
+    __sync_fetch_and_add(&sumMicros, micros);
+    unsigned long long oldMax=maxMicros;
+    while (micros>oldMax) {
+        unsigned long long seen=__sync_val_compare_and_swap(&maxMicros, oldMax, micros);
+        if (seen==oldMax) break;
+        oldMax=seen;
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i=0; i<PROFILER_NUM_BUCKETS; i++) buckets[i]+=other.buckets[i];
+    count+=other.count;
+    sumMicros+=other.sumMicros;
+    maxMicros=MAX(maxMicros, other.maxMicros);
+}
+
+float LatencyHistogram::getMean() const {
+    return count ? (float)sumMicros/count : 0;
+}
+
+float LatencyHistogram::getPercentile(float p) const {
+    if (count==0) return 0;
+    unsigned int target=(unsigned int)ceil(p*count), accumulated=0;
+    for (int i=0; i<PROFILER_NUM_BUCKETS; i++) {
+        accumulated+=buckets[i];
+        if (accumulated>=target && accumulated>0) return MIN(bucketUpperBound(i), (float)maxMicros);
+    }
+    return maxMicros;
+}
+
+// =========== StageProfiler ====================
+
+StageProfiler::StageProfiler() {
+    enabled=true;
+    currentState=0;
+    for (int i=0; i<PROFILER_MAX_STATES; i++) stateNames[i]="STATE "+ofToString(i);
+    reset();
+}
+
+void StageProfiler::setStateName(int state, string name) {
+    if (state>=0 && state<PROFILER_MAX_STATES) stateNames[state]=name;
+}
+
+void StageProfiler::reset() {
+    for (int i=0; i<PROFILER_MAX_STATES; i++)
+        for (int j=0; j<NUM_PROFILER_STAGES; j++) {
+            histograms[i][j].reset();
+            allocations[i][j]=0;
+        }
+}
+
+void StageProfiler::record(ProfilerStage stage, int state, unsigned long long micros) {
+    if (state<0 || state>=PROFILER_MAX_STATES) return;
+    histograms[state][stage].add(micros);
+}
+
+void StageProfiler::recordAllocations(ProfilerStage stage, int state, unsigned long long count) {
+    if (state<0 || state>=PROFILER_MAX_STATES) return;
+    allocations[state][stage]+=count;
+}
+
+string StageProfiler::getStageName(ProfilerStage stage) {
+    switch (stage) {
+        case STAGE_CAPTURE_LATENCY: return "capture latency";
+        case STAGE_UPDATE: return "update (total)";
+        case STAGE_MOTION_GATE: return "motion gate";
+        case STAGE_PREPROCESS_CAMERA: return "preprocess camera";
+        case STAGE_PREPROCESS_PROJECTOR: return "preprocess projector";
+        case STAGE_DETECT_PRINTED: return "detect printed";
+        case STAGE_TRACK_PRINTED: return "track printed";
+        case STAGE_DETECT_PROJECTED: return "detect projected";
+        case STAGE_DECODE_STRUCTURED_LIGHT: return "decode structured light";
+        case STAGE_BOARD_POSE: return "board pose";
+        case STAGE_CALIBRATE_CAMERA: return "calibrate camera";
+        case STAGE_CLEAN_CAMERA: return "clean camera";
+        case STAGE_CALIBRATE_PROJECTOR: return "calibrate projector";
+        case STAGE_CLEAN_PROJECTOR: return "clean projector";
+        case STAGE_STEREO_CALIBRATION: return "stereo calibration";
+        case STAGE_JOINT_EXTRINSICS: return "joint extrinsics";
+        case STAGE_UNDISTORT: return "undistort";
+        case STAGE_DRAW: return "draw (total)";
+        case STAGE_DRAW_PROJECTION: return "draw projection";
+        default: return "?";
+    }
+}
+
+static string formatStageLine(string name, const LatencyHistogram& h, unsigned long long allocations) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-22s %7u %9.3f %9.3f %9.3f %9.3f %8.1f", name.c_str(), h.getCount(),
+             h.getMean()/1000.0, h.getPercentile(0.5)/1000.0, h.getPercentile(0.99)/1000.0, h.getMax()/1000.0,
+             h.getCount() ? (double)allocations/h.getCount() : 0.0);
+    return line;
+}
+
+static const string stageTableHeader="stage                    count   mean ms    p50 ms    p99 ms    max ms   allocs";
+
+void StageProfiler::dump(string filename, bool absolute) const {
+    ofstream file(ofToDataPath(filename, absolute).c_str());
+    for (int state=0; state<PROFILER_MAX_STATES; state++) {
+        file << "== " << stateNames[state] << " ==" << endl << stageTableHeader << endl;
+        for (int stage=0; stage<NUM_PROFILER_STAGES; stage++) {
+            const LatencyHistogram& h=histograms[state][stage];
+            if (h.getCount()) file << formatStageLine(getStageName((ProfilerStage)stage), h, allocations[state][stage]) << endl;
+        }
+        file << endl;
+    }
+    ofLogNotice() << "Stage profile saved to " << filename;
+}
+
+void StageProfiler::drawOverlay(int x, int y) const {
+    string text="PROFILE (" + stateNames[currentState] + ")\n" + stageTableHeader + "\n";
+    for (int stage=0; stage<NUM_PROFILER_STAGES; stage++) {
+        const LatencyHistogram& h=histograms[currentState][stage];
+        if (h.getCount()) text+=formatStageLine(getStageName((ProfilerStage)stage), h, allocations[currentState][stage]) + "\n";
+    }
+    drawHighlightString(text, x, y, ofColor(0), ofColor(255));
+}
+
+// =========== ScopedStageTimer ====================
+
+ScopedStageTimer::ScopedStageTimer(StageProfiler& profiler, ProfilerStage stage, int state)
+: profiler(profiler), stage(stage) {
+    this->state=(state<0) ? profiler.getState() : state;
+    active=profiler.isEnabled();
+    countAllocations=active && AllocationCounter::isCountedThread();
+    startAllocations=countAllocations ? AllocationCounter::getCount() : 0;
+    startTime=active ? ofGetElapsedTimeMicros() : 0;
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+    if (active) profiler.record(stage, state, ofGetElapsedTimeMicros()-startTime);
+    if (countAllocations) profiler.recordAllocations(stage, state, AllocationCounter::getCount()-startAllocations);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "ofMain.h"
+#include "AllocationCounter.h"
+
+// ==================================================================
+// Low overhead per-stage latency measurements for the update/draw hot path.
+// Each stage keeps one histogram per calibration state (CAMERA_ONLY, PHASE1, PHASE2, AR_DEMO). The histograms have
+// logarithmic buckets (4 per octave, from 1 microsecond to ~1 minute), so recording a sample is a couple of atomic
+// increments (no allocation, no lock: the solver thread records its own stages too), and p50/p99 are read from the
+// buckets (precision ~20%, max is exact).
+// The timers of the main thread also record the heap allocations made inside the stage (see AllocationCounter).
+// Usage:
+//      {
+//          ScopedStageTimer timer(profiler, STAGE_DETECT_PRINTED);
+//          ... code to measure ...
+//      }
+// ==================================================================
+
+enum ProfilerStage {
+    STAGE_CAPTURE_LATENCY,      // capture timestamp -> start of processFrame (capture thread, see FrameRing)
+    STAGE_UPDATE,               // whole processFrame
+    STAGE_MOTION_GATE,          // difference with the previous frame
+    STAGE_PREPROCESS_CAMERA,    // calibrationCamera.addImageToProcess
+    STAGE_PREPROCESS_PROJECTOR, // calibrationProjector.addImageToProcess
+    STAGE_DETECT_PRINTED,       // calibrationCamera.generateCandidateImageObjectPoints
+    STAGE_TRACK_PRINTED,        // optical flow tracking of the printed pattern corners (AR_DEMO)
+    STAGE_DETECT_PROJECTED,     // concurrent dot detection + full image fallback (one sample per frame)
+    STAGE_DECODE_STRUCTURED_LIGHT, // Gray code decoding + local homographies (structured light board)
+    STAGE_BOARD_POSE,           // calibrationCamera.computeCandidateBoardPose
+    STAGE_CALIBRATE_CAMERA,     // calibrationCamera.calibrate
+    STAGE_CLEAN_CAMERA,         // calibrationCamera.clean
+    STAGE_CALIBRATE_PROJECTOR,  // calibrationProjector.calibrate (solver thread)
+    STAGE_CLEAN_PROJECTOR,      // calibrationProjector.simultaneousClean (solver thread)
+    STAGE_STEREO_CALIBRATION,   // stereoCalibrationCameraProjector (solver thread)
+    STAGE_JOINT_EXTRINSICS,     // joint refinement of the extrinsics (CalibrationGraph, solver thread)
+    STAGE_UNDISTORT,            // undistorted camera view (UndistortionCache)
+    STAGE_DRAW,                 // whole draw
+    STAGE_DRAW_PROJECTION,      // projections of board points in draw (ProjectionEngine)
+    NUM_PROFILER_STAGES
+};
+
+#define PROFILER_MAX_STATES 4
+#define PROFILER_BUCKETS_PER_OCTAVE 4
+#define PROFILER_NUM_BUCKETS (27*PROFILER_BUCKETS_PER_OCTAVE)
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    void reset();
+    void add(unsigned long long micros);
+    void merge(const LatencyHistogram& other);
+
+    unsigned int getCount() const {return count;}
+    float getMean() const; // microseconds
+    float getPercentile(float p) const; // microseconds, p in [0,1]
+    unsigned long long getMax() const {return maxMicros;}
+
+protected:
+    static int bucketIndex(unsigned long long micros);
+    static float bucketUpperBound(int index);
+
+    unsigned int buckets[PROFILER_NUM_BUCKETS];
+    unsigned int count;
+    unsigned long long sumMicros, maxMicros;
+};
+
+class StageProfiler {
+public:
+    StageProfiler();
+
+    void setEnabled(bool enabled) {this->enabled=enabled;}
+    bool isEnabled() const {return enabled;}
+    void setStateName(int state, string name);
+    void setState(int state) {currentState=state;}
+    int getState() const {return currentState;}
+    void reset();
+
+    void record(ProfilerStage stage, int state, unsigned long long micros);
+    void recordAllocations(ProfilerStage stage, int state, unsigned long long allocations);
+    unsigned long long getAllocations(ProfilerStage stage, int state) const {return allocations[state][stage];}
+    const LatencyHistogram& getHistogram(ProfilerStage stage, int state) const {return histograms[state][stage];}
+
+    // Text table (one block per state): count, mean, p50, p99 and max in milliseconds, mean allocations per call.
+    void dump(string filename, bool absolute = false) const;
+    // Same table for the current state, on screen:
+    void drawOverlay(int x, int y) const;
+
+    static string getStageName(ProfilerStage stage);
+
+protected:
+    bool enabled;
+    int currentState;
+    string stateNames[PROFILER_MAX_STATES];
+    LatencyHistogram histograms[PROFILER_MAX_STATES][NUM_PROFILER_STAGES];
+    unsigned long long allocations[PROFILER_MAX_STATES][NUM_PROFILER_STAGES]; // (main thread stages only)
+};
+
+class ScopedStageTimer {
+public:
+    // state<0 means the current state of the profiler
+    ScopedStageTimer(StageProfiler& profiler, ProfilerStage stage, int state = -1);
+    ~ScopedStageTimer();
+
+protected:
+    StageProfiler& profiler;
+    ProfilerStage stage;
+    int state;
+    bool active, countAllocations;
+    unsigned long long startTime, startAllocations;
+};
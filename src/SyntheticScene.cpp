@@ -0,0 +1,166 @@
+#include "SyntheticScene.h"
+
+using namespace cv;
+
+const int texturePixelsPerSquare = 64;
+
+SyntheticScene::SyntheticScene() {
+    squareSize=1;
+    blurSigma=0.8;
+    noiseSigma=2;
+    ambient=0.6;
+    rng=RNG(12345); // (same poses on every run)
+}
+
+void SyntheticScene::setCamera(const SyntheticDevice& camera) {
+    this->camera=camera;
+    buildDistortionMaps();
+}
+
+void SyntheticScene::setProjector(const SyntheticDevice& projector, const Mat& rotCamToProj, const Mat& transCamToProj) {
+    this->projector=projector;
+    rotCamToProj.reshape(1, 3).convertTo(this->rotCamToProj, CV_64F);
+    transCamToProj.reshape(1, 3).convertTo(this->transCamToProj, CV_64F);
+    projectorImage=Mat::zeros(projector.resolution, CV_8UC1);
+}
+
+void SyntheticScene::setBoard(cv::Size patternSize, float squareSize) {
+    this->patternSize=patternSize;
+    this->squareSize=squareSize;
+
+    // Squares: (patternSize + 1), plus one white square of margin all around:
+    int squaresX=patternSize.width+3, squaresY=patternSize.height+3;
+    boardTexture.create(squaresY*texturePixelsPerSquare, squaresX*texturePixelsPerSquare, CV_8UC1);
+    for (int y=0; y<boardTexture.rows; y++) {
+        uchar* row=boardTexture.ptr<uchar>(y);
+        int sy=y/texturePixelsPerSquare;
+        for (int x=0; x<boardTexture.cols; x++) {
+            int sx=x/texturePixelsPerSquare;
+            bool margin=(sx==0 || sy==0 || sx==squaresX-1 || sy==squaresY-1);
+            row[x]=(margin || (sx+sy)%2==0) ? 230 : 20;
+        }
+    }
+    // Texture pixel (u, v) -> board coordinates: the inner corner (0, 0) is at the texture pixel (2, 2) squares:
+    double scale=squareSize/texturePixelsPerSquare;
+    textureToBoard=(Mat_<double>(3, 3) << scale, 0, -2*squareSize, 0, scale, -2*squareSize, 0, 0, 1);
+
+    boardPoints.clear();
+    for (int i=0; i<patternSize.height; i++)
+        for (int j=0; j<patternSize.width; j++) boardPoints.push_back(Point3f(j*squareSize, i*squareSize, 0));
+}
+
+void SyntheticScene::setProjectedDots(const vector<Point2f>& dots, float radius) {
+    projectedDots=dots;
+    projectorImage=Mat::zeros(projector.resolution, CV_8UC1);
+    for (int i=0; i<dots.size(); i++) circle(projectorImage, Point(cvRound(dots[i].x*16), cvRound(dots[i].y*16)), cvRound(radius*16), Scalar(255), -1, CV_AA, 4);
+}
+
+void SyntheticScene::setProjectedImage(const Mat& image) {
+    projectedDots.clear();
+    image.copyTo(projectorImage);
+}
+
+// For each DISTORTED camera pixel, the position in the ideal (undistorted) image:
+void SyntheticScene::buildDistortionMaps() {
+    vector<Point2f> pixels, normalized;
+    pixels.reserve(camera.resolution.area());
+    for (int y=0; y<camera.resolution.height; y++)
+        for (int x=0; x<camera.resolution.width; x++) pixels.push_back(Point2f(x, y));
+    undistortPoints(Mat(pixels), normalized, camera.cameraMatrix, camera.distCoeffs, Mat(), camera.cameraMatrix);
+    Mat map(camera.resolution, CV_32FC2, &normalized[0]);
+    convertMaps(map, Mat(), distortMap1, distortMap2, CV_16SC2);
+}
+
+Mat SyntheticScene::boardHomography(const Mat& K, const Mat& R, const Mat& t) const {
+    Mat H(3, 3, CV_64F);
+    R.col(0).copyTo(H.col(0));
+    R.col(1).copyTo(H.col(1));
+    t.copyTo(H.col(2));
+    return K*H;
+}
+
+void SyntheticScene::getCornerImagePoints(const Mat& rotation, const Mat& translation, vector<Point2f>& imagePoints) const {
+    projectPoints(Mat(boardPoints), rotation, translation, camera.cameraMatrix, camera.distCoeffs, imagePoints);
+}
+
+bool SyntheticScene::randomPose(Mat& rotation, Mat& translation, bool requireDots, float minDistance, float maxDistance, float maxAngleDegrees) {
+    Point3f center((patternSize.width-1)*squareSize/2, (patternSize.height-1)*squareSize/2, 0);
+    // (with the dots: aim at the paper on the right of the chessboard, where the projected pattern should fall)
+    Point3f aim=requireDots ? Point3f((patternSize.width+2)*squareSize, center.y, 0) : center;
+    for (int attempt=0; attempt<1000; attempt++) {
+        double maxAngle=maxAngleDegrees*CV_PI/180;
+        Mat r=(Mat_<double>(3, 1) << rng.uniform(-maxAngle, maxAngle), rng.uniform(-maxAngle, maxAngle), rng.uniform(-maxAngle/2, maxAngle/2));
+        double distance=rng.uniform((double)minDistance, (double)maxDistance);
+        // Aimed point somewhere around the optical axis:
+        double spread=requireDots ? 0.05 : 0.2;
+        Mat target=(Mat_<double>(3, 1) << rng.uniform(-spread, spread)*distance, rng.uniform(-spread, spread)*distance, distance);
+        Mat R;
+        Rodrigues(r, R);
+        Mat t=target-R*(Mat_<double>(3, 1) << aim.x, aim.y, 0);
+
+        // All the corners (with a margin) in the camera image:
+        vector<Point2f> corners;
+        projectPoints(Mat(boardPoints), r, t, camera.cameraMatrix, camera.distCoeffs, corners);
+        Rect inside(20, 20, camera.resolution.width-40, camera.resolution.height-40);
+        bool ok=true;
+        for (int i=0; i<corners.size() && ok; i++) ok=inside.contains(corners[i]);
+        if (!ok) continue;
+
+        if (requireDots && !projectedDots.empty()) {
+            // Dots on the board plane (projector -> board homography), outside the printed squares, and in the camera image:
+            Mat Rp, rp, tp;
+            composeRT(r, t, rotCamToProj, transCamToProj, rp, tp);
+            Rodrigues(rp, Rp);
+            Mat H=boardHomography(projector.cameraMatrix, Rp, tp).inv();
+            vector<Point2f> onBoard, inCamera;
+            perspectiveTransform(Mat(projectedDots), onBoard, H);
+            Rect_<float> squares(-1.5*squareSize, -1.5*squareSize, (patternSize.width+2)*squareSize, (patternSize.height+2)*squareSize);
+            for (int i=0; i<onBoard.size() && ok; i++) ok=!squares.contains(onBoard[i]);
+            if (!ok) continue;
+            vector<Point3f> dots3d;
+            for (int i=0; i<onBoard.size(); i++) dots3d.push_back(Point3f(onBoard[i].x, onBoard[i].y, 0));
+            projectPoints(Mat(dots3d), r, t, camera.cameraMatrix, camera.distCoeffs, inCamera);
+            for (int i=0; i<inCamera.size() && ok; i++) ok=inside.contains(inCamera[i]);
+            if (!ok) continue;
+        }
+        rotation=r;
+        translation=t;
+        return true;
+    }
+    return false;
+}
+
+void SyntheticScene::render(const Mat& rotation, const Mat& translation, Mat& frame) {
+    Mat R, r, t;
+    rotation.reshape(1, 3).convertTo(r, CV_64F);
+    translation.reshape(1, 3).convertTo(t, CV_64F);
+    Rodrigues(r, R);
+
+    // (1) Board reflectance seen by the (ideal) camera:
+    Mat Hc=boardHomography(camera.cameraMatrix, R, t);
+    warpPerspective(boardTexture, board, Hc*textureToBoard, camera.resolution, INTER_LINEAR, BORDER_CONSTANT, Scalar(230)); // (white paper)
+
+    // (2) Projector light on the board, seen by the camera (camera <- board <- projector):
+    Mat Rp, rp, tp;
+    composeRT(r, t, rotCamToProj, transCamToProj, rp, tp);
+    Rodrigues(rp, Rp);
+    Mat Hp=boardHomography(projector.cameraMatrix, Rp, tp);
+    warpPerspective(projectorImage, light, Hc*Hp.inv(), camera.resolution, INTER_LINEAR, BORDER_CONSTANT, Scalar(0));
+
+    // (3) Reflectance * (ambient + light), blur, noise:
+    board.convertTo(board, CV_32F, 1.0/255);
+    light.convertTo(light, CV_32F, 1.0/255);
+    gray=board.mul(light*(1-ambient)+ambient)*255;
+    if (blurSigma>0) GaussianBlur(gray, gray, cv::Size(0, 0), blurSigma);
+    if (noiseSigma>0) {
+        Mat noise(gray.size(), CV_32F);
+        rng.fill(noise, RNG::NORMAL, 0, noiseSigma);
+        gray+=noise;
+    }
+    gray.convertTo(gray, CV_8U);
+
+    // (4) Lens distortion, and RGB:
+    Mat distorted;
+    remap(gray, distorted, distortMap1, distortMap2, INTER_LINEAR, BORDER_CONSTANT, Scalar(0));
+    cvtColor(distorted, frame, CV_GRAY2RGB);
+}
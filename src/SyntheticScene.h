@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+// ==================================================================
+// Synthetic camera frames with KNOWN camera/projector intrinsics and extrinsics (benchmarks and regression tests,
+// without a printed board waved in front of the real hardware):
+// - the printed chessboard (same geometry as chessboard_8x5.pdf / settingsPatternCamera.yml) lies on the plane z=0 of
+//   the board coordinates (inner corner (i, j) at (j*squareSize, i*squareSize, 0)), posed in camera coordinates; it is
+//   printed on a large white sheet (the projected dots must fall on the white paper, NOT on the squares),
+// - the projector image (e.g. the projected circle grid) lights the board through the projector pinhole (no projector
+//   distortion), the camera sees board reflectance * (ambient + projector light),
+// - then blur, noise, and the camera lens distortion (remap with maps computed once per camera).
+// Frames are RGB (as the grabber frames), of the camera resolution.
+// ==================================================================
+
+struct SyntheticDevice {
+    cv::Size resolution;
+    cv::Mat cameraMatrix, distCoeffs; // (CV_64F)
+};
+
+class SyntheticScene {
+public:
+    SyntheticScene();
+
+    void setCamera(const SyntheticDevice& camera);
+    void setProjector(const SyntheticDevice& projector, const cv::Mat& rotCamToProj, const cv::Mat& transCamToProj);
+    void setBoard(cv::Size patternSize, float squareSize);
+    void setImageQuality(float blurSigma, float noiseSigma, float ambient = 0.6) {this->blurSigma=blurSigma; this->noiseSigma=noiseSigma; this->ambient=ambient;}
+
+    // Projector image (CV_8UC1, projector resolution) with white dots (e.g. the candidate image points of the projector):
+    void setProjectedDots(const vector<cv::Point2f>& dots, float radius);
+    void setProjectedImage(const cv::Mat& image);
+
+    // Random board pose, fully visible in the camera (and, if requireDots, with all the projected dots visible on the white
+    // paper, on the right of the chessboard):
+    bool randomPose(cv::Mat& rotation, cv::Mat& translation, bool requireDots, float minDistance, float maxDistance, float maxAngleDegrees);
+    void render(const cv::Mat& rotation, const cv::Mat& translation, cv::Mat& frame);
+
+    // Ground truth:
+    const vector<cv::Point3f>& getBoardPoints() const {return boardPoints;}
+    void getCornerImagePoints(const cv::Mat& rotation, const cv::Mat& translation, vector<cv::Point2f>& imagePoints) const;
+    const SyntheticDevice& getCamera() const {return camera;}
+    const SyntheticDevice& getProjector() const {return projector;}
+    void getExtrinsics(cv::Mat& rotation, cv::Mat& translation) const {rotation=rotCamToProj.clone(); translation=transCamToProj.clone();}
+
+protected:
+    cv::Mat boardHomography(const cv::Mat& K, const cv::Mat& R, const cv::Mat& t) const; // board plane -> image (no distortion)
+    void buildDistortionMaps();
+
+    SyntheticDevice camera, projector;
+    cv::Mat rotCamToProj, transCamToProj;
+    cv::Size patternSize;
+    float squareSize;
+    float blurSigma, noiseSigma, ambient;
+
+    cv::Mat boardTexture, textureToBoard; // reflectance (1 white square of margin), and texture pixel -> board coordinates
+    vector<cv::Point3f> boardPoints;
+    vector<cv::Point2f> projectedDots;
+    cv::Mat projectorImage;
+    cv::Mat distortMap1, distortMap2;
+    cv::Mat board, light, gray; // (render buffers)
+    cv::RNG rng;
+};
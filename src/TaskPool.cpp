@@ -0,0 +1,138 @@
+#include "TaskPool.h"
+#include <unistd.h>
+#include <pthread.h>
+
+// =========== TaskGroup ====================
+
+TaskGroup::TaskGroup() {
+    remaining=0;
+    pool=NULL;
+}
+
+void TaskGroup::wait() {
+    for (;;) {
+        mutex.lock();
+        bool finished=(remaining==0);
+        mutex.unlock();
+        if (finished) return; // (the last job released the mutex: nothing touches the group anymore)
+        // Help instead of sleeping (this is also what makes nested use of the pool safe):
+        if (!pool || !pool->runPending(this)) done.tryWait(2);
+    }
+}
+
+// =========== TaskPool ====================
+
+static TaskPool sharedPool;
+static pthread_once_t sharedPoolOnce=PTHREAD_ONCE_INIT;
+
+void TaskPool::setupShared() {
+    sharedPool.setup();
+}
+
+TaskPool& TaskPool::shared() {
+    pthread_once(&sharedPoolOnce, setupShared);
+    return sharedPool;
+}
+
+TaskPool::TaskPool() : jobsAvailable(0, 1<<30) {
+    running=false;
+}
+
+TaskPool::~TaskPool() {
+    stop();
+}
+
+void TaskPool::setup(int numThreads) {
+    stop();
+    if (numThreads<=0) numThreads=MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+    running=true;
+    // The thread that waits for a group works too, so one worker less than cores:
+    for (int i=0; i<numThreads-1; i++) {
+        workers.push_back(new Worker(this));
+        workers.back()->startThread(true, false);
+    }
+}
+
+void TaskPool::stop() {
+    if (!running) return;
+    running=false;
+    for (int i=0; i<workers.size(); i++) jobsAvailable.set();
+    for (int i=0; i<workers.size(); i++) {
+        workers[i]->waitForThread(true);
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+void TaskPool::push(const Job& job) {
+    jobsMutex.lock();
+    jobs.push_back(job);
+    jobsMutex.unlock();
+    jobsAvailable.set();
+}
+
+bool TaskPool::pop(Job& job, TaskGroup* group) {
+    bool found=false;
+    jobsMutex.lock();
+    for (deque<Job>::iterator it=jobs.begin(); it!=jobs.end(); ++it) {
+        if (group && it->group!=group) continue;
+        job=*it;
+        jobs.erase(it);
+        found=true;
+        break;
+    }
+    jobsMutex.unlock();
+    return found;
+}
+
+void TaskPool::execute(const Job& job) {
+    job.task->run(job.begin, job.end);
+    // Last access to the group (the waiter may destroy it right after the unlock):
+    TaskGroup* group=job.group;
+    group->mutex.lock();
+    if (--group->remaining==0) group->done.set();
+    group->mutex.unlock();
+}
+
+bool TaskPool::runPending(TaskGroup* group) {
+    Job job;
+    if (!pop(job, group)) return false;
+    execute(job);
+    return true;
+}
+
+void TaskPool::submit(ParallelTask& task, TaskGroup& group, int begin, int end) {
+    group.mutex.lock();
+    group.pool=this;
+    group.remaining++;
+    group.mutex.unlock();
+    Job job;
+    job.task=&task;
+    job.begin=begin;
+    job.end=end;
+    job.group=&group;
+    push(job);
+}
+
+void TaskPool::parallelFor(ParallelTask& task, int count, int grain) {
+    if (count<=0) return;
+    // A few chunks per thread (load balancing), but not smaller than grain:
+    int chunks=MIN(getNumThreads()*4, (count+grain-1)/MAX(grain, 1));
+    if (chunks<=1) {
+        task.run(0, count);
+        return;
+    }
+    TaskGroup group;
+    for (int i=0; i<chunks; i++) {
+        int begin=(int)((long long)count*i/chunks), end=(int)((long long)count*(i+1)/chunks);
+        if (end>begin) submit(task, group, begin, end);
+    }
+    group.wait();
+}
+
+void TaskPool::Worker::threadedFunction() {
+    while (isThreadRunning() && pool->running) {
+        if (!pool->jobsAvailable.tryWait(100)) continue;
+        pool->runPending();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Event.h"
+#include "Poco/Semaphore.h"
+
+// ==================================================================
+// Small pool of worker threads (one per core) shared by the whole application, to spread work across all cores:
+//
+// (1) parallel loop over [0, count): derive from ParallelTask and implement run(begin, end):
+//          TaskPool::shared().parallelFor(task, count);
+// (2) independent tasks, joined later (each task is run(0, 1)):
+//          TaskGroup group;
+//          TaskPool::shared().submit(taskA, group);
+//          TaskPool::shared().submit(taskB, group);
+//          ... (the calling thread can do something else here)
+//          group.wait();
+//
+// The waiting thread also runs pending jobs OF THE SAME GROUP, so tasks can themselves use the pool (no deadlock), and
+// a frame thread waiting for a short parallel loop never picks up a long job of someone else (e.g. the solver's
+// leave-one-out calibrations).
+// The shared pool is created on first use (once, even if the first calls come from several threads).
+// A group (usually on the stack) can be destroyed as soon as wait() returns: the counter of remaining jobs is updated
+// under the group mutex, which wait() takes before returning, so the last job does not touch the group after that.
+// ==================================================================
+
+class ParallelTask {
+public:
+    virtual ~ParallelTask() {}
+    virtual void run(int begin, int end) = 0;
+};
+
+class TaskPool;
+
+class TaskGroup {
+public:
+    TaskGroup();
+    void wait();
+    bool isDone() const {return remaining==0;}
+
+protected:
+    friend class TaskPool;
+    volatile int remaining;
+    ofMutex mutex; // (remaining, done)
+    Poco::Event done;
+    TaskPool* pool;
+};
+
+class TaskPool {
+public:
+    static TaskPool& shared();
+
+    TaskPool();
+    ~TaskPool();
+
+    void setup(int numThreads = 0); // 0: one thread per core
+    void stop();
+    int getNumThreads() const {return workers.size()+1;} // (the calling thread works too)
+
+    void parallelFor(ParallelTask& task, int count, int grain = 1);
+    void submit(ParallelTask& task, TaskGroup& group, int begin = 0, int end = 1);
+
+    // Run one pending job in the calling thread (false if there was none). group: only a job of this group (NULL: any).
+    bool runPending(TaskGroup* group = NULL);
+
+protected:
+    struct Job {
+        ParallelTask* task;
+        int begin, end;
+        TaskGroup* group;
+    };
+
+    class Worker : public ofThread {
+    public:
+        Worker(TaskPool* pool) : pool(pool) {}
+        void threadedFunction();
+        TaskPool* pool;
+    };
+    friend class Worker;
+
+    void push(const Job& job);
+    bool pop(Job& job, TaskGroup* group);
+    static void setupShared();
+    static void execute(const Job& job);
+
+    vector<Worker*> workers;
+    deque<Job> jobs;
+    ofMutex jobsMutex;
+    Poco::Semaphore jobsAvailable;
+    volatile bool running;
+};
@@ -0,0 +1,73 @@
+#include "UndistortionCache.h"
+
+using namespace cv;
+
+// One band of rows per index (the maps give absolute source coordinates, so each band is independent):
+class RemapTask : public ParallelTask {
+public:
+    RemapTask(const Mat& src, Mat& dst, const Mat& map1, const Mat& map2, int interpolation, int bandHeight)
+    : src(src), dst(dst), map1(map1), map2(map2), interpolation(interpolation), bandHeight(bandHeight) {}
+    void run(int begin, int end) {
+        for (int band=begin; band<end; band++) {
+            Range rows(band*bandHeight, MIN((band+1)*bandHeight, dst.rows));
+            Mat dstBand=dst.rowRange(rows);
+            remap(src, dstBand, map1.rowRange(rows), map2.rowRange(rows), interpolation, BORDER_CONSTANT);
+        }
+    }
+    const Mat& src;
+    Mat& dst;
+    const Mat& map1;
+    const Mat& map2;
+    int interpolation, bandHeight;
+};
+
+// Compares the intrinsics with the cached ones (CV_64F, continuous) in place: called every frame, so no conversion into
+// temporary matrices (other depths than float/double are never equal, the maps are then rebuilt):
+static bool sameValues(const Mat& a, const Mat& cached) {
+    if (a.empty() || cached.empty() || a.total()*a.channels()!=cached.total()) return false;
+    if (a.depth()!=CV_32F && a.depth()!=CV_64F) return false;
+    const double* c=cached.ptr<double>();
+    int cols=a.cols*a.channels();
+    for (int r=0; r<a.rows; r++) {
+        if (a.depth()==CV_64F) {
+            const double* row=a.ptr<double>(r);
+            for (int i=0; i<cols; i++, c++) if (row[i]!=*c) return false;
+        } else {
+            const float* row=a.ptr<float>(r);
+            for (int i=0; i<cols; i++, c++) if ((double)row[i]!=*c) return false;
+        }
+    }
+    return true;
+}
+
+UndistortionCache::UndistortionCache() {
+    ready=false;
+    version=0;
+}
+
+bool UndistortionCache::update(const Mat& cameraMatrix, const Mat& distCoeffs, cv::Size imageSize) {
+    if (ready && imageSize==this->imageSize && sameValues(cameraMatrix, this->cameraMatrix) && sameValues(distCoeffs, this->distCoeffs)) return false;
+    if (cameraMatrix.empty() || imageSize.area()==0) return false;
+
+    cameraMatrix.convertTo(this->cameraMatrix, CV_64F);
+    distCoeffs.convertTo(this->distCoeffs, CV_64F);
+    this->imageSize=imageSize;
+    // Same camera matrix for the undistorted image (as Calibration::undistort):
+    initUndistortRectifyMap(this->cameraMatrix, this->distCoeffs, Mat(), this->cameraMatrix, imageSize, CV_16SC2, map1, map2);
+    ready=true;
+    version++;
+    return true;
+}
+
+void UndistortionCache::apply(const Mat& src, Mat& dst, int interpolation) {
+    if (!ready) {
+        src.copyTo(dst);
+        return;
+    }
+    dst.create(imageSize, src.type());
+    // About 4 bands per thread (load balancing), but not too thin:
+    int bands=MIN(4*TaskPool::shared().getNumThreads(), MAX(imageSize.height/16, 1));
+    int bandHeight=(imageSize.height+bands-1)/bands;
+    RemapTask task(src, dst, map1, map2, interpolation, bandHeight);
+    TaskPool::shared().parallelFor(task, (imageSize.height+bandHeight-1)/bandHeight);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "TaskPool.h"
+
+// ==================================================================
+// Undistortion of the camera frames with cached maps:
+// - the maps are computed ONCE per version of the intrinsics (initUndistortRectifyMap), in the compact fixed-point
+//   format (CV_16SC2 + CV_16UC1: 6 bytes per pixel instead of 8, and the fast remap path),
+// - update() compares the intrinsics with the ones of the cached maps (a few doubles), so the maps are rebuilt
+//   automatically after a calibrate() or a load() that changed them,
+// - apply() runs remap on horizontal bands of the image, in parallel on the TaskPool.
+// ==================================================================
+
+class UndistortionCache {
+public:
+    UndistortionCache();
+
+    // Returns true if the maps were (re)built:
+    bool update(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize);
+    void invalidate() {ready=false;}
+    bool isReady() const {return ready;}
+    int getVersion() const {return version;} // incremented each time the maps are rebuilt
+
+    // dst must NOT be src (it is allocated if needed, and then reused)
+    void apply(const cv::Mat& src, cv::Mat& dst, int interpolation = cv::INTER_LINEAR);
+
+protected:
+    cv::Mat cameraMatrix, distCoeffs; // intrinsics of the cached maps (CV_64F)
+    cv::Size imageSize;
+    cv::Mat map1, map2;
+    bool ready;
+    int version;
+};
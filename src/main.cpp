@@ -1,11 +1,56 @@
 #include "testApp.h"
 #include "ofAppGlutWindow.h"
+#include "ofAppNoWindow.h"
+#include "BenchmarkSuite.h"
 
+// Headless replay (no camera, no display), for profiling and regression tests on the build servers:
+//   cameraProjectorCalib --replay <directory of frames | movie file> [--mode camera|projector|ar] [--fps 30]
+// The frames go through the same state machine as the live camera, as fast as possible, and a report (frames/sec, number
+// of acquired boards) is printed at the end.
+// Synthetic benchmark (detection and calibration time, accuracy against ground truth, see BenchmarkSuite.h):
+//   cameraProjectorCalib --benchmark [--output benchmark.txt] [--baseline benchmarkBaseline.txt]
+// (exit code 1 if a check failed)
 
+int main(int argc, char* argv[]) {
+    string replayPath="";
+    CalibState replayMode=CAMERA_ONLY;
+    float replayFps=30;
+    bool benchmark=false;
+    string benchmarkOutput="benchmark.txt", benchmarkBaseline="";
+    for (int i=1; i<argc; i++) {
+        string arg=argv[i];
+        if (arg=="--benchmark") benchmark=true;
+        else if (i==argc-1) break; // (the other options have a value)
+        else if (arg=="--output") benchmarkOutput=argv[++i];
+        else if (arg=="--baseline") benchmarkBaseline=argv[++i];
+        else if (arg=="--replay") replayPath=argv[++i];
+        else if (arg=="--fps") replayFps=ofToFloat(argv[++i]);
+        else if (arg=="--mode") {
+            string mode=argv[++i];
+            if (mode=="projector") replayMode=CAMERA_AND_PROJECTOR_PHASE1;
+            else if (mode=="ar") replayMode=AR_DEMO;
+            else replayMode=CAMERA_ONLY;
+        }
+    }
 
-int main() {
-	ofAppGlutWindow window;
-	//ofSetupOpenGL(&window, 1440+PROJ_WIDTH, 990, OF_WINDOW); // width computer screen + width projector screen / height projector
-    ofSetupOpenGL(&window, 1440+PROJ_WIDTH, 990, OF_FULLSCREEN); // width computer screen + width projector screen / height projector
-	ofRunApp(new testApp());
+    if (benchmark) {
+        ofAppNoWindow window;
+        ofSetupOpenGL(&window, CAM_WIDTH, CAM_HEIGHT, OF_WINDOW);
+        BenchmarkSuite suite;
+        return suite.run(benchmarkOutput, benchmarkBaseline) ? 0 : 1;
+    }
+    
+    testApp* app=new testApp();
+
+    if (replayPath!="") {
+        ofAppNoWindow window;
+        app->setReplay(replayPath, replayMode, replayFps);
+        ofSetupOpenGL(&window, CAM_WIDTH, CAM_HEIGHT, OF_WINDOW);
+        ofRunApp(app);
+    } else {
+        ofAppGlutWindow window;
+        //ofSetupOpenGL(&window, 1440+PROJ_WIDTH, 990, OF_WINDOW); // width computer screen + width projector screen / height projector
+        ofSetupOpenGL(&window, 1440+PROJ_WIDTH, 990, OF_FULLSCREEN); // width computer screen + width projector screen / height projector
+        ofRunApp(app);
+    }
 }
@@ -1,34 +1,99 @@
 #include "testApp.h"
+#include <stdarg.h>
 
 using namespace ofxCv;
 using namespace cv;
 
 const float diffThreshold = 3.0; // maximum amount of movement between successive frames (must be smaller in order to add a board)
 const float timeThreshold = 1.0; // minimum time between snapshots (seconds)
+const int boardPrecheckLevel = 1; // the "is the printed pattern visible?" test runs on this level of the gray pyramid (image 2^level times smaller)
+const int captureRingSize = 4; // frames buffered between the capture thread and the processing (the capture overwrites the oldest one when full)
+const float eventLogTimingPeriod = 5; // seconds between two stage timing summaries in the event log (data/events.jsonl)
+const float arDisplayLatency = 0.03; // AR_DEMO: seconds from the end of draw() to the projector light (tune with the loopback mode, key 'l')
+const float arMaxPrediction = 0.1; // AR_DEMO: the pose is not extrapolated further than this (seconds) after the last detection
+const int maxARTargets = 4; // AR_DEMO, multi-target mode ('n'): at most this many printed boards are tracked at the same time
+const int steadyStateFrames = 30; // frames in the same state before AR_DEMO/PHASE1 are expected to make no heap allocation
+const int frameArenaSize = 1024*1024; // per frame scratch memory (bytes) of the OpenCV temporaries of the corner tracking (pyramids); overflows go to the heap (see the profiler overlay)
+const int motionGateDecimation = 1; // compare one pixel every motionGateDecimation pixels (in x and y) for the motion test (2 or 4 is enough for 1080p+ cameras)
 
 const int preCalibrateCameraTimes = 20; // this is for calibrating the camera BEFORE starting projector calibration. 
+const int fullRecalibrationEvery = 5; // incremental calibration: full re-calibration (intrinsics + all board poses) every this many boards
+const float recalibrationErrorJump = 2.0; // ... or when the reprojection error of a new board is this many times larger than the total error
 const int startCleaningCamera = 8; // start cleaning outliers after this many samples (10 is ok...). Should be < than preCalibrateCameraTimes
 const float maxErrorCamera=0.2;
+const CleaningMode cleaningMode=CLEAN_BATCH; // how the boards with large reprojection error are removed (see BoardCleaner.h)
+const bool useCalibrationGraph = true; // refine the camera/projector extrinsics jointly with all the board poses (see CalibrationGraph.h)
 
 const float maxErrorProjector=0.25;
 const int startCleaningProjector = 8;
 const int startDynamicProjectorPattern=5; // after this number of projector/camera calibration, the projection will start following the 
 // printed pattern to facilitate larger exploration of the field of view. If this number is larger than minNumGoodBoards, then this will never 
 // happen automatically. 
+const int structuredLightSettleFrames = 3; // structured light: frames to wait after changing the projected pattern (projector + camera latency)
+const int structuredLightSubdivision = 4; // structured light: projector points on a grid this many times finer than the printed chessboard
+const bool useCoverageAcceptance = true; // reject the boards that add no new image cells and whose pose is close to an accepted one (see CoverageMap.h)
+const int coverageGridCols = 8, coverageGridRows = 6; // coverage grid over the camera and projector images
+const int coverageMinNewCells = 2; // ... a board is new if it has points in at least this many empty cells
+const float coverageMinAngle = 10; // ... or if its rotation differs by this many degrees from all the accepted boards
+const float coverageMinTranslation = 0.15; // ... or its position by this fraction of the distance to the board
 const int minNumGoodBoards=20; // after this number of simultaneoulsy acquired "good" boards, IF the projector total reprojection error is smaller than a certain threshold, we end calibration (and move to AR mode automatically)
 
 
 // ****** INITIAL MODE ******
 CalibState InitialMode=AR_DEMO;//CAMERA_AND_PROJECTOR_PHASE1;//CAMERA_ONLY; //;// AR_DEMO;
 
+// printf for the overlay texts (valid until the next call; drawHighlightString makes its own copy):
+static const char* formatText(const char* format, ...) {
+    static char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return text;
+}
+
+testApp::testApp() {
+    replayMode=false;
+    replayFps=30;
+    replayInitialMode=CAMERA_ONLY;
+    boardsAcceptedCamera=0;
+    boardsAcceptedStereo=0;
+}
+
+void testApp::setReplay(string path, CalibState initialMode, float fps) {
+    replayMode=true;
+    replayPath=path;
+    replayInitialMode=initialMode;
+    replayFps=fps;
+}
+
 void testApp::setup() {
-	ofSetVerticalSync(true);
+    // Allocation accounting of the frame processing (this thread), and its scratch memory:
+    AllocationCounter::setCountedThread();
+    frameArena.setup(frameArenaSize);
+    cornerTracker.setArena(&frameArena);
+    TaskPool::shared(); // (workers started here, before the solver and capture threads can use the pool)
+    frameStartAllocations=AllocationCounter::getCount();
+    lastFrameAllocations=0;
+    framesInState=0;
+    steadyStateAllocatingFrames=0;
+    
+    if (replayMode) {
+        // No camera (and no OpenGL context): frames come from the recording.
+        if (!replay.open(replayPath, CAM_WIDTH, CAM_HEIGHT, replayFps)) {
+            ofLogError() << "Nothing to replay in " << replayPath;
+            std::exit(1);
+        }
+    } else {
+        ofSetVerticalSync(true);
+        
+        // The camera is polled by its own thread (not at the vsync rate of update()):
+        if (!capture.setup(CAM_WIDTH, CAM_HEIGHT, captureRingSize)) ofLogError() << "Cannot open the camera";
+        camImage.allocate(CAM_WIDTH, CAM_HEIGHT, OF_IMAGE_COLOR);
+        imitate(undistorted, camImage);
+    }
     
-    cam.listDevices();
-	cam.initGrabber(CAM_WIDTH, CAM_HEIGHT);
-	imitate(undistorted, cam);
-	imitate(previous, cam);
-	imitate(diff, cam);
+    motionGate.setDecimation(motionGateDecimation);
     
 #ifdef MOVIE_PLAY
     eyeMovie.loadMovie("movies/ojo.mov");
@@ -44,6 +109,29 @@ void testApp::setup() {
     //       To make things more clear, we will do this also for objects of type camera. 
     calibrationCamera.setImagerResolution(cv::Size(CAM_WIDTH, CAM_HEIGHT));
     calibrationProjector.setImagerResolution(cv::Size(PROJ_WIDTH, PROJ_HEIGHT));
+    
+    // Fast rejection of the frames without printed pattern (the printed pattern is a chessboard), before the full detection:
+    boardPrecheck.setup(calibrationCamera.myPatternShape.getPatternSize());
+    // Grayscale image and pyramid computed once per frame, for all the consumers (fast board test, tracking...):
+    preprocessor.setup(boardPrecheckLevel);
+    // Image space detection of the projected dots (run concurrently with the printed pattern detection in PHASE2), with
+    // the grid type and dot color of the projector pattern file:
+    if (!projectedDetector.setup(calibrationProjector)) ofLogNotice() << "Projector pattern: not a circle grid, no concurrent detection";
+    ofColor projectorDotColor=calibrationProjector.myPatternShape.color;
+    projectorSegmentsGray=(projectorDotColor.r==projectorDotColor.g && projectorDotColor.g==projectorDotColor.b);
+    // Projector pattern following the printed one (the layout is computed once, then placed on the board every frame):
+    vector<Point3f> canonicalLayout=Calibration::createObjectPointsDynamic(Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(0, 1, 0), calibrationProjector.myPatternShape);
+    if (FollowingLayout::matches(calibrationProjector.myPatternShape.getPatternSize())) {
+        followingPatternFixed.setup(canonicalLayout);
+    } else {
+        ofLogNotice() << "Projector pattern: no fixed size layout, using the dynamic path";
+        followingPatternDynamic=ofPtr<DynamicPattern>(new DynamicPattern(calibrationProjector.myPatternShape.getPatternSize()));
+        followingPatternDynamic->setup(canonicalLayout);
+    }
+    printedObjectPoints=Calibration::createObjectPointsDynamic(Point3f(0, 0, 0), Point3f(calibrationCamera.myPatternShape.squareSize, 0, 0), 
+                                                               Point3f(0, calibrationCamera.myPatternShape.squareSize, 0), calibrationCamera.myPatternShape);
+    // AR_DEMO multi-target mode: every printed board in view (same layout as the calibration pattern) gets its own pose:
+    targets.setup(calibrationCamera.myPatternShape.getPatternSize(), printedObjectPoints, maxARTargets);
 	
     // (3) Define viewports for each display:
     // ATTENTION: I cannot use ofGetScreenWidth() and the like, because we need to put OF in "extended desktop" mode!
@@ -51,13 +139,66 @@ void testApp::setup() {
     viewportProjector.set(COMPUTER_DISP_WIDTH,0,PROJ_WIDTH, PROJ_HEIGHT);
     
     // Other graphics settings:
-    ofBackground(0,0,0);
-    ofEnableAlphaBlending();
-    ofEnableSmoothing();
-    ofSetCircleResolution(30);
+    if (!replayMode) {
+        ofBackground(0,0,0);
+        ofEnableAlphaBlending();
+        ofEnableSmoothing();
+        ofSetCircleResolution(30);
+    }
+    
+    // Stage profiler (one histogram set per calibration state):
+    profiler.setStateName(CAMERA_ONLY, "CAMERA_ONLY");
+    profiler.setStateName(CAMERA_AND_PROJECTOR_PHASE1, "PHASE1");
+    profiler.setStateName(CAMERA_AND_PROJECTOR_PHASE2, "PHASE2");
+    profiler.setStateName(AR_DEMO, "AR_DEMO");
+    
+    // Event log (the frame thread never writes to the console itself):
+    eventLog.setStateName(CAMERA_ONLY, "CAMERA_ONLY");
+    eventLog.setStateName(CAMERA_AND_PROJECTOR_PHASE1, "PHASE1");
+    eventLog.setStateName(CAMERA_AND_PROJECTOR_PHASE2, "PHASE2");
+    eventLog.setStateName(AR_DEMO, "AR_DEMO");
+    eventLog.setup("events.jsonl");
+    lastTimingLog=0;
+    displayProfiler=false;
+    displayUndistorted=false;
+    displayCoverage=true;
+    displayPreprocessed=false;
+    
+    // Coverage based acceptance of the boards:
+    cameraCoverage.setup(cv::Size(CAM_WIDTH, CAM_HEIGHT), coverageGridCols, coverageGridRows);
+    projectorCoverage.setup(cv::Size(PROJ_WIDTH, PROJ_HEIGHT), coverageGridCols, coverageGridRows);
+    cameraCoverage.setThresholds(coverageMinNewCells, coverageMinAngle, coverageMinTranslation);
+    projectorCoverage.setThresholds(coverageMinNewCells, coverageMinAngle, coverageMinTranslation);
+    trackingAR=true;
+    filterAR=true;
+    multiTargetAR=false;
+    frameCaptureMicros=0;
+    
+    // Dense structured light acquisition (key 'g', instead of the projected circle grid):
+    grayCode.setup(PROJ_WIDTH, PROJ_HEIGHT);
+    structuredLight=false;
+    
+    // Background solver for the projector/stereo calibration:
+    solver.setIncremental(fullRecalibrationEvery, recalibrationErrorJump, minNumGoodBoards);
+    solver.setCleaningMode(cleaningMode);
+    solver.setJointExtrinsics(useCalibrationGraph);
+    solver.setup(startCleaningProjector, maxErrorProjector, &profiler, CAMERA_AND_PROJECTOR_PHASE2);
+    incrementalCamera.setup(fullRecalibrationEvery, recalibrationErrorJump);
     
     // INITIAL MODE:
-    initialization(InitialMode);
+    if (replayMode) {
+        initialization(replayInitialMode);
+        replayStartTime=ofGetElapsedTimeMicros();
+    }
+    else initialization(InitialMode);
+    lastFrameState=stateCalibration;
+}
+
+void testApp::exit() {
+    capture.stop();
+    eventLog.stop();
+    solver.stop();
+    TaskPool::shared().stop();
 }
 
 void testApp::initialization(CalibState initialmode) {
@@ -68,10 +209,20 @@ void testApp::initialization(CalibState initialmode) {
     manualGetImage=false;
     
     newBoardAquired=false;
+    printedPatternVisible=false;
+    cornerTracker.reset();
+    poseFilter.reset();
+    targets.reset();
+    projectedDetector.resetPrediction();
+    structuredLight=false;
     dynamicProjection=false;
     dynamicProjectionInside=false;
     displayAR=false;
     
+    // Results of solves started in the previous session must be dropped:
+    solver.reset();
+    incrementalCamera.reset();
+    
     switch (initialmode) {
         case CAMERA_ONLY: // (1) calibrate camera before anything else
             stateCalibration=CAMERA_ONLY;
@@ -79,24 +230,16 @@ void testApp::initialization(CalibState initialmode) {
             
         case CAMERA_AND_PROJECTOR_PHASE1: // (2) load pre-calibrated camera and start calibration projector and computing extrinsics
         case CAMERA_AND_PROJECTOR_PHASE2: 
-            calibrationCamera.load("calibrationCamera.yml");
-            
-            // Attention! the load method, also load a set of image/object points! I don't need that: it will break the SIMULTANEOUS stereo calib 
-            calibrationCamera.deleteAllBoards();
+            // (without the boards: they would break the SIMULTANEOUS stereo calib) 
+            loadCalibration(calibrationCamera, "calibrationCamera");
             
             stateCalibration=CAMERA_AND_PROJECTOR_PHASE1;
             break;
             
         case AR_DEMO: // camera, projector and extrinsics are loaded from file:
-            calibrationCamera.load("calibrationCamera.yml");
-            // attention! load also load a set of image/object points! I don't need that:
-            calibrationCamera.deleteAllBoards();
-            
-            calibrationProjector.load("calibrationProjector.yml");
-            // attention! load also load a set of image/object points! I don't need that:
-            calibrationProjector.deleteAllBoards();
-            
-            loadExtrinsics("CameraProjectorExtrinsics.yml");
+            loadCalibration(calibrationCamera, "calibrationCamera");
+            if (!loadCalibration(calibrationProjector, "calibrationProjector", true)) loadExtrinsics("CameraProjectorExtrinsics.yml");
+            targets.setIntrinsics(calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), calibrationCamera.getDistCoeffs());
             
             stateCalibration=AR_DEMO;
             
@@ -105,334 +248,744 @@ void testApp::initialization(CalibState initialmode) {
         default:
             break;
     }
+    rebuildCoverage(); // (boards of the loaded calibrations, if any)
 }
 
 void testApp::update() {
-	cam.update();
+    endFrame(); // (the previous update/draw pair is over)
+    if (replayMode) {
+        updateReplay();
+        return;
+    }
+    
 #ifdef MOVIE_PLAY
     eyeMovie.idleMovie();
 #endif
     
-	if(cam.isFrameNew()) {		
-		Mat camMat = toCv(cam); // current image to process
-        
-		Mat prevMat = toCv(previous);
-		Mat diffMat = toCv(diff);
-		absdiff(prevMat, camMat, diffMat);	
-        diffMean = mean(Mat(mean(diffMat)))[0];
-		camMat.copyTo(prevMat);
-        
-		float curTime = ofGetElapsedTimef();
+    // AR_DEMO only cares about the newest frame; calibration processes the frames in order (the capture thread drops the
+    // oldest ones if we are too slow, it never waits for us):
+    CapturedFrame frame;
+    if (capture.acquire(frame, stateCalibration==AR_DEMO ? FRAME_LATEST : FRAME_EVERY)) {
+        if (profiler.isEnabled()) profiler.record(STAGE_CAPTURE_LATENCY, stateCalibration, FrameRing::nowMicros()-frame.captureMicros);
+        if (loopback.isRunning()) {
+            // Glass to glass measurement: the projector shows a frame counter (no calibration meanwhile)
+            preprocessor.process(frame.image);
+            loopback.process(preprocessor.getGray(), frame.captureMicros);
+        } else {
+            latency.beginFrame(frame.sequence, frame.captureMicros);
+            frameCaptureMicros=frame.captureMicros;
+            frameStartAllocations=AllocationCounter::getCount();
+            processFrame(frame.image, ofGetElapsedTimef());
+            countFrameAllocations();
+            // The pre-processed views shown by draw() show THIS frame (no-op if a detection already needed them). This
+            // is display work, like draw(): not counted in the frame allocations, and only for the views on screen:
+            if (showsCameraPreprocessed()) preprocessCamera();
+            if (showsProjectorPreprocessed()) preprocessProjector();
+        }
         
-        //(a) First, add and preprocess the image (this will threshold, color segmentation, etc as specified in the pattern 
-        // calibration files). This is done regardless of the manual acquisition mode, because we want to be able to check 
-        // the pre-precess images. 
-        calibrationCamera.addImageToProcess(camMat);
-        calibrationProjector.addImageToProcess(camMat);
+        // Live undistorted view (the maps are rebuilt only when the camera intrinsics change):
+        if (displayUndistorted && calibrationCamera.isReady()) {
+            ScopedStageTimer timer(profiler, STAGE_UNDISTORT);
+            undistortion.update(calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), calibrationCamera.getDistCoeffs(), cv::Size(CAM_WIDTH, CAM_HEIGHT));
+            Mat undistortedMat=toCv(undistorted);
+            undistortion.apply(frame.image, undistortedMat);
+            undistorted.update();
+        }
+        // Copy for display, and give the slot back to the capture thread:
+        camImage.setFromPixels(frame.image.data, frame.image.cols, frame.image.rows, OF_IMAGE_COLOR);
+        capture.release();
+    }
+}
+
+// Frame boundary: release the scratch memory, state changes and stage timings of the frame that just ended.
+void testApp::endFrame() {
+    frameArena.reset();
+    if (stateCalibration==lastFrameState) framesInState++;
+    else {
+        eventLog.state(stateCalibration, lastFrameState);
+        framesInState=0;
+    }
+    lastFrameState=stateCalibration;
+    
+    // Stage timings of the current state, from time to time:
+    if (profiler.isEnabled() && ofGetElapsedTimef()-lastTimingLog>eventLogTimingPeriod) {
+        for (int stage=0; stage<NUM_PROFILER_STAGES; stage++) {
+            const LatencyHistogram& h=profiler.getHistogram((ProfilerStage)stage, stateCalibration);
+            if (h.getCount()) eventLog.stageTiming((ProfilerStage)stage, stateCalibration, h);
+        }
+        lastTimingLog=ofGetElapsedTimef();
+    }
+}
+
+// Heap allocations of processFrame (draw() is not counted: openFrameworks builds a std::string for every text it draws).
+// The goal is none in the steady state of AR_DEMO and PHASE1 (no board being acquired), but the detection of the fork
+// (PHASE1, AR_DEMO when the tracking is lost) still allocates: for now the frames that do are only reported (profiler
+// overlay, replay report), not treated as failures.
+void testApp::countFrameAllocations() {
+    lastFrameAllocations=AllocationCounter::getCount()-frameStartAllocations;
+    bool steadyState=(stateCalibration==AR_DEMO || stateCalibration==CAMERA_AND_PROJECTOR_PHASE1) && framesInState>=steadyStateFrames;
+    if (steadyState && lastFrameAllocations>0) steadyStateAllocatingFrames++;
+}
+
+void testApp::updateReplay() {
+    Mat frame;
+    if (replay.nextFrame(frame)) {
+        frameCaptureMicros=replay.getFrameTime()*1000000;
+        frameStartAllocations=AllocationCounter::getCount();
+        processFrame(frame, replay.getFrameTime());
+        countFrameAllocations();
+        // Wait for the solver: this way the boards are published at the same frame whatever the CPU speed, and the 
+        // replay is repeatable (the wait is counted in the throughput).
+        while (solver.isSolving()) ofSleepMillis(1);
+    } else {
+        reportReplay();
+        ofExit(0);
+    }
+}
+
+void testApp::reportReplay() {
+    float seconds=(ofGetElapsedTimeMicros()-replayStartTime)/1000000.0;
+    int frames=replay.getCurrentFrame()+1;
+    cout << "======= REPLAY REPORT =======" << endl;
+    cout << "Recording: " << replayPath << endl;
+    cout << "Frames processed: " << frames << " in " << seconds << " s (" << (seconds>0 ? frames/seconds : 0) << " frames/sec)" << endl;
+    cout << "Boards accepted: camera " << boardsAcceptedCamera << ", camera+projector " << boardsAcceptedStereo << endl;
+    cout << "Boards kept: camera " << calibrationCamera.size() << ", projector " << calibrationProjector.size() << endl;
+    cout << "Reproj error camera: " << calibrationCamera.getReprojectionError() << ", projector: " << calibrationProjector.getReprojectionError() << endl;
+    cout << "Final state: " << stateCalibration << endl;
+    cout << "Steady state frames with heap allocations: " << steadyStateAllocatingFrames << " (frame arena peak " << frameArena.getPeak()/1024 << " kB, " << frameArena.getOverflows() << " overflows)" << endl;
+    profiler.dump("profileReplay.txt");
+}
+
+void testApp::processFrame(Mat camMat, float curTime) {
+    profiler.setState(stateCalibration);
+    eventLog.setFrame(preprocessor.getFrameNumber()+1); // (the frame about to be preprocessed)
+    currentFrame=camMat;
+    cameraPreprocessed=projectorPreprocessed=false;
+    
+    // Publish the latest projector/stereo calibration computed by the solver thread. This is only done in PHASE1, because
+    // PHASE1 sets again the projected pattern (the solved copies carry the candidate points of the board they were 
+    // submitted with), and we don't want to replace the projector image points while PHASE2 is trying to detect them
+    // (nor the board pose during a structured light sequence).
+    if (stateCalibration==CAMERA_AND_PROJECTOR_PHASE1 && !structuredLight && solver.fetch(calibrationCamera, calibrationProjector, rotCamToProj, transCamToProj)) {
+        eventLog.message(MSG_PROJECTOR_SOLVED, solver.getLastSolveTime());
+        eventLog.reprojectionError(LOG_PROJECTOR, calibrationProjector.getReprojectionError(), calibrationProjector.size());
+        // (resume file: the calibration loaded at startup, calibrationProjector.bin, is only written when the phase completes)
+        projectorStore.checkpoint("calibrationProjector.resume.bin", calibrationProjector, rotCamToProj, transCamToProj);
+        cameraStereoStore.checkpoint("calibrationCameraStereo.resume.bin", calibrationCamera);
+        rebuildCoverage(); // (the solver may have cleaned some boards)
         
-        //(b) detect the patterns, and perform calibration or stereo calibration:
-        switch(stateCalibration) {
-                // CAMERA ONLY ---------------------------------------------------------------------------------------------
-            case CAMERA_ONLY:
+        // Go to AR MODE if we finished calibration:
+        if (calibrationProjector.size()>minNumGoodBoards) {
+            // SAVE THE INTRINSICS and EXTRINSINCS when TOTAL reprojection error is lower than a certain threshold (this is 
+            // automatically assured if we called simultaneousClean before this lines of code), 
+            // and when we get a sufficiently large amount of boards, and move to AR_DEMO:
+            calibrationProjector.save("calibrationProjector.yml"); 
+            saveExtrinsics("CameraProjectorExtrinsics.yml");
+            CalibrationStore().save("calibrationProjector.bin", calibrationProjector, rotCamToProj, transCamToProj);
+            projectorStore.discard("calibrationProjector.resume.bin");
+            cameraStereoStore.discard("calibrationCameraStereo.resume.bin");
+            stateCalibration=AR_DEMO; 
+        }
+    }
+    
+    ScopedStageTimer frameTimer(profiler, STAGE_UPDATE);
+    
+    {
+        ScopedStageTimer timer(profiler, STAGE_MOTION_GATE);
+        diffMean = motionGate.update(camMat); // mean absolute difference with the previous frame
+    }
+    
+    //(a) First, the preprocessing shared by everybody (gray + pyramid). The preprocessing of each calibration object 
+    // (threshold, color segmentation, etc as specified in the pattern calibration files) starts from it (camera pattern,
+    // and projector pattern with gray dots) and is done when a detection needs it (see preprocessCamera/preprocessProjector),
+    // or for the views shown on screen (see update).
+    preprocessor.process(camMat);
+    
+    // Structured light sequence in progress (it replaces PHASE1/PHASE2 until all the patterns are acquired):
+    if (structuredLight) {
+        processStructuredLight();
+        return;
+    }
+    
+    //(b) detect the patterns, and perform calibration or stereo calibration:
+    switch(stateCalibration) {
+            // CAMERA ONLY ---------------------------------------------------------------------------------------------
+        case CAMERA_ONLY:
+            
+            if(( manualAcquisition && manualGetImage) ||
+               (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
                 
-                if(( manualAcquisition && manualGetImage) ||
-                   (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
+                if (detectPrintedPattern()) {
                     
-                    if (calibrationCamera.generateCandidateImageObjectPoints()) {
-                        
-                        // Add the candidate image/object points to the board vector list:
-                        calibrationCamera.addCandidateImagePoints();
-                        calibrationCamera.addCandidateObjectPoints(); 
-                        
-                        calibrationCamera.calibrate(); // this use all the previous boards stored in vector arrays, AND recompute each board rotations and tranlastions in the board vector list.
-                        cout << "Camera re-calibrated" << endl;
+                    // Coverage test BEFORE any solve (the pose needs a first calibration; it is reused by incrementalCamera):
+                    bool poseComputed=calibrationCamera.isReady();
+                    if (poseComputed) computePrintedBoardPose();
+                    if (isRedundantBoard(false)) {
+                        lastTime = curTime; // (next try after timeThreshold)
+                        manualGetImage=false;
+                        break;
+                    }
+                    
+                    // Add the candidate image/object points to the board vector list:
+                    calibrationCamera.addCandidateImagePoints();
+                    calibrationCamera.addCandidateObjectPoints(); 
+                    boardsAcceptedCamera++;
+                    eventLog.boardAccepted(LOG_CAMERA, calibrationCamera.size());
+                    
+                    // Incremental calibration: most of the time, only the pose of the new board is computed (with the current 
+                    // intrinsics). A full calibration is done every fullRecalibrationEvery boards, if the error of the new board jumps, 
+                    // and always before testing the end of the CAMERA_ONLY calibration.
+                    bool fullRecalibration=incrementalCamera.addBoard(calibrationCamera, poseComputed) || (calibrationCamera.size()>=preCalibrateCameraTimes);
+                    if (!fullRecalibration) {
+                        eventLog.message(MSG_CAMERA_POSE_ONLY, incrementalCamera.getLastBoardError());
+                    } else {
+                        {
+                            ScopedStageTimer timer(profiler, STAGE_CALIBRATE_CAMERA);
+                            IncrementalCalibration::refine(calibrationCamera); // this use all the previous boards stored in vector arrays, AND recompute each board rotations and tranlastions in the board vector list (warm started from the current intrinsics).
+                        }
+                        incrementalCamera.fullRefinementDone();
+                        eventLog.message(MSG_CAMERA_RECALIBRATED);
                         
-                        // Clean the list of boards using reprojection error test:
+                        // Clean the list of boards using reprojection error test (only after a full calibration: it uses the per board errors):
                         if(calibrationCamera.size() > startCleaningCamera) {
-                            calibrationCamera.clean(maxErrorCamera);
+                            ScopedStageTimer timer(profiler, STAGE_CLEAN_CAMERA);
+                            BoardCleaner::clean(calibrationCamera, maxErrorCamera, cleaningMode);
                         }
+                        eventLog.reprojectionError(LOG_CAMERA, calibrationCamera.getReprojectionError(), calibrationCamera.size());
+                    }
+                    
+                    // Binary checkpoint (only the new board is appended to the file). This is a resume file: an unfinished
+                    // session must not replace the completed calibration loaded at startup (calibrationCamera.bin):
+                    cameraStore.checkpoint("calibrationCamera.resume.bin", calibrationCamera);
+                    cameraCoverage.rebuild(calibrationCamera);
+                    
+                    // (for visualization, the undistorted camera image is now computed in update() with cached maps: key 'u')
+                    
+                    // Test end CAMERA_ONLY calibration:
+                    // (note: puting this after cleaning, means we want a certain number of "good" boards before moving on)
+                    if (fullRecalibration && (calibrationCamera.size()>=preCalibrateCameraTimes)) {
+                        // Save latest camera calibration:
+                        calibrationCamera.save("calibrationCamera.yml");
+                        CalibrationStore().save("calibrationCamera.bin", calibrationCamera);
+                        cameraStore.discard("calibrationCamera.resume.bin");
                         
-                        // For visualization: undistort image from camera:
-                        /*
-                         if(calibrationCamera.size() > 0) {
-                         calibrationCamera.undistort(toCv(cam), toCv(undistorted));
-                         undistorted.update(); // << this is confusing for me (how the actual data is updated, etc). 
-                         }
-                         */
-                        
-                        // Test end CAMERA_ONLY calibration:
-                        // (note: puting this after cleaning, means we want a certain number of "good" boards before moving on)
-                        if ((calibrationCamera.size()>=preCalibrateCameraTimes)) {
-                            // Save latest camera calibration:
-                            calibrationCamera.save("calibrationCamera.yml");
-                            
-                            // DELETE all the object/image points, because now we are going to get them for both the projector and camera:
-                            calibrationCamera.deleteAllBoards();
-                            
-                            // Start stereo calibration (for camera and projector):
-                            stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
-                        }
+                        // DELETE all the object/image points, because now we are going to get them for both the projector and camera:
+                        calibrationCamera.deleteAllBoards();
+                        rebuildCoverage();
                         
-                        // Reset timer, as well as manual flag:
-                        lastTime = curTime;
-                        manualGetImage=false;
+                        // Start stereo calibration (for camera and projector):
+                        stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
                     }
                     
+                    // Reset timer, as well as manual flag:
+                    lastTime = curTime;
+                    manualGetImage=false;
                 }
-                break;
-                
-                // CAMERA AND PROJECTOR ---------------------------------------------------------------------------------------------
-                // Notes: In case of camera/projector calibration, we need to proceed in TWO PHASES to give time to the projected image 
-                // to refresh before trying to detect it (in case of "dynamic projected pattern"). Otherwise we may be detecting the OLD 
-                // projected pattern, but using the newer image points (which completely breaks the calibration of course)
-                
-            case CAMERA_AND_PROJECTOR_PHASE1: 
-                // PHASE 1 goal is just to set the projector image points to be projected, so the projector 
-                // will project something to be detected in the draw function. The first time, this is using the recorded pattern, but later 
-                // (as the projector gets calibrated) we can use some arbitrary points "closer" to the printed pattern.
-                // In this later case (dynamic pattern), if the printed pattern is not visible, then we won't go to phase 2. 
-                
-                cout << " ****** PHASE 1 ********** " << endl;
                 
+            }
+            break;
+            
+            // CAMERA AND PROJECTOR ---------------------------------------------------------------------------------------------
+            // Notes: In case of camera/projector calibration, we need to proceed in TWO PHASES to give time to the projected image 
+            // to refresh before trying to detect it (in case of "dynamic projected pattern"). Otherwise we may be detecting the OLD 
+            // projected pattern, but using the newer image points (which completely breaks the calibration of course)
+            
+        case CAMERA_AND_PROJECTOR_PHASE1: 
+            // PHASE 1 goal is just to set the projector image points to be projected, so the projector 
+            // will project something to be detected in the draw function. The first time, this is using the recorded pattern, but later 
+            // (as the projector gets calibrated) we can use some arbitrary points "closer" to the printed pattern.
+            // In this later case (dynamic pattern), if the printed pattern is not visible, then we won't go to phase 2. 
+            
+            // (the state changes are in the event log)
+            
+            // Dynamic or static projection? :               
+            if (calibrationProjector.boardRotations.empty()) dynamicProjection=false; // this is necessary in case all the board are deleted because 
+            // of large reprojection error (even if we FORCED dynamicProjection to true using the keyboard). In that case, there won't be 
+            // any board rot/translation computed form the point of view of the projector. Note: we test the board ROTATIONS and not 
+            // size(), because boards accepted while the solver is running have no projector pose yet.
+            else if (calibrationProjector.size()>startDynamicProjectorPattern) dynamicProjection=true; // note that dynamic projection can be set manually too, or using this threshold on the number of boards. 
+            
+            // Now, set the IMAGE points of the projector, either using a stored pattern, or from the reprojected 3d points of the 
+            // printed chessboard.
+            if (dynamicProjection) {
                 
-                // Dynamic or static projection? :               
-                if (calibrationProjector.size()==0) dynamicProjection=false; // this is necessary in case all the board are deleted because 
-                // of large reprojection error (even if we FORCED dynamicProjection to true using the keyboard). In that case, there won't be 
-                // any board rot/translation computed form the point of view of the projector. 
-                else if (calibrationProjector.size()>startDynamicProjectorPattern) dynamicProjection=true; // note that dynamic projection can be set manually too, or using this threshold on the number of boards. 
+                if (framesInState==0) eventLog.message(MSG_DYNAMIC_PATTERN);
                 
-                // Now, set the IMAGE points of the projector, either using a stored pattern, or from the reprojected 3d points of the 
-                // printed chessboard.
-                if (dynamicProjection) {
+                // First, check if we can detect the printed pattern to reajust the projection
+                // IMPORTANT NOTE: we may prefer AVOIDING the manual acquisition test or the timer, so as to move the 
+                // projection in "real time":
+              //  if(( manualAcquisition && manualGetImage) ||
+              //     (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
                     
-                    cout << "USING DYNAMIC PROJECTION PATTERN" << endl;
-                    
-                    // First, check if we can detect the printed pattern to reajust the projection
-                    // IMPORTANT NOTE: we may prefer AVOIDING the manual acquisition test or the timer, so as to move the 
-                    // projection in "real time":
-                  //  if(( manualAcquisition && manualGetImage) ||
-                  //     (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
+                    if  (detectPrintedPattern()) { // generate image points from the detected pattern, and 
+                        //object points from the stored pattern, for the CAMERA.
                         
-                        if  (calibrationCamera.generateCandidateImageObjectPoints()) { // generate image points from the detected pattern, and 
-                            //object points from the stored pattern, for the CAMERA.
-                            
-                            cout << "Printed pattern detected" << endl;
-                            
-                            // We assume now that the camera is well calibrated: do NOT recalibrate again, simply compute latest board pose:                        
-                            calibrationCamera.computeCandidateBoardPose();  
-                            
-                            // NOTE: we don't add anything to the board vector arrays FOR THE CAMERA (image/object) because we need to be sure
-                            // we also get this data for the projector calibration object before calling stereo calibration
-                            // However, we can already use the candidate points to show image and reprojection for that board.  
-                            
-                            // In this case, we can modify the candidate projector image points to follow the printed board if the projector has
-                            // been partially calibrated. This is important to effectively explore the "image space" for the projector, and 
-                            // improve the calibration. 
-                            // IMPORTANT: This can be done using the computed extrinsics, or the board rot/trans computed from the latest
-                            // projector calibration; we will use the latest board pose, in camera and projector coordinates, as well as 
-                            // the current post in camera coordinates, to deduce the current pose in projector coordinates: this is better than
-                            // using the current "global computed" extrinsics (which may not have been yet computed, or recently "cleaned"). 
-                            
-                            //(make a special function with "displacement" parameter to project inside or outside the printed pattern?):
-                            vector<Point3f> auxObjectPoints;
-                            Point3f posOrigin, axisX, axisY;  
-                            axisX=calibrationCamera.candidateObjectPoints[1]-calibrationCamera.candidateObjectPoints[0];
-                            axisY=calibrationCamera.candidateObjectPoints[calibrationCamera.myPatternShape.getPatternSize().width]-calibrationCamera.candidateObjectPoints[0];
-                            if (dynamicProjectionInside) 
-                                //pattern inside the printed chessboard:
-                                posOrigin=calibrationCamera.candidateObjectPoints[0]+(axisX-axisY)*0.5;
-                            else
-                                // pattern outside the printed chessboard:
-                                posOrigin=calibrationCamera.candidateObjectPoints[0]-axisY*(calibrationCamera.myPatternShape.getPatternSize().width-2);
-                            
-                            auxObjectPoints=Calibration::createObjectPointsDynamic(posOrigin, axisX, axisY, calibrationProjector.myPatternShape);
-                            // Note: a method "setCandidateDynamicObjectPoints" is not needed, because the actual candidate OBJECT points will be computed from the camera image. But perhaps it would be better to have it, to avoid calling a static method. 
-                            
-                            vector<Point2f> followingPatternImagePoints;
-                            // Remember: we will use the rot/trans of the PREVIOUS BOARD as stored by the projector calibration object, and
-                            // not the (yet not good) extrinsics, which is what we are looking for by the way. So, since we don't use the 
-                            // extrinsics, we need to determine the new rot/trans from the camera "delta" motion, which presumably, is quite 
-                            // good (camera is well calibrated). Note that even if the final pose in projector coordinates is not good, we don't
-                            // care: we are just trying to get the projected point "closer" to the printed pattern to facilitate "exploration"
-                            // of the space - points will we will precisely detected with the camera. 
-                            
-                            Mat Rc1, Tc1, Rc1inv, Tc1inv, Rc2, Tc2, Rp1, Tp1, Rp2, Tp2;
-                            // Previous bord position in projector coordinate frame:
-                            Rp1=calibrationProjector.boardRotations.back();
-                            Tp1=calibrationProjector.boardTranslations.back();
-                            // Previous board position in camera coordinate frame:
-                            Rc1=calibrationCamera.boardRotations.back();
-                            Tc1=calibrationCamera.boardTranslations.back();
-                            // Latest board position in camera coordiante frame (not yet in the vector list!!):
-                            Rc2=calibrationCamera.candidateBoardRotation;
-                            Tc2=calibrationCamera.candidateBoardTranslation;
-                            
-                            
-                            Mat auxRinv=Mat::eye(3,3,CV_32F);
-                            Rodrigues(Rc1,auxRinv);
-                            auxRinv=auxRinv.inv(); // or transpose, the same since it is a rotation matrix!
-                            Rodrigues(auxRinv, Rc1inv);
-                            Tc1inv=-auxRinv*Tc1;
-                            Mat Raux, Taux;
-                            composeRT(Rc2, Tc2, Rc1inv, Tc1inv, Raux, Taux);
-                            composeRT(Raux, Taux, Rp1, Tp1, Rp2, Tp2);
-                            
-                            followingPatternImagePoints=calibrationProjector.createImagePointsFrom3dPoints(auxObjectPoints, Rp2, Tp2); 
-                            // Set image points to display:
-                            calibrationProjector.setCandidateImagePoints(followingPatternImagePoints);
-                            
-                            // Then project, and go to phase 2:
-                            stateCalibration=CAMERA_AND_PROJECTOR_PHASE2; 
-                            
-                        } 
-                        else {
-                            cout << "Printed pattern not visible" << endl;
-                            cout << endl << "======= MOVE THE PRINTED PATTERN =====" << endl; 
-                            // Note: no need to reset manual acquisition of timer, because we know that we need to look for something. 
-                        }
+                        eventLog.message(MSG_PRINTED_DETECTED);
                         
-         //           }
-                    
-                }
-                else 
-                {
-                    cout << "USING FIXED PROJECTION PATTERN" << endl;
-                    //(a) Set the candidate points (for projection) using the fixed pattern:
-                    calibrationProjector.setCandidateImagePoints(); 
+                        // We assume now that the camera is well calibrated: do NOT recalibrate again, simply compute latest board pose:                        
+                        computePrintedBoardPose();  
+                        
+                        // NOTE: we don't add anything to the board vector arrays FOR THE CAMERA (image/object) because we need to be sure
+                        // we also get this data for the projector calibration object before calling stereo calibration
+                        // However, we can already use the candidate points to show image and reprojection for that board.  
+                        
+                        // In this case, we can modify the candidate projector image points to follow the printed board if the projector has
+                        // been partially calibrated. This is important to effectively explore the "image space" for the projector, and 
+                        // improve the calibration. 
+                        // IMPORTANT: This can be done using the computed extrinsics, or the board rot/trans computed from the latest
+                        // projector calibration; we will use the latest board pose, in camera and projector coordinates, as well as 
+                        // the current post in camera coordinates, to deduce the current pose in projector coordinates: this is better than
+                        // using the current "global computed" extrinsics (which may not have been yet computed, or recently "cleaned"). 
+                        
+                        //(make a special function with "displacement" parameter to project inside or outside the printed pattern?):
+                        Point3f posOrigin, axisX, axisY;  
+                        axisX=calibrationCamera.candidateObjectPoints[1]-calibrationCamera.candidateObjectPoints[0];
+                        axisY=calibrationCamera.candidateObjectPoints[calibrationCamera.myPatternShape.getPatternSize().width]-calibrationCamera.candidateObjectPoints[0];
+                        if (dynamicProjectionInside) 
+                            //pattern inside the printed chessboard:
+                            posOrigin=calibrationCamera.candidateObjectPoints[0]+(axisX-axisY)*0.5;
+                        else
+                            // pattern outside the printed chessboard:
+                            posOrigin=calibrationCamera.candidateObjectPoints[0]-axisY*(calibrationCamera.myPatternShape.getPatternSize().width-2);
+                        
+                        // Note: a method "setCandidateDynamicObjectPoints" is not needed, because the actual candidate OBJECT points will be computed from the camera image. But perhaps it would be better to have it, to avoid calling a static method. 
+                        
+                        // Remember: we will use the rot/trans of the PREVIOUS BOARD as stored by the projector calibration object, and
+                        // not the (yet not good) extrinsics, which is what we are looking for by the way. So, since we don't use the 
+                        // extrinsics, we need to determine the new rot/trans from the camera "delta" motion, which presumably, is quite 
+                        // good (camera is well calibrated). Note that even if the final pose in projector coordinates is not good, we don't
+                        // care: we are just trying to get the projected point "closer" to the printed pattern to facilitate "exploration"
+                        // of the space - points will we will precisely detected with the camera. 
+                        
+                        // Index of the latest SOLVED board (the camera list may already contain boards that are being solved):
+                        int lastSolved=calibrationProjector.boardRotations.size()-1;
+                        // Previous bord position in projector coordinate frame:
+                        RigidPose P1=RigidPose::fromRodrigues(calibrationProjector.boardRotations[lastSolved], calibrationProjector.boardTranslations[lastSolved]);
+                        // Previous board position in camera coordinate frame:
+                        RigidPose C1=RigidPose::fromRodrigues(calibrationCamera.boardRotations[lastSolved], calibrationCamera.boardTranslations[lastSolved]);
+                        // Latest board position in camera coordiante frame (not yet in the vector list!!):
+                        RigidPose C2=RigidPose::fromRodrigues(calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation);
+                        
+                        // New board -> camera -> previous board -> projector:
+                        RigidPose P2=P1*C1.inverse()*C2;
+                        
+                        // (the layout is chosen here, once: everything inside is specialized for it)
+                        if (followingPatternDynamic) projectFollowingPattern(*followingPatternDynamic, posOrigin, axisX, axisY, P2);
+                        else projectFollowingPattern(followingPatternFixed, posOrigin, axisX, axisY, P2);
+                        
+                        // Then project, and go to phase 2:
+                        stateCalibration=CAMERA_AND_PROJECTOR_PHASE2; 
+                        
+                    } 
+                    else {
+                        if (framesInState==0) eventLog.boardRejected(REJECT_PRINTED_NOT_VISIBLE); // (once, not on every frame of PHASE1)
+                        // Note: no need to reset manual acquisition of timer, because we know that we need to look for something. 
+                    }
                     
-                    // Project, and go to phase 2:
-                    stateCalibration=CAMERA_AND_PROJECTOR_PHASE2; 
-                }      
+     //           }
                 
-                break;
+            }
+            else 
+            {
+                eventLog.message(MSG_FIXED_PATTERN);
+                //(a) Set the candidate points (for projection) using the fixed pattern:
+                calibrationProjector.setCandidateImagePoints(); 
+                // The camera positions of the fixed dots are not known here (no board pose): no prediction, so that a
+                // prediction left by a dynamic frame does not send the window search to the wrong place. The fixed
+                // pattern does not move, so the dots of the last detection are the right windows anyway:
+                projectedDetector.clearPrediction();
                 
-            case  CAMERA_AND_PROJECTOR_PHASE2: 
-                // PHASE 2: here, we will check if BOTH camera and projector patterns are visible in the current acquired image. 
-                // IF NOT, then we will revert to phase one:
-                cout << " ****** PHASE 2 ********** " << endl;
+                // Project, and go to phase 2:
+                stateCalibration=CAMERA_AND_PROJECTOR_PHASE2; 
+            }      
+            
+            break;
+            
+        case  CAMERA_AND_PROJECTOR_PHASE2: 
+            // PHASE 2: here, we will check if BOTH camera and projector patterns are visible in the current acquired image. 
+            // IF NOT, then we will revert to phase one:
+            if(( manualAcquisition && manualGetImage) ||
+               (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
                 
-                if(( manualAcquisition && manualGetImage) ||
-                   (!manualAcquisition && (curTime - lastTime > timeThreshold && diffMean < diffThreshold) )) {
-                    
-                    cout << "Trying to detect projected and printed patterns simultaneously:" << endl;
+                // The image space detection of the projected pattern does not need the board pose: it runs on the task 
+                // pool while this thread detects the printed pattern and computes the candidate board pose. Both are joined
+                // only for the back-projection of the projected dots on the board plane (see detectProjectedPattern):
+                TaskGroup projectedDetection;
+                projectedDetector.setInput(currentFrame, preprocessor.getGray());
+                TaskPool::shared().submit(projectedDetector, projectedDetection);
+                
+                bool printedDetected=detectPrintedPattern();
+                if (printedDetected) computePrintedBoardPose();
+                projectedDetection.wait();
+                // One sample per frame: the concurrent detection, plus the full image fallback if it ran:
+                unsigned long long projectedMicros=projectedDetector.getDetectionMicros();
+                bool projectedDetected=printedDetected && detectProjectedPattern(projectedMicros);
+                if (profiler.isEnabled()) profiler.record(STAGE_DETECT_PROJECTED, stateCalibration, projectedMicros);
+                
+                if (printedDetected) {
+                    eventLog.message(MSG_PRINTED_DETECTED);
                     
-                    // First, detect printed pattern and compute candidate board pose:
-                    if (calibrationCamera.generateCandidateImageObjectPoints()) {
-                        cout << "Printed pattern detected." << endl;
+                    // If this succeeded, use this board pose and the camera to detect the candidate object points for the projector:
+                    if (projectedDetected) {
+                        //Note: generateCandidateObjectPoints compute the candidate objectPoints (if these are detected by the camera), but not the image points. These were assumed to be set already on the projector calibration object (and displayed!). 
                         
-                        calibrationCamera.computeCandidateBoardPose();  
+                        eventLog.message(MSG_PROJECTED_DETECTED);
                         
-                        // If this succeeded, use this board pose and the camera to detect the candidate object points for the projector:
-                        if (calibrationProjector.generateCandidateObjectPoints(calibrationCamera)) {
-                            //Note: generateCandidateObjectPoints compute the candidate objectPoints (if these are detected by the camera), but not the image points. These were assumed to be set already on the projector calibration object (and displayed!). 
-                            
-                            cout << "Projected pattern detected" << endl;
-                            
-                            // If the object points for the projector were detected, add those points as well as the image points to the
-                            // list of boards image/object for BOTH the camera and projector calibration object, including the rotation and 
-                            // translation vector for the camera frame: 
-                            
-                            // add to CAMERA board list (only for stereo calibration):
-                            calibrationCamera.addCandidateImagePoints();
-                            calibrationCamera.addCandidateObjectPoints();
-                            calibrationCamera.addCandidateBoardPose();
-                            
-                            // add to PROJECTOR board list (for projector recalibration and stereo calibration):
-                            calibrationProjector.addCandidateImagePoints();
-                            calibrationProjector.addCandidateObjectPoints();
-                            // Note: the rotation and translation vectors for the projector are not yet added: these CANNOT 
-                            // properly be computed using PnP algorithm (as calibrationProjector.computeCandidateBoardPose()), because we are 
-                            // precisely trying to get the projector instrinsics! This will be done by the projector.calibrate() method...
-                            
-                            cout << "Re-calibrating projector..." << endl;
-                            // PUT THIS IN ANOTHER THREAD????
-                            calibrationProjector.calibrate(); // this will recompute the projector instrinsics, as well as the board translation and rotation for all the boards - including the latest one. NOTE: it will also update the candidateBoardRotation and candidateBoardTranslation just because we may want these matrices for drawing (but we don't need to "add" them to the vector lists, because this is already done by the openCV calibration method). 
-                            cout << "Projector re-calibrated." << endl;
-                            
-                            
-                            // Cleaning: this needs to be done SIMULTANEOUSLY for projector and camera. 
-                            // However, the test is only done on the projector reprojection error if the camera intrinsics are fixed (because the 
-                            // stereo calibration will be done by generating image points for the camera based only on the OBJECT POINTS OF THE PROJECTOR)
-                            if(calibrationProjector.size() > startCleaningProjector) {
-                                calibrationProjector.simultaneousClean(calibrationCamera, maxErrorProjector);
-                            }
-                            
-                            // Now we can run the stereo calibration (output: rotCamToProj and transCamToProj). Note: we call stereo calibration
-                            // with FIXED INTRINSICS for both the camera and projector. 
-                            // NOTE: perhaps we can start running this after a few projector calibrations????
-                            cout << "Performing stereo calibration..." << endl;
-                            calibrationProjector.stereoCalibrationCameraProjector(calibrationCamera, rotCamToProj, transCamToProj);
-                            cout << "Stereo Calibration performed." << endl;
-                            
-                            // Everything went fine: go to AR MODE if we finished calibration, or revert to PHASE 1 (and indicate that a "stereo board" was properly aquired)    
-                            
-                            if (calibrationProjector.size()>minNumGoodBoards) {
-                                // SAVE THE INTRINSICS and EXTRINSINCS when TOTAL reprojection error is lower than a certain threshold (this is 
-                                // automatically assured if we called simultaneousClean before this lines of code), 
-                                // and when we get a sufficiently large amount of boards, and move to AR_DEMO:
-                                calibrationProjector.save("calibrationProjector.yml"); 
-                                saveExtrinsics("CameraProjectorExtrinsics.yml");
-                                stateCalibration=AR_DEMO; 
-                            } else {
-                                // Otherwise, proceed refining the calibration:
-                                stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
-                                newBoardAquired=true;
-                                cout << endl << "======= YOU CAN MOVE THE PRINTED PATTERN TO EXPLORE IMAGE SPACE =====" << endl; 
-                                lastTime = curTime;
-                                manualGetImage=false;
-                            }
-                            
-                        }  
-                        else {
-                            cout << "Projected pattern not visible!" << endl;
-                            cout << "You need to move the board so that the PROJECTED pattern is visible too." << endl; 
-                            // REVERT TO PHASE1
-                            stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
-                            // No need to reset manual acquisition or timer, because we are looking for something new. But we may want, in
-                            // case of manual mode, to be able to fix the board before hit a key:
-                            manualGetImage=false; 
+                        if (isRedundantBoard(true)) {
+                            // REVERT TO PHASE1 (and wait for the timer, or for a new manual acquisition)
+                            stateCalibration=CAMERA_AND_PROJECTOR_PHASE1;
+                            lastTime = curTime;
+                            manualGetImage=false;
+                            break;
                         }
                         
-                    } else {
-                        cout << "Printed pattern not visible!" << endl;
-                        cout << "You need to move the board so that the PRINTED pattern is visible." << endl;
-                        // REVERT TO PHASE1:
+                        // If the object points for the projector were detected, add those points as well as the image points to the
+                        // list of boards image/object for BOTH the camera and projector calibration object, including the rotation and 
+                        // translation vector for the camera frame: 
+                        
+                        // add to CAMERA board list (only for stereo calibration):
+                        calibrationCamera.addCandidateImagePoints();
+                        calibrationCamera.addCandidateObjectPoints();
+                        calibrationCamera.addCandidateBoardPose();
+                        
+                        // add to PROJECTOR board list (for projector recalibration and stereo calibration):
+                        calibrationProjector.addCandidateImagePoints();
+                        calibrationProjector.addCandidateObjectPoints();
+                        boardsAcceptedStereo++;
+                        eventLog.boardAccepted(LOG_STEREO, calibrationProjector.size());
+                        rebuildCoverage();
+                        // Note: the rotation and translation vectors for the projector are not yet added: these CANNOT 
+                        // properly be computed using PnP algorithm (as calibrationProjector.computeCandidateBoardPose()), because we are 
+                        // precisely trying to get the projector instrinsics! This will be done by the projector.calibrate() method...
+                        
+                        // Projector calibration (this will recompute the projector instrinsics, as well as the board translation and rotation 
+                        // for all the boards - including the latest one), SIMULTANEOUS cleaning of projector and camera boards, and stereo 
+                        // calibration with FIXED INTRINSICS (output: rotCamToProj and transCamToProj) are done by the solver thread, on a 
+                        // snapshot of the board lists. The result is published at the beginning of update() (and then we check if we can 
+                        // end calibration and go to AR MODE). 
+                        eventLog.message(MSG_PROJECTOR_SOLVING);
+                        solver.submit(calibrationCamera, calibrationProjector, rotCamToProj, transCamToProj);
+                        
+                        // Everything went fine: revert to PHASE 1 (and indicate that a "stereo board" was properly aquired)    
+                        stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
+                        newBoardAquired=true;
+                        lastTime = curTime;
+                        manualGetImage=false;
+                        
+                    }  
+                    else {
+                        eventLog.boardRejected(REJECT_PROJECTED_NOT_VISIBLE);
+                        // REVERT TO PHASE1
                         stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
                         // No need to reset manual acquisition or timer, because we are looking for something new. But we may want, in
                         // case of manual mode, to be able to fix the board before hit a key:
                         manualGetImage=false; 
                     }
                     
-                } 
-                else { // this means that the timer or image difference is not yet enough, or we didn't choose to manually acquire
-                    // the image: just move to phase one to continue the moving the board around. 
-                     stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
-    
+                } else {
+                    eventLog.boardRejected(REJECT_PRINTED_NOT_VISIBLE);
+                    // REVERT TO PHASE1:
+                    stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
+                    // No need to reset manual acquisition or timer, because we are looking for something new. But we may want, in
+                    // case of manual mode, to be able to fix the board before hit a key:
+                    manualGetImage=false; 
                 }
-                break;
-                
-            case AR_DEMO:
-                
-                // We assume here that projector and camera are calibrated, as well as extrinsics
-                // We can detect things using the pattern, or something else (say, a rectangular A4 page). The important thing is to get the 
-                // transformation from OBJECT to CAMERA. We will use the EXTRINSICS to get the correspondance from OBJECT to PROJECTOR. 
-                if (calibrationCamera.generateCandidateImageObjectPoints()) { 
-                    cout << "Chessboard pattern recognized" << endl;
-                    calibrationCamera.computeCandidateBoardPose();  // transformation from board to camera computed here
-                }
-                
-                break;
                 
-                // TO DO: final "AR demo" mode with projector and camera calibrated (no need to recalibrate projector, nor the extrinsics).
-                // We can use the chessboard, or just an A4 page using my modified CountourFinder. Project a movie?
-                // ...
+            } 
+            else { // this means that the timer or image difference is not yet enough, or we didn't choose to manually acquire
+                // the image: just move to phase one to continue the moving the board around. 
+                 stateCalibration=CAMERA_AND_PROJECTOR_PHASE1; 
+
+            }
+            break;
+            
+        case AR_DEMO:
+            
+            // We assume here that projector and camera are calibrated, as well as extrinsics
+            // We can detect things using the pattern, or something else (say, a rectangular A4 page). The important thing is to get the 
+            // transformation from OBJECT to CAMERA. We will use the EXTRINSICS to get the correspondance from OBJECT to PROJECTOR. 
+            // In multi-target mode, all the printed boards in view are detected and posed (see MultiTargetTracker):
+            if (multiTargetAR) {
+                ScopedStageTimer timer(profiler, STAGE_DETECT_PRINTED);
+                targets.update(preprocessor.getGray(), preprocessor.getLevel(boardPrecheckLevel), 1<<boardPrecheckLevel, frameCaptureMicros);
+                latency.mark(MARK_POSE);
+            }
+            // The corners are TRACKED from the previous frame when possible (full detection only when tracking is lost):
+            else if (trackPrintedPattern()) { 
+                computePrintedBoardPose();  // transformation from board to camera computed here
+                poseFilter.update(calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, frameCaptureMicros);
+            }
+            
+            break;
+            
+            // TO DO: final "AR demo" mode with projector and camera calibrated (no need to recalibrate projector, nor the extrinsics).
+            // We can use the chessboard, or just an A4 page using my modified CountourFinder. Project a movie?
+            // ...
+    }
+	
+}
+
+// ============ Structured light (Gray code) acquisition of a projector board ============
+// The board must stay still during the whole sequence (about 42 patterns, a few seconds). The printed pattern pose is
+// computed on the first (white) frame; then the projector position of a grid of points of the board plane (finer than
+// the printed corners) is obtained from the decoded correspondences, and the board is added as in PHASE2.
+
+void testApp::startStructuredLight() {
+    if (replayMode || !calibrationCamera.isReady() ||
+        (stateCalibration!=CAMERA_AND_PROJECTOR_PHASE1 && stateCalibration!=CAMERA_AND_PROJECTOR_PHASE2)) {
+        eventLog.boardRejected(REJECT_CAMERA_NOT_CALIBRATED);
+        return;
+    }
+    if (!structuredLightImage.isAllocated()) structuredLightImage.allocate(PROJ_WIDTH, PROJ_HEIGHT, OF_IMAGE_GRAYSCALE);
+    structuredLightFrames.resize(grayCode.getNumPatterns());
+    structuredLight=true;
+    structuredLightStep=0;
+    structuredLightWait=0;
+    showStructuredLightPattern();
+    eventLog.message(MSG_STRUCTURED_LIGHT_STARTED, grayCode.getNumPatterns()); // (don't move the board)
+}
+
+void testApp::showStructuredLightPattern() {
+    Mat pattern=toCv(structuredLightImage);
+    grayCode.generate(structuredLightStep, pattern);
+    structuredLightImage.update();
+}
+
+void testApp::stopStructuredLight(LogRejectReason reason) {
+    eventLog.boardRejected(reason);
+    structuredLight=false;
+    stateCalibration=CAMERA_AND_PROJECTOR_PHASE1;
+}
+
+void testApp::processStructuredLight() {
+    // Wait until the camera sees the new pattern:
+    if (++structuredLightWait<structuredLightSettleFrames) return;
+    structuredLightWait=0;
+    if (structuredLightStep>0 && diffMean>diffThreshold) {
+        stopStructuredLight(REJECT_BOARD_MOVED);
+        return;
+    }
+    
+    if (structuredLightStep==0) { // (full white) printed pattern pose:
+        if (!detectPrintedPattern()) {
+            stopStructuredLight(REJECT_PRINTED_NOT_VISIBLE);
+            return;
         }
-		
-	}
+        computePrintedBoardPose();
+    }
+    preprocessor.getGray().copyTo(structuredLightFrames[structuredLightStep]);
+    
+    structuredLightStep++;
+    if (structuredLightStep<grayCode.getNumPatterns()) {
+        showStructuredLightPattern();
+        return;
+    }
+    structuredLight=false;
+    
+    // Decoding, and projector position of a fine grid of board points:
+    vector<Point3f> objectPoints;
+    vector<Point2f> cameraPoints, projectorPoints;
+    vector<uchar> status;
+    {
+        ScopedStageTimer timer(profiler, STAGE_DECODE_STRUCTURED_LIGHT);
+        Mat projectorX, projectorY, mask;
+        grayCode.decode(structuredLightFrames, projectorX, projectorY, mask);
+        
+        // Grid over the printed chessboard corners, in board coordinates:
+        const vector<Point3f>& corners=calibrationCamera.candidateObjectPoints;
+        Point3f minCorner=corners[0], maxCorner=corners[0];
+        for (int i=1; i<corners.size(); i++) {
+            minCorner.x=MIN(minCorner.x, corners[i].x); minCorner.y=MIN(minCorner.y, corners[i].y);
+            maxCorner.x=MAX(maxCorner.x, corners[i].x); maxCorner.y=MAX(maxCorner.y, corners[i].y);
+        }
+        float step=calibrationCamera.myPatternShape.squareSize/structuredLightSubdivision;
+        vector<Point3f> grid;
+        for (float y=minCorner.y; y<=maxCorner.y+step/2; y+=step)
+            for (float x=minCorner.x; x<=maxCorner.x+step/2; x+=step) grid.push_back(Point3f(x, y, 0));
+        
+        // Where the camera sees them, then where the projector "sees" them:
+        projectPoints(Mat(grid), calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation,
+                      calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), calibrationCamera.getDistCoeffs(), cameraPoints);
+        vector<Point2f> allProjectorPoints;
+        grayCode.projectorPoints(cameraPoints, allProjectorPoints, status);
+        for (int i=0; i<grid.size(); i++) {
+            if (!status[i]) continue;
+            objectPoints.push_back(grid[i]);
+            projectorPoints.push_back(allProjectorPoints[i]);
+        }
+        eventLog.message(MSG_STRUCTURED_LIGHT_DECODED, projectorPoints.size(), grid.size());
+    }
+    if (projectorPoints.size()<calibrationCamera.candidateObjectPoints.size()) {
+        stopStructuredLight(REJECT_NOT_ENOUGH_POINTS);
+        return;
+    }
+    
+    // Add the board, as in PHASE2 (camera: the printed corners; projector: the dense grid):
+    calibrationProjector.setCandidateImagePoints(projectorPoints);
+    calibrationProjector.candidateObjectPoints=objectPoints;
+    calibrationCamera.addCandidateImagePoints();
+    calibrationCamera.addCandidateObjectPoints();
+    calibrationCamera.addCandidateBoardPose();
+    calibrationProjector.addCandidateImagePoints();
+    calibrationProjector.addCandidateObjectPoints();
+    boardsAcceptedStereo++;
+    eventLog.boardAccepted(LOG_STEREO, calibrationProjector.size());
+    rebuildCoverage();
+    solver.submit(calibrationCamera, calibrationProjector, rotCamToProj, transCamToProj);
+    
+    stateCalibration=CAMERA_AND_PROJECTOR_PHASE1;
+    newBoardAquired=true;
+    lastTime=ofGetElapsedTimef();
+}
+
+// Pattern detection and pose (timed, see StageProfiler):
+bool testApp::detectPrintedPattern() {
+    ScopedStageTimer timer(profiler, STAGE_DETECT_PRINTED);
+    // The fast test only runs in the states that look for the board on every frame (AR_DEMO, PHASE1), where its corners,
+    // refined at full resolution, are the detection. The acquisition states (CAMERA_ONLY, PHASE2) use the full resolution
+    // detection of the calibration object: they must still find the small or distant boards that the test can miss.
+    bool precheck=(stateCalibration==AR_DEMO || stateCalibration==CAMERA_AND_PROJECTOR_PHASE1);
+    int scale=1<<boardPrecheckLevel;
+    printedPatternVisible=false;
+    if (!precheck) {
+        preprocessCamera();
+        printedPatternVisible=calibrationCamera.generateCandidateImageObjectPoints();
+    } else if (boardPrecheck.check(preprocessor.getLevel(boardPrecheckLevel), scale)) {
+        // The board is already found: its corners are refined at full resolution (window of the reduced resolution error), 
+        // instead of a second detection from scratch:
+        precheckCorners=boardPrecheck.getCorners();
+        cornerSubPix(preprocessor.getGray(), precheckCorners, cv::Size(2+2*scale, 2+2*scale), cv::Size(-1, -1), TermCriteria(CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 20, 0.05));
+        calibrationCamera.setCandidateImagePoints(precheckCorners);
+        calibrationCamera.candidateObjectPoints=printedObjectPoints;
+        printedPatternVisible=true;
+    }
+    if (printedPatternVisible) {
+        boardPrecheck.setDetected(calibrationCamera.candidateImagePoints);
+        latency.mark(MARK_DETECTED);
+    } else {
+        boardPrecheck.setLost();
+    }
+    return printedPatternVisible;
+}
+
+void testApp::computePrintedBoardPose() {
+    ScopedStageTimer timer(profiler, STAGE_BOARD_POSE);
+    calibrationCamera.computeCandidateBoardPose();
+    latency.mark(MARK_POSE);
+}
+
+// PHASE1 following pattern: place the layout on the printed board (same points as 
+// Calibration::createObjectPointsDynamic(origin, axisX, axisY, calibrationProjector.myPatternShape)), project it with the
+// estimated board->projector pose, and predict where the camera will see the dots.
+template<class Layout>
+void testApp::projectFollowingPattern(Layout& layout, const Point3f& origin, const Point3f& axisX, const Point3f& axisY, const RigidPose& boardToProjector) {
+    layout.place(origin, axisX, axisY);
+    projection.setIntrinsics(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(), calibrationProjector.getDistCoeffs());
+    projection.setPose(FOLLOWING_PATTERN, boardToProjector);
+    projection.project(FOLLOWING_PATTERN, layout.getObjectPoints(), layout.size(), layout.getImagePoints());
+    latency.mark(MARK_PROJECTED);
+    // Set image points to display (the vector keeps its capacity from frame to frame):
+    followingPatternImagePoints.assign(layout.getImagePoints(), layout.getImagePoints()+layout.size());
+    calibrationProjector.setCandidateImagePoints(followingPatternImagePoints);
+    // Where the camera should see the dots (the pattern is placed on the board, whose camera pose is known), so that
+    // PHASE2 only looks for each dot in a small window (see ProjectedPatternDetector):
+    projectPoints(Mat(layout.size(), 1, CV_32FC3, (void*)layout.getObjectPoints()), 
+                  calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation,
+                  calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), calibrationCamera.getDistCoeffs(), 
+                  predictedDots);
+    projectedDetector.setPrediction(predictedDots);
+}
+
+// Coverage based acceptance: true (and logged) if the candidate board adds nothing to the boards already accepted: no
+// new cell of the camera (or projector) image, and a pose close to one of the accepted boards.
+bool testApp::isRedundantBoard(bool withProjector) {
+    if (!useCoverageAcceptance) return false;
+    bool novel=cameraCoverage.isNovel(calibrationCamera.candidateImagePoints);
+    if (withProjector) novel=novel || projectorCoverage.isNovel(calibrationProjector.candidateImagePoints);
+    // (the projector sees the board through fixed extrinsics: the diversity of the camera poses is enough)
+    bool diverse=calibrationCamera.isReady() && cameraCoverage.isDiverse(calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation);
+    if (novel || diverse) return false;
+    eventLog.boardRejected(REJECT_REDUNDANT);
+    return true;
+}
+
+void testApp::rebuildCoverage() {
+    cameraCoverage.rebuild(calibrationCamera);
+    projectorCoverage.rebuild(calibrationProjector);
+}
+
+// Printed pattern corners tracked frame to frame (AR_DEMO), with full detection as fallback:
+bool testApp::trackPrintedPattern() {
+    if (trackingAR && cornerTracker.isTracking()) {
+        ScopedStageTimer timer(profiler, STAGE_TRACK_PRINTED);
+        if (cornerTracker.track(preprocessor.getGray(), trackedCorners)) {
+            calibrationCamera.setCandidateImagePoints(trackedCorners);
+            boardPrecheck.setDetected(trackedCorners);
+            printedPatternVisible=true;
+            latency.mark(MARK_DETECTED);
+            return true;
+        }
+    }
+    
+    if (detectPrintedPattern()) {
+        eventLog.message(MSG_PRINTED_DETECTED); // (full detection: the tracking was lost)
+        if (trackingAR) cornerTracker.setDetected(preprocessor.getGray(), calibrationCamera.candidateImagePoints, calibrationCamera.candidateObjectPoints);
+        return true;
+    }
+    cornerTracker.reset();
+    return false;
+}
+
+// (micros: duration of the detection, the fallback adds its own)
+bool testApp::detectProjectedPattern(unsigned long long& micros) {
+    // Dots already found by projectedDetector (concurrent detection): only the back-projection is left.
+    if (projectedDetector.isFound() &&
+        projectedDetector.backProject(calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), calibrationCamera.getDistCoeffs(),
+                                      calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation,
+                                      calibrationProjector.candidateObjectPoints)) return true;
+    
+    // Otherwise, full detection on the preprocessed (color segmented) image of the projector calibration object:
+    preprocessProjector();
+    unsigned long long start=ofGetElapsedTimeMicros();
+    bool detected=calibrationProjector.generateCandidateObjectPoints(calibrationCamera);
+    micros+=ofGetElapsedTimeMicros()-start;
+    return detected;
+}
+
+// Preprocessing of the calibration objects (at most once per frame). The printed pattern is detected in the shared gray
+// image (no second color conversion); so is the projected pattern when its dots are white or gray, otherwise its color
+// segmentation needs the color frame:
+void testApp::preprocessCamera() {
+    if (!cameraPreprocessed) {
+        ScopedStageTimer timer(profiler, STAGE_PREPROCESS_CAMERA);
+        calibrationCamera.addImageToProcess(preprocessor.getGray());
+        cameraPreprocessed=true;
+    }
+}
+
+void testApp::preprocessProjector() {
+    if (!projectorPreprocessed) {
+        ScopedStageTimer timer(profiler, STAGE_PREPROCESS_PROJECTOR);
+        calibrationProjector.addImageToProcess(projectorSegmentsGray ? preprocessor.getGray() : currentFrame);
+        projectorPreprocessed=true;
+    }
+}
+
+// (the projector pattern is only looked for in PHASE1/PHASE2)
+bool testApp::showsCameraPreprocessed() const {
+    return displayPreprocessed && !replayMode;
+}
+
+bool testApp::showsProjectorPreprocessed() const {
+    return displayPreprocessed && !replayMode && (stateCalibration==CAMERA_AND_PROJECTOR_PHASE1 || stateCalibration==CAMERA_AND_PROJECTOR_PHASE2);
 }
 
 void testApp::draw() {
-    stringstream intrinsicsProjector, intrinsicsCamera;
+    if (replayMode) return; // headless
+    
+    profiler.setState(stateCalibration);
+    ScopedStageTimer drawTimer(profiler, STAGE_DRAW);
     
     ofSetWindowPosition(0,0); 
     
@@ -450,11 +1003,21 @@ void testApp::draw() {
     
     // Draw current acquired image:
     ofSetColor(255);
-    cam.draw(0,0, CAM_WIDTH, CAM_HEIGHT);
+    if (displayUndistorted && undistortion.isReady()) undistorted.draw(0,0, CAM_WIDTH, CAM_HEIGHT);
+    else camImage.draw(0,0, CAM_WIDTH, CAM_HEIGHT);
     
-    // Draw preprocessed images for camera and projector board detection (we need to do the preprocessing BEFORE calling the detection functions):
-    calibrationCamera.drawPreprocessedImage(CAM_WIDTH, 0, CAM_WIDTH/2, CAM_HEIGHT/2);
-    calibrationProjector.drawPreprocessedImage(CAM_WIDTH, CAM_HEIGHT/2, CAM_WIDTH/2, CAM_HEIGHT/2);
+    // Regions of the camera image that still need boards (red), and same for the projector image (small map):
+    if (displayCoverage && stateCalibration!=AR_DEMO) {
+        cameraCoverage.draw(0, 0, CAM_WIDTH, CAM_HEIGHT);
+        if (stateCalibration!=CAMERA_ONLY) {
+            projectorCoverage.draw(CAM_WIDTH*3/2+20, CAM_HEIGHT+20, PROJ_WIDTH/4, PROJ_HEIGHT/4);
+            drawHighlightString(formatText("Projector coverage %d%%", (int)(100*projectorCoverage.getCoverage())), CAM_WIDTH*3/2+20, CAM_HEIGHT+15);
+        }
+    }
+    
+    // Draw preprocessed images for camera and projector board detection ('v'; refreshed in update() only when shown):
+    if (showsCameraPreprocessed()) calibrationCamera.drawPreprocessedImage(CAM_WIDTH, 0, CAM_WIDTH/2, CAM_HEIGHT/2);
+    if (showsProjectorPreprocessed()) calibrationProjector.drawPreprocessedImage(CAM_WIDTH, CAM_HEIGHT/2, CAM_WIDTH/2, CAM_HEIGHT/2);
     
     // Signal the acquisition of a new board:
     if (newBoardAquired) {
@@ -462,23 +1025,30 @@ void testApp::draw() {
     }
     
     
-    // Draw detected points (for CAMERA CALIBRATION BOARD):
-    calibrationCamera.drawCandidateImagePoints(0,0, CAM_WIDTH, CAM_HEIGHT, ofColor(255,0,0));
-    // Draw reprojected points (for CAMERA CALIBRATION BOARD):
-    calibrationCamera.drawCandidateReprojection(0,0, CAM_WIDTH, CAM_HEIGHT, ofColor(255,255,0));
-    // Draw axis of detected board:
-    calibrationCamera.drawCandidateAxis(0,0, CAM_WIDTH, CAM_HEIGHT);
+    // (note: when the fast pre-check rejects a frame, the calibration object still holds the last detection)
+    if (printedPatternVisible) {
+        // Draw detected points (for CAMERA CALIBRATION BOARD):
+        calibrationCamera.drawCandidateImagePoints(0,0, CAM_WIDTH, CAM_HEIGHT, ofColor(255,0,0));
+        // Draw reprojected points (for CAMERA CALIBRATION BOARD):
+        calibrationCamera.drawCandidateReprojection(0,0, CAM_WIDTH, CAM_HEIGHT, ofColor(255,255,0));
+        // Draw axis of detected board:
+        calibrationCamera.drawCandidateAxis(0,0, CAM_WIDTH, CAM_HEIGHT);
+    }
     
-    // Draw undistorted image:
-    //undistorted.draw(CAM_WIDTH, 0);
+    cv::Point2d fovCamera=calibrationCamera.getDistortedIntrinsics().getFov(), fovProjector=calibrationProjector.getDistortedIntrinsics().getFov();
+    drawHighlightString(formatText("Camera fov: %g, %g", fovCamera.x, fovCamera.y), posTextX, posTextY, yellowPrint, ofColor(0));
+    drawHighlightString(formatText("Reproj error camera: %g from %d", calibrationCamera.getReprojectionError(), (int)calibrationCamera.size()), posTextX, posTextY+20, magentaPrint);
     
-    intrinsicsCamera << "Camera fov: " << toOf(calibrationCamera.getDistortedIntrinsics().getFov());
-    drawHighlightString(intrinsicsCamera.str(), posTextX, posTextY, yellowPrint, ofColor(0));
-    drawHighlightString("Reproj error camera: " + ofToString(calibrationCamera.getReprojectionError()) + " from " + ofToString(calibrationCamera.size()), posTextX, posTextY+20, magentaPrint);
+    drawHighlightString(formatText("Projector fov: %g, %g", fovProjector.x, fovProjector.y), posTextX, posTextY+50, yellowPrint, ofColor(0));
+    drawHighlightString(formatText("Reproj error projector: %g from %d", calibrationProjector.getReprojectionError(), (int)calibrationProjector.size()), posTextX, posTextY+70, magentaPrint);
     
-    intrinsicsProjector << "Projector fov: " << toOf(calibrationProjector.getDistortedIntrinsics().getFov()) ;//<< " distCoeffs: " << calibrationProjector.getDistCoeffs();
-    drawHighlightString(intrinsicsProjector.str(), posTextX, posTextY+50, yellowPrint, ofColor(0));
-    drawHighlightString("Reproj error projector: " + ofToString(calibrationProjector.getReprojectionError()) + " from " + ofToString(calibrationProjector.size()), posTextX, posTextY+70, magentaPrint);
+    if (displayProfiler) {
+        drawHighlightString(formatText("Capture: %.1f fps, %d frames dropped", capture.getCaptureFps(), (int)capture.getDropped()), CAM_WIDTH*3/2+20, 80);
+        drawHighlightString(formatText("Heap allocations: %llu last frame, %d steady state frames with allocations, arena peak %d kB (%d overflows)",
+                                       lastFrameAllocations, steadyStateAllocatingFrames, (int)(frameArena.getPeak()/1024), frameArena.getOverflows()), CAM_WIDTH*3/2+20, 60);
+        profiler.drawOverlay(CAM_WIDTH*3/2+20, 100);
+        drawHighlightString(loopback.isRunning() ? loopback.getSummary() : latency.getSummary(), CAM_WIDTH*3/2+20, 40);
+    }
     
     switch(stateCalibration) {
         case CAMERA_ONLY:
@@ -493,22 +1063,21 @@ void testApp::draw() {
             else 
                 drawHighlightString("Using FIXED Projection", COMPUTER_DISP_WIDTH-400, 60, cyanPrint,  ofColor(255));
             
+            if (solver.isSolving())
+                drawHighlightString("Solving projector calibration...", COMPUTER_DISP_WIDTH-400, 80, cyanPrint,  ofColor(255));
+            
             
             // Extrinsics camera-projector:
             // NOTE: in the future, the object STEREO should have a flag "isReady" to test if it is possible to proceed with some things...
             // For the time being, I assume that if BOTH camera and projector have been calibrated once, then we also called the stereo calibration...
             if (calibrationCamera.isReady()&&calibrationProjector.isReady()&&(calibrationProjector.size()>0)) {
                 
-                extrinsics="";
-                Mat rotCamToProj3x3;
-                Rodrigues(rotCamToProj, rotCamToProj3x3);
-                for (int i=0; i<3; i++) {
-                    for (int j=0; j<3; j++)  extrinsics += ofToString(rotCamToProj3x3.at<double>(i,j),3) + "  "; 
-                    extrinsics += ofToString(transCamToProj.at<double>(0,i),3)+" \n";
-                }
-                drawHighlightString(extrinsics, posTextX, posTextY+100, yellowPrint, ofColor(0));
+                // (the projection engine composes the poses with the extrinsics only when they change)
+                projection.setIntrinsics(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(), calibrationProjector.getDistCoeffs());
+                projection.setExtrinsics(rotCamToProj, transCamToProj);
+                drawHighlightString(projection.getExtrinsicsText(3, 3), posTextX, posTextY+100, yellowPrint, ofColor(0));
                 
-                if (displayAR) {
+                if (displayAR && !structuredLight) {
                     // ============================ DRAW ON THE PROJECTOR DISPLAY (SET AS CONTIGUOUS SCREEN) ===================================
                     // NOTE: we can use the position parameter on the draw functions, or put (0,0) and do a translation here, or use two viewports...
                     //ofPushMatrix();
@@ -523,24 +1092,38 @@ void testApp::draw() {
                     glMatrixMode(GL_MODELVIEW);
                     glLoadIdentity();
                     
-                    vector<Point2f> testPoints;
+                    vector<Point2f>& testPoints=projectedPoints;
+                    projection.setPose(BOARD_IN_PROJECTOR, calibrationProjector.candidateBoardRotation, calibrationProjector.candidateBoardTranslation, false);
+                    projection.setPose(BOARD_IN_CAMERA, calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, true);
                     // (a) Project over the printed chessboard using the board position directly in projector reference frame (this assumes projector calibration was possible):
-                    testPoints=calibrationProjector.createImagePointsFrom3dPoints(calibrationCamera.candidateObjectPoints,  calibrationProjector.candidateBoardRotation, calibrationProjector.candidateBoardTranslation); // no final Re and te means identity transform
+                    {
+                        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+                        projection.project(BOARD_IN_PROJECTOR, calibrationCamera.candidateObjectPoints, testPoints); // (no extrinsics)
+                    }
                     calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255,0,0), 3); // make static function
                     calibrationProjector.drawCandidateAxis(0,0, PROJ_WIDTH, PROJ_HEIGHT);
                     
                     // (b) Project over the projector points (not directly, but using object points and board transformation from the projector:
-                    testPoints=calibrationProjector.createImagePointsFrom3dPoints(calibrationProjector.candidateObjectPoints,  calibrationProjector.candidateBoardRotation, calibrationProjector.candidateBoardTranslation);// no final Re and te means identity transform
+                    {
+                        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+                        projection.project(BOARD_IN_PROJECTOR, calibrationProjector.candidateObjectPoints, testPoints); // (no extrinsics)
+                    }
                     calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(0,255,0), 9);
                     
                     
                     // Now, the REAL tests - i.e. true AR using camera/projector calibration:
                     // (a) Project over the printed chessboard using EXTRINSICS (this assumes projector calibration as well as stereo calibration):            
-                    testPoints=calibrationProjector.createImagePointsFrom3dPoints(calibrationCamera.candidateObjectPoints,  calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, rotCamToProj, transCamToProj);
+                    {
+                        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+                        projection.project(BOARD_IN_CAMERA, calibrationCamera.candidateObjectPoints, testPoints);
+                    }
                     calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255, 100,0,100), 8);
                     
                     // (b) Project over the projector pattern, but using the points seen by the camera, and the EXTRINSICS:
-                    testPoints=calibrationProjector.createImagePointsFrom3dPoints(calibrationProjector.candidateObjectPoints,  calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation,rotCamToProj, transCamToProj); 
+                    {
+                        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+                        projection.project(BOARD_IN_CAMERA, calibrationProjector.candidateObjectPoints, testPoints);
+                    }
                     calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(0,255,0,100), 8);
                 }
             }
@@ -556,7 +1139,12 @@ void testApp::draw() {
             gluOrtho2D(0,viewportProjector.width, viewportProjector.height, 0);
             glMatrixMode(GL_MODELVIEW);
             glLoadIdentity();
-            if (newBoardAquired==false) {
+            if (structuredLight) {
+                // Gray code pattern being acquired (full projector image):
+                ofSetColor(255);
+                structuredLightImage.draw(0, 0, PROJ_WIDTH, PROJ_HEIGHT);
+            }
+            else if (newBoardAquired==false) {
                 // NOTE: the size of the dots depends on the distance if we use openCV circles... if we have an estimate of the extrinsics, it is 
                 // better to do a good back-projection and use OpenGL to draw circles, then mantaining their real size.
                 calibrationProjector.drawCandidateProjectorPattern(0,0, PROJ_WIDTH, PROJ_HEIGHT, ofColor(255,255,255,255), 6);//calibrationProjector.myPatternShape.squareSize/4);
@@ -573,98 +1161,133 @@ void testApp::draw() {
             // perspective and modelview matrix. 
             drawHighlightString(" *** AR DEMO MODE ***", COMPUTER_DISP_WIDTH-300, 40, cyanPrint,  ofColor(255));
             
-            extrinsics="";
-            Mat rotCamToProj3x3;
-            Rodrigues(rotCamToProj, rotCamToProj3x3);
-            for (int i=0; i<3; i++) {
-                for (int j=0; j<3; j++)  extrinsics += ofToString(rotCamToProj3x3.at<double>(i,j),1) + "  "; 
-                extrinsics += ofToString(transCamToProj.at<double>(0,i),4)+" \n";
-            }
-            drawHighlightString(extrinsics, posTextX, posTextY+100, yellowPrint, ofColor(0));
+            projection.setIntrinsics(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(), calibrationProjector.getDistCoeffs());
+            projection.setExtrinsics(rotCamToProj, transCamToProj);
+            drawHighlightString(projection.getExtrinsicsText(1, 4), posTextX, posTextY+100, yellowPrint, ofColor(0));
             
-            if (calibrationCamera.candidatePatternDetected()) { 
-                
-                
-                // First, get the 3d coordinates of the FOUR conrners in CHESSBOARD coordinates:
-                vector<Point3f> corners; // define the four corners of the chessboard:
-                corners.push_back(calibrationCamera.candidateObjectPoints[0]);
-                corners.push_back(calibrationCamera.candidateObjectPoints[calibrationCamera.myPatternShape.getPatternSize().width-1]);
-                corners.push_back(calibrationCamera.candidateObjectPoints[calibrationCamera.myPatternShape.getPatternSize().width*
-                                                                          calibrationCamera.myPatternShape.getPatternSize().height-1]);
-                corners.push_back(calibrationCamera.candidateObjectPoints[calibrationCamera.myPatternShape.getPatternSize().width*
-                                                                          (calibrationCamera.myPatternShape.getPatternSize().height-1)]);
-                
-                
-                //(a) ========================= Draw using OpenGL ========================= 
-                // PROBLEM: For some unknown reason, the settings using openGL places the z=0 plane somehow below the real board plane. The 
-                // difference is noticeable (projecting using OpenCV projection works very well, but using openGL the points/images are not
-                // properly on the plane. One possible explanation is the problem with the task bar in OF_FULLSCREEN mode... 
-                // (1) Set viewport:
-                ofViewport(viewportProjector);
-                // (2) Set perspective matrix (using the projector intrinsics):
-                calibrationProjector.setOpenGLProjectionMatrix();
-                // (3) Set the proper modelview:
-                glMatrixMode(GL_MODELVIEW);
-                glLoadIdentity();
-                gluLookAt(0, 0, 0,   // position of camera
-                          0, 0, 1,   // looking towards the point (0,0,1) 
-                          0, -1, 0); // orientation
-                
-                Mat finalR, finalT;
-                composeRT(calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, // from model to camera
-                          rotCamToProj, transCamToProj, // extrinsics (from camera to projector)
-                          finalR, finalT); 
-                applyMatrix(makeMatrix(finalR, finalT));
-                ofScale(calibrationCamera.myPatternShape.squareSize, calibrationCamera.myPatternShape.squareSize, 0);
-                
-                //Draw something (image, whatever):
-                ofSetColor(0,255,0); ofNoFill();
-                ofSetLineWidth(2);
-                ofRect(0,0,calibrationCamera.myPatternShape.getPatternSize().width-1, calibrationCamera.myPatternShape.getPatternSize().height-1);
-            
-#ifdef MOVIE_PLAY
-                // Draw small images on the white squares of the chessboard:
-                ofSetColor(255);
-                for(int i = 0; i < calibrationCamera.myPatternShape.patternSize.height-1; i++)
-                    for(int j = 0; j < calibrationCamera.myPatternShape.patternSize.width/2-1+i%2; j++) {
-                        eyeMovie.draw(j*2+(i+1)%2,i,1,1); // note: ofScale ensures that each square is normalized
-                    }
-#endif
-                
-                //(b) ========================= Draw using OpenCV =========================
-                // (just for checking compatibility). Note: if we draw circles, the circles would NOT be in perspective here!
-                ofViewport(viewportProjector);
-                glMatrixMode(GL_PROJECTION);
-                glLoadIdentity();
-                gluOrtho2D(0,viewportProjector.width, viewportProjector.height, 0);
-                glMatrixMode(GL_MODELVIEW);
-                glLoadIdentity();
-                
-                // draw viewport limits:
-                ofSetLineWidth(5);
-                ofSetColor(255, 255, 255);
-                ofRect(0,0, viewportProjector.width, viewportProjector.height);
-                
-                // Project all corners of the printed chessboard using EXTRINSICS:
-                vector<Point2f> testPoints;
-                testPoints=calibrationProjector.createImagePointsFrom3dPoints(calibrationCamera.candidateObjectPoints,  calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, rotCamToProj, transCamToProj);
-                calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255, 0,0,255), 5);
-                
-                // Project the FOUR corners using the points seen by the camera, and the EXTRINSICS:
-                testPoints=calibrationProjector.createImagePointsFrom3dPoints(corners,  calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation,rotCamToProj, transCamToProj); 
-                calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255,255,0,255), 8);
-                
-                // Draw axis (and indicate (0,0)):
-                ofSetColor(255, 0, 255);
-                ofLine(testPoints[0].x, testPoints[0].y, testPoints[1].x, testPoints[1].y);
-                ofSetColor(0, 255, 255);
-                ofLine(testPoints[0].x, testPoints[0].y, testPoints[3].x, testPoints[3].y);
-
+            // from model to camera, then extrinsics (from camera to projector). The board pose is predicted at the time
+            // the projector will show this image (filtered pose + velocity), or the raw pose of the last detection:
+            if (multiTargetAR) {
+                // (one overlay per tracked board; all the boards share the printed pattern layout)
+                for (int i=0; i<targets.size(); i++) {
+                    const TrackedTarget& target=targets.getTarget(i);
+                    if (!target.visible) continue; // (not found in the last frame: no overlay from the filter alone)
+                    if (filterAR && target.filter.isValid()) 
+                        projection.setPose(BOARD_IN_CAMERA, target.filter.predict(FrameRing::nowMicros()+(unsigned long long)(arDisplayLatency*1000000), arMaxPrediction), true);
+                    else projection.setPose(BOARD_IN_CAMERA, target.rotation, target.translation, true);
+                    drawARBoard(targets.getObjectPoints());
+                }
+            }
+            else if (printedPatternVisible && calibrationCamera.candidatePatternDetected()) { 
+                if (filterAR && poseFilter.isValid()) {
+                    RigidPose predicted=poseFilter.predict(FrameRing::nowMicros()+(unsigned long long)(arDisplayLatency*1000000), arMaxPrediction);
+                    projection.setPose(BOARD_IN_CAMERA, predicted, true);
+                }
+                else projection.setPose(BOARD_IN_CAMERA, calibrationCamera.candidateBoardRotation, calibrationCamera.candidateBoardTranslation, true);
+                drawARBoard(calibrationCamera.candidateObjectPoints);
             }
             break;
             
     }
     
+    // Loopback latency measurement: the frame counter replaces the whole projector image
+    if (loopback.isRunning()) {
+        ofViewport(viewportProjector);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluOrtho2D(0,viewportProjector.width, viewportProjector.height, 0);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        loopback.draw(PROJ_WIDTH, PROJ_HEIGHT);
+    }
+    
+    // The projector image of the last processed frame is drawn:
+    latency.endFrame();
+}
+
+
+// AR_DEMO: draws the overlay of a printed board whose pose is in the BOARD_IN_CAMERA slot of the projection engine
+// (objectPoints: the board model points):
+void testApp::drawARBoard(const vector<Point3f>& objectPoints) {
+    // First, get the 3d coordinates of the FOUR conrners in CHESSBOARD coordinates:
+    Point3f corners[4]; // define the four corners of the chessboard (on the stack):
+    corners[0]=objectPoints[0];
+    corners[1]=objectPoints[calibrationCamera.myPatternShape.getPatternSize().width-1];
+    corners[2]=objectPoints[calibrationCamera.myPatternShape.getPatternSize().width*
+                            calibrationCamera.myPatternShape.getPatternSize().height-1];
+    corners[3]=objectPoints[calibrationCamera.myPatternShape.getPatternSize().width*
+                            (calibrationCamera.myPatternShape.getPatternSize().height-1)];
+    
+    
+    //(a) ========================= Draw using OpenGL ========================= 
+    // PROBLEM: For some unknown reason, the settings using openGL places the z=0 plane somehow below the real board plane. The 
+    // difference is noticeable (projecting using OpenCV projection works very well, but using openGL the points/images are not
+    // properly on the plane. One possible explanation is the problem with the task bar in OF_FULLSCREEN mode... 
+    // (1) Set viewport:
+    ofViewport(viewportProjector);
+    // (2) Set perspective matrix (using the projector intrinsics):
+    calibrationProjector.setOpenGLProjectionMatrix();
+    // (3) Set the proper modelview:
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    gluLookAt(0, 0, 0,   // position of camera
+              0, 0, 1,   // looking towards the point (0,0,1) 
+              0, -1, 0); // orientation
+    
+    // from model to camera (pose set by the caller), then extrinsics (from camera to projector):
+    applyMatrix(projection.getPoseMatrix(BOARD_IN_CAMERA)); // (same as makeMatrix, without the temporary Mats)
+    ofScale(calibrationCamera.myPatternShape.squareSize, calibrationCamera.myPatternShape.squareSize, 0);
+    
+    //Draw something (image, whatever):
+    ofSetColor(0,255,0); ofNoFill();
+    ofSetLineWidth(2);
+    ofRect(0,0,calibrationCamera.myPatternShape.getPatternSize().width-1, calibrationCamera.myPatternShape.getPatternSize().height-1);
+
+#ifdef MOVIE_PLAY
+    // Draw small images on the white squares of the chessboard:
+    ofSetColor(255);
+    for(int i = 0; i < calibrationCamera.myPatternShape.patternSize.height-1; i++)
+        for(int j = 0; j < calibrationCamera.myPatternShape.patternSize.width/2-1+i%2; j++) {
+            eyeMovie.draw(j*2+(i+1)%2,i,1,1); // note: ofScale ensures that each square is normalized
+        }
+#endif
+    
+    //(b) ========================= Draw using OpenCV =========================
+    // (just for checking compatibility). Note: if we draw circles, the circles would NOT be in perspective here!
+    ofViewport(viewportProjector);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0,viewportProjector.width, viewportProjector.height, 0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    
+    // draw viewport limits:
+    ofSetLineWidth(5);
+    ofSetColor(255, 255, 255);
+    ofRect(0,0, viewportProjector.width, viewportProjector.height);
+    
+    // Project all corners of the printed chessboard using EXTRINSICS:
+    vector<Point2f>& testPoints=projectedPoints;
+    {
+        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+        projection.project(BOARD_IN_CAMERA, objectPoints, testPoints);
+    }
+    latency.mark(MARK_PROJECTED);
+    calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255, 0,0,255), 5);
+    
+    // Project the FOUR corners using the points seen by the camera, and the EXTRINSICS:
+    {
+        ScopedStageTimer timer(profiler, STAGE_DRAW_PROJECTION);
+        testPoints.resize(4); // (within the capacity left by the full board projection above)
+        projection.project(BOARD_IN_CAMERA, corners, 4, &testPoints[0]);
+    }
+    calibrationProjector.drawArbitraryImagePoints(0,0, PROJ_WIDTH, PROJ_HEIGHT, testPoints, ofColor(255,255,0,255), 8);
+    
+    // Draw axis (and indicate (0,0)):
+    ofSetColor(255, 0, 255);
+    ofLine(testPoints[0].x, testPoints[0].y, testPoints[1].x, testPoints[1].y);
+    ofSetColor(0, 255, 255);
+    ofLine(testPoints[0].x, testPoints[0].y, testPoints[3].x, testPoints[3].y);
 }
 
 
@@ -689,6 +1312,66 @@ void testApp::saveExtrinsics(string filename, bool absolute) const {
 }
 
 
+// Load a calibration WITHOUT its boards (intrinsics, and the extrinsics stored with the projector calibration): from the
+// binary store if there is one (only the header is read), else from the YAML file. Returns true if the extrinsics
+// were found in the binary store.
+bool testApp::loadCalibration(EditableCalibration& calibration, string name, bool withExtrinsics) {
+    CalibrationStore store;
+    if (store.open(name+".bin") && store.toCalibration(calibration)) {
+        if (withExtrinsics && store.hasExtrinsics()) {
+            store.getExtrinsics(rotCamToProj, transCamToProj);
+            return true;
+        }
+        return false;
+    }
+    calibration.load(name+".yml");
+    // attention! load also load a set of image/object points! I don't need that:
+    calibration.deleteAllBoards();
+    return false;
+}
+
+// Resume an unfinished session from its checkpoints (key 'r'): the projector session if there is one, else the camera
+// session. The resume files only hold the intrinsics and the boards; the board poses are recomputed: camera poses by PnP
+// with the fixed intrinsics in the projector session (the projector is re-solved by the solver thread), one warm started
+// refinement in the camera session.
+bool testApp::resumeSession() {
+    CalibrationStore projectorResume, cameraResume;
+    if (projectorResume.open("calibrationProjector.resume.bin") && cameraResume.open("calibrationCameraStereo.resume.bin") &&
+        projectorResume.size()==cameraResume.size()) {
+        initialization(CAMERA_AND_PROJECTOR_PHASE1);
+        if (!cameraResume.toCalibration(calibrationCamera, true) || !projectorResume.toCalibration(calibrationProjector, true)) {
+            ofLogError() << "resumeSession: truncated resume file";
+            calibrationProjector.deleteAllBoards();
+            initialization(CAMERA_AND_PROJECTOR_PHASE1);
+            return false;
+        }
+        if (projectorResume.hasExtrinsics()) projectorResume.getExtrinsics(rotCamToProj, transCamToProj);
+        Mat cameraMatrix=calibrationCamera.getDistortedIntrinsics().getCameraMatrix(), distCoeffs=calibrationCamera.getDistCoeffs();
+        calibrationCamera.boardRotations.clear();
+        calibrationCamera.boardTranslations.clear();
+        for (int i=0; i<calibrationCamera.size(); i++) {
+            Mat rotation, translation;
+            solvePnP(Mat(calibrationCamera.objectPoints[i]), Mat(calibrationCamera.imagePoints[i]), cameraMatrix, distCoeffs, rotation, translation);
+            calibrationCamera.boardRotations.push_back(rotation);
+            calibrationCamera.boardTranslations.push_back(translation);
+        }
+        if (calibrationProjector.size()>0) solver.submit(calibrationCamera, calibrationProjector, rotCamToProj, transCamToProj);
+    } else if (cameraResume.open("calibrationCamera.resume.bin")) {
+        initialization(CAMERA_ONLY);
+        if (!cameraResume.toCalibration(calibrationCamera, true)) {
+            ofLogError() << "resumeSession: truncated resume file";
+            calibrationCamera.deleteAllBoards();
+            return false;
+        }
+        if (calibrationCamera.size()>0) IncrementalCalibration::refine(calibrationCamera);
+    } else {
+        return false;
+    }
+    rebuildCoverage();
+    eventLog.message(MSG_SESSION_RESUMED, calibrationCamera.size(), calibrationProjector.size());
+    return true;
+}
+
 void testApp::loadExtrinsics(string filename, bool absolute) {
     FileStorage fs(ofToDataPath(filename, absolute), FileStorage::READ);
     fs["Rotation_Vector"] >> rotCamToProj;
@@ -711,6 +1394,23 @@ void testApp::keyPressed(int key) {
     if (key=='p') dynamicProjection=!dynamicProjection; // toggle between fixed or dynamic (following) projection. 
     if (key=='o') dynamicProjectionInside=!dynamicProjectionInside;
     
+    if (key=='r') resumeSession(); // continue the unfinished calibration session from its resume files
+    if (key=='g') startStructuredLight(); // dense projector board from a Gray code sequence (camera must be calibrated)
+    if (key=='c') displayCoverage=!displayCoverage; // image regions still needing boards (camera image, and projector map)
+    if (key=='v') displayPreprocessed=!displayPreprocessed; // segmented images of the calibration objects (refreshed every frame while shown)
+    if (key=='u') displayUndistorted=!displayUndistorted; // show the camera image undistorted (once the camera is calibrated)
+    if (key=='t') displayProfiler=!displayProfiler; // on-screen stage timings for the current state
+    if (key=='T') profiler.dump("profile.txt");
+    if (key=='L') latency.dump("latency.txt"); // capture -> projector latency, per segment and per frame
+    if (key=='l') { // glass to glass latency (projected frame counter read back by the camera)
+        if (loopback.isRunning()) loopback.stop();
+        else if (!replayMode && !structuredLight) loopback.start();
+    }
+    
+    if (key=='k') {trackingAR=!trackingAR; cornerTracker.reset();} // track the printed pattern in AR_DEMO (or detect it on every frame)
+    if (key=='f') filterAR=!filterAR; // AR_DEMO: predicted (filtered) pose, or raw pose of the last detection
+    if (key=='n') {multiTargetAR=!multiTargetAR; targets.reset(); cornerTracker.reset();} // AR_DEMO: all the boards in view, or the calibration pattern only
+    
     if (key=='d') displayAR=!displayAR; // this is just for test to see how it is going. But better not to use during 
     // calibration, because it interferes with the detection. 
 }
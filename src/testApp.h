@@ -2,6 +2,29 @@
 
 #include "ofMain.h"
 #include "ofxCv.h"
+#include "CalibrationSolver.h"
+#include "ReplaySource.h"
+#include "CaptureThread.h"
+#include "UndistortionCache.h"
+#include "CalibrationStore.h"
+#include "ProjectionEngine.h"
+#include "StageProfiler.h"
+#include "MotionGate.h"
+#include "FramePreprocessor.h"
+#include "BoardPrecheck.h"
+#include "CornerTracker.h"
+#include "ProjectedPatternDetector.h"
+#include "GrayCodePattern.h"
+#include "IncrementalCalibration.h"
+#include "BoardCleaner.h"
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include "EventLog.h"
+#include "LatencyTrace.h"
+#include "LoopbackLatency.h"
+#include "PoseFilter.h"
+#include "MultiTargetTracker.h"
+#include "CoverageMap.h"
 
 // ==================================================================
 // WE NEED TO DEFINE HERE the size of the computer screen and the projector screen. This cannot be done using ofGetScreenWidth() and the like
@@ -31,18 +54,106 @@ enum CalibState {CAMERA_ONLY, CAMERA_AND_PROJECTOR_PHASE1, CAMERA_AND_PROJECTOR_
 
 class testApp : public ofBaseApp {
 public:
+    testApp();
 	void setup();
 	void update();
 	void draw();
 	void keyPressed(int key);
+	void exit();
 	
     void initialization(CalibState initialmode); 
     
-	ofVideoGrabber cam;
+    // Process one acquired frame (live grabber or replay): motion test, detection and calibration state machine.
+    void processFrame(cv::Mat camMat, float curTime);
+    bool detectPrintedPattern();
+    void computePrintedBoardPose();
+    bool isRedundantBoard(bool withProjector);
+    void rebuildCoverage();
+    // Image coverage and pose diversity of the accepted boards ('c' to display):
+    CoverageMap cameraCoverage, projectorCoverage;
+    bool displayCoverage;
+    bool detectProjectedPattern(unsigned long long& micros);
+    ProjectedPatternDetector projectedDetector;
+    vector<cv::Point2f> predictedDots; // (camera image positions of the following pattern dots, set in PHASE1)
+    
+    // Dense projector board from a Gray code sequence (key 'g'):
+    GrayCodePattern grayCode;
+    bool structuredLight;
+    int structuredLightStep, structuredLightWait;
+    vector<cv::Mat> structuredLightFrames;
+    ofImage structuredLightImage; // pattern being projected
+    void startStructuredLight();
+    void stopStructuredLight(LogRejectReason reason);
+    void showStructuredLightPattern();
+    void processStructuredLight();
+    cv::Mat currentFrame; // frame being processed (header only)
+    FramePreprocessor preprocessor; // gray + pyramid of the current (and previous) frame
+    void preprocessCamera(), preprocessProjector(); // addImageToProcess, at most once per frame
+    bool cameraPreprocessed, projectorPreprocessed;
+    bool projectorSegmentsGray; // the projector pattern color is a gray level: its segmentation starts from the shared gray image
+    // Preprocessed (segmented) images of the calibration objects ('v'): only the shown ones are refreshed every frame:
+    bool displayPreprocessed;
+    bool showsCameraPreprocessed() const, showsProjectorPreprocessed() const;
+    BoardPrecheck boardPrecheck;
+    vector<cv::Point2f> precheckCorners; // (refined at full resolution: the detection of the precheck states)
+    vector<cv::Point3f> printedObjectPoints; // printed pattern layout (candidate object points of the refined precheck corners)
+    bool printedPatternVisible; // result of the last detection of the printed pattern
+    bool trackPrintedPattern();
+    CornerTracker cornerTracker;
+    vector<cv::Point2f> trackedCorners;
+    bool trackingAR;
+    
+    // Per-stage timings ('t' to display, 'T' to save in data/profile.txt):
+    StageProfiler profiler;
+    bool displayProfiler;
+    
+    // Frame boundary (scratch memory reset, state changes, timing logs), and heap allocations of the frame processing of
+    // the main thread:
+    FrameArena frameArena;
+    void endFrame();
+    void countFrameAllocations();
+    unsigned long long frameStartAllocations, lastFrameAllocations;
+    int framesInState, steadyStateAllocatingFrames;
+    CalibState lastFrameState;
+    
+    // Events of the frame thread (state changes, boards accepted/rejected, errors, timings), written by a background thread:
+    EventLog eventLog;
+    float lastTimingLog;
+    
+    // Capture -> projector latency of each frame ('L' to save in data/latency.txt), and glass to glass loopback ('l'):
+    LatencyTrace latency;
+    LoopbackLatency loopback;
+    unsigned long long frameCaptureMicros; // capture timestamp of the frame being processed
+    
+    // AR_DEMO: board pose smoothed and extrapolated to the projector display time ('f' to use the raw pose):
+    PoseFilter poseFilter;
+    bool filterAR;
+    
+    // AR_DEMO: several printed boards tracked and drawn at the same time ('n' to toggle):
+    MultiTargetTracker targets;
+    bool multiTargetAR;
+    void drawARBoard(const vector<cv::Point3f>& objectPoints); // (pose in the BOARD_IN_CAMERA slot)
+    
+    // Headless replay mode (no camera, no window; see main.cpp): the recorded frames go through processFrame as fast as 
+    // possible, and we report the throughput and the number of acquired boards at the end. 
+    void setReplay(string path, CalibState initialMode, float fps = 30);
+    void updateReplay();
+    void reportReplay();
+    bool replayMode;
+    string replayPath;
+    float replayFps;
+    CalibState replayInitialMode;
+    ReplaySource replay;
+    unsigned long long replayStartTime;
+    int boardsAcceptedCamera, boardsAcceptedStereo;
+    
+    CaptureThread capture; // camera grabber polled in its own thread
+    ofImage camImage;      // last processed frame (display)
 	ofImage undistorted;
+    UndistortionCache undistortion; // cached undistortion maps of the camera
+    bool displayUndistorted;
     
- 	ofPixels previous; 
-	ofPixels diff;
+    MotionGate motionGate; // motion test between successive frames
 	float diffMean;
 	
 	float lastTime;
@@ -57,13 +168,31 @@ public:
     
     // VARIABLES and METHODS THAT SHOULD BELONG TO A STEREO-CALIBRATION OBJECT (probably using multiple cameras and projectors)
 	ofRectangle viewportComputer, viewportProjector;
-    ofxCv::Calibration calibrationCamera, calibrationProjector;
+    EditableCalibration calibrationCamera, calibrationProjector;
     CalibState stateCalibration;
     
+    // Projector calibration, cleaning and stereo calibration run here (off the frame thread):
+    CalibrationSolver solver;
+    IncrementalCalibration incrementalCamera;
+    
     //Extrinsics (should belong to the Stereo calibration object)
     cv::Mat rotCamToProj, transCamToProj; // in fact, there should be one pair of these for all the possible pairs camera-projector, camera-camera, projector-projector. 
-    string extrinsics;
+    ProjectionEngine projection; // board points -> projector image (poses composed with the extrinsics only when they change)
+    enum {BOARD_IN_PROJECTOR, BOARD_IN_CAMERA, FOLLOWING_PATTERN}; // pose slots of the projection engine
+    vector<cv::Point2f> projectedPoints;
+    // Projector pattern following the printed board: fixed size storage for the known layout, else dynamic (not NULL):
+    typedef FixedPattern<4, 5> FollowingLayout;
+    FollowingLayout followingPatternFixed;
+    ofPtr<DynamicPattern> followingPatternDynamic;
+    template<class Layout> void projectFollowingPattern(Layout& layout, const cv::Point3f& origin, const cv::Point3f& axisX,
+                                                        const cv::Point3f& axisY, const RigidPose& boardToProjector);
+    vector<cv::Point2f> followingPatternImagePoints;
     void saveExtrinsics(string filename, bool absolute = false) const;
     void loadExtrinsics(string filename, bool absolute = false);
+    bool loadCalibration(EditableCalibration& calibration, string name, bool withExtrinsics = false);
+    // Per board checkpoints of the session in progress (calibrationCamera.resume.bin; in PHASE1/2,
+    // calibrationProjector.resume.bin and the camera boards paired with it, calibrationCameraStereo.resume.bin):
+    CalibrationStore cameraStore, projectorStore, cameraStereoStore;
+    bool resumeSession();
     
 };